@@ -0,0 +1,31 @@
+#ifndef BENCHMARK_TUTO_HPP
+#define BENCHMARK_TUTO_HPP
+
+#include <cstddef>
+#include <string>
+
+namespace app {
+
+// Scene loading benchmarks, run without any window or Vulkan setup:
+//   vulkan_learning --bench-load <obj> [maxThreads]
+// compares the vertex dedup containers on the OBJ data, then times the mesh
+// building from the tinyobj output and the streaming parser for
+// 1..maxThreads threads.
+int runLoadBenchmark(const std::string& objPath, std::size_t maxThreads);
+
+// Transform hierarchy benchmark, without any window:
+//   vulkan_learning --bench-transforms [nodeCount] [maxThreads]
+// times the world matrix update of nodeCount nodes (100000 by default) when
+// every node moves and when 1% of them do, for 1..maxThreads threads.
+int runTransformBenchmark(std::size_t nodeCount, std::size_t maxThreads);
+
+// Draw submission benchmark, in a window:
+//   vulkan_learning --bench-draw [meshCount] [frames]
+// draws a grid of meshCount small meshes (10000 by default) with every
+// vulkan::DrawMode, then the same grid as instances of a single mesh, and
+// prints the CPU recording and GPU times per frame.
+int runDrawBenchmark(std::size_t meshCount, std::size_t frames);
+
+} // namespace app
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef MAPPED_FILE_TUTO_HPP
+#define MAPPED_FILE_TUTO_HPP
+
+#include <cstddef>
+#include <string>
+
+namespace scene {
+
+// read-only memory mapping of a whole file
+class MappedFile {
+  public:
+    MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    const char* data() const {
+        return _data;
+    }
+    std::size_t size() const {
+        return _size;
+    }
+
+  private:
+    void _unmap();
+
+    const char* _data = nullptr;
+    std::size_t _size = 0;
+#ifdef _WIN32
+    void* _fileHandle = nullptr;
+    void* _mappingHandle = nullptr;
+#endif
+};
+
+} // namespace scene
+
+#endif
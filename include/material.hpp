@@ -0,0 +1,28 @@
+#ifndef MATERIAL_TUTO_HPP
+#define MATERIAL_TUTO_HPP
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_FORCE_MESSAGES
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+namespace scene {
+
+// what the renderer uses of an MTL material
+struct MaterialData {
+    std::string name;
+    // Kd, multiplies the texture
+    glm::vec3 diffuse{1.0f};
+    // map_Kd, relative to the working directory, empty without a texture
+    std::string diffuseTexture;
+};
+
+// materials of an MTL library in file order, throws if it can't be read
+std::vector<MaterialData> parseMtl(const std::string& mtlPath);
+
+} // namespace scene
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef MESH_BUILDER_TUTO_HPP
+#define MESH_BUILDER_TUTO_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "material.hpp"
+#include "mesh_data.hpp"
+#include "mesh_optimizer.hpp"
+#include "thread_pool.hpp"
+#include "tiny_obj_loader.h"
+
+namespace scene {
+
+struct LoadOptions {
+    // threads used to build the meshes, 0 means one per core
+    std::size_t threadCount = 0;
+    // read and write the binary mesh cache next to the OBJ file
+    bool useCache = true;
+    // MeshOptimization passes run before the upload (and the cache write)
+    uint32_t optimizations = allMeshOptimizations;
+    // layout of the GPU vertex buffers
+    vulkan::VertexFormat vertexFormat = vulkan::VertexFormat::Packed;
+    // texture of the default material, used by the faces without a material
+    std::string defaultTexture;
+};
+
+// shapes with more indices than this are deduplicated in several chunks
+constexpr std::size_t dedupChunkSize = 3 * (1 << 16);
+
+// vertex of an OBJ face corner, with the axis swizzle and V flip applied
+Vertex makeObjVertex(const tinyobj::attrib_t& attrib,
+                     const tinyobj::index_t& index);
+
+// Turns tinyobj shapes into deduplicated vertex/index arrays, one MeshData
+// per shape. Shapes (and chunks of large shapes) are processed in parallel
+// on the pool, chunks of a shape are then merged in order so the output is
+// the same as a sequential build.
+std::vector<MeshData> buildMeshes(const tinyobj::attrib_t& attrib,
+                                  const std::vector<tinyobj::shape_t>& shapes,
+                                  ThreadPool& pool);
+
+// merges the separately deduplicated chunks [begin, end) of one shape,
+// chunks are consumed
+MeshData mergeMeshChunks(std::vector<MeshData>& chunks, std::size_t begin,
+                         std::size_t end);
+
+// loads an OBJ file and its materials with the streaming parser, see
+// parseObj()
+std::vector<MeshData>
+loadObjMeshes(const std::string& objPath, ThreadPool& pool,
+              std::vector<MaterialData>& materials,
+              std::vector<std::string>* libraries = nullptr);
+
+} // namespace scene
+
+#endif
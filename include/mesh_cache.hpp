@@ -0,0 +1,50 @@
+#ifndef MESH_CACHE_TUTO_HPP
+#define MESH_CACHE_TUTO_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "mapped_file.hpp"
+#include "material.hpp"
+#include "mesh_data.hpp"
+
+namespace scene {
+
+// Binary cache of the deduplicated meshes of an OBJ file, stored next to it
+// as "<objPath>.meshcache". The cache is keyed by the source path, size and
+// modification time; the content hash is only checked when the size matches
+// but the modification time does not (e.g. after a copy or a touch). The
+// MeshOptimization mask the meshes went through is stored as well, a cache
+// built with other passes is ignored. The materials are stored with the
+// meshes, along with the size and modification time of the MTL libraries
+// they come from: changing, adding or removing one invalidates the cache.
+class MeshCache {
+  public:
+    static std::optional<MeshCache> open(const std::string& sourcePath,
+                                         uint32_t optimizations);
+    // libraries are the paths of the mtllib libraries, see parseObj()
+    static void write(const std::string& sourcePath,
+                      const std::vector<std::string>& libraries,
+                      const std::vector<MeshData>& meshes,
+                      const std::vector<MaterialData>& materials,
+                      uint32_t optimizations);
+    static std::string cachePath(const std::string& sourcePath);
+
+    std::size_t meshCount() const;
+    MeshView mesh(std::size_t index) const;
+    // MeshData::material of a mesh
+    uint32_t material(std::size_t index) const;
+    std::vector<MaterialData> materials() const;
+
+  private:
+    MeshCache(MappedFile file);
+
+    MappedFile _file;
+};
+
+} // namespace scene
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef MESH_DATA_TUTO_HPP
+#define MESH_DATA_TUTO_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "vulkan/mesh.hpp"
+
+namespace scene {
+
+using vulkan::MeshLod;
+using vulkan::Meshlet;
+using vulkan::MeshView;
+using vulkan::Vertex;
+
+// CPU side geometry of a single shape, ready to be uploaded
+struct MeshData {
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    // index ranges of the levels of detail, finest first, all indexing the
+    // same vertices; empty when the whole index buffer is the only level
+    std::vector<MeshLod> lods;
+    // clusters of the full resolution level, empty if they were not built
+    std::vector<Meshlet> meshlets;
+    std::vector<uint32_t> meshletVertices;
+    std::vector<uint32_t> meshletTriangles;
+    // in the materials of the scene, 0 is the default one
+    uint32_t material = 0;
+
+    MeshView view() const {
+        return MeshView{vertices.data(),         vertices.size(),
+                        indices.data(),          indices.size(),
+                        lods.data(),             lods.size(),
+                        meshlets.data(),         meshlets.size(),
+                        meshletVertices.data(),  meshletVertices.size(),
+                        meshletTriangles.data(), meshletTriangles.size()};
+    }
+};
+
+} // namespace scene
+
+#endif
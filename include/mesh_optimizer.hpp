@@ -0,0 +1,92 @@
+#ifndef MESH_OPTIMIZER_TUTO_HPP
+#define MESH_OPTIMIZER_TUTO_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "mesh_data.hpp"
+#include "thread_pool.hpp"
+
+namespace scene {
+
+// Optimization passes run on the meshes between the vertex dedup and the
+// upload. The mask is stored in the mesh cache, a cache built with other
+// passes is rebuilt.
+enum MeshOptimization : uint32_t {
+    // reorder triangles for the post-transform vertex cache (Tipsify)
+    OptimizeVertexCache = 1u << 0,
+    // sort triangle clusters so that outward facing ones are drawn first
+    OptimizeOverdraw = 1u << 1,
+    // renumber vertices in index access order, drops unused vertices
+    OptimizeVertexFetch = 1u << 2,
+    // append a chain of simplified levels of detail to the index buffer
+    GenerateLods = 1u << 3,
+    // split the full resolution level into meshlets for GPU culling
+    BuildMeshlets = 1u << 4,
+    // split meshes with too many vertices for 16 bit indices, runs first
+    SplitForShortIndices = 1u << 5,
+};
+
+constexpr uint32_t allMeshOptimizations
+    = OptimizeVertexCache | OptimizeOverdraw | OptimizeVertexFetch
+      | GenerateLods | BuildMeshlets | SplitForShortIndices;
+
+// post-transform cache behaviour of an index buffer, simulated as a FIFO
+struct VertexCacheStats {
+    std::size_t misses = 0;
+    std::size_t triangles = 0;
+    std::size_t vertices = 0;
+
+    // average cache miss ratio, transformed vertices per triangle
+    double acmr() const;
+    // average transform to vertex ratio, 1.0 is optimal
+    double atvr() const;
+
+    VertexCacheStats& operator+=(const VertexCacheStats& other);
+};
+
+// FIFO size used for the simulation, close to what current GPUs behave like
+constexpr std::size_t vertexCacheSize = 16;
+
+VertexCacheStats analyzeVertexCache(const uint32_t* indices,
+                                    std::size_t indexCount,
+                                    std::size_t vertexCount,
+                                    std::size_t cacheSize = vertexCacheSize);
+
+// Tipsify (Sander et al. 2007): fans around the last emitted vertices while
+// they are still in the cache, linear in the index count.
+void optimizeVertexCache(std::vector<uint32_t>& indices,
+                         std::size_t vertexCount,
+                         std::size_t cacheSize = vertexCacheSize);
+
+// Splits the index buffer into clusters where the vertex cache restarts
+// (and where the cache efficiency of the cluster is already within threshold
+// of the whole run), then sorts the clusters so that the ones facing away
+// from the mesh center come first. Drawn first, they occlude the inner ones
+// from most viewpoints. Meant to run after optimizeVertexCache().
+void optimizeOverdraw(std::vector<uint32_t>& indices,
+                      const std::vector<Vertex>& vertices,
+                      float threshold = 1.05f);
+
+// Fills mesh.lods: every level halves the triangle count of the previous one
+// with simplifyMesh(), until it gets small or stops simplifying. Levels are
+// appended to mesh.indices and keep the same vertices.
+void generateLods(MeshData& mesh, bool optimizeCache);
+
+// reorders the vertex buffer in first use order, so that vertex fetch walks
+// memory sequentially, and rewrites the indices accordingly
+void optimizeVertexFetch(MeshData& mesh);
+
+// Splits mesh into parts of at most maxVertices vertices each, taking its
+// triangles in order. Only the vertices and indices are kept, the other
+// passes must run after.
+std::vector<MeshData> splitMesh(const MeshData& mesh, std::size_t maxVertices);
+
+// runs the passes of the optimizations mask on every mesh, in parallel
+void optimizeMeshes(std::vector<MeshData>& meshes, uint32_t optimizations,
+                    ThreadPool& pool);
+
+} // namespace scene
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef MESH_SIMPLIFY_TUTO_HPP
+#define MESH_SIMPLIFY_TUTO_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "mesh_data.hpp"
+
+namespace scene {
+
+// Quadric error edge collapse (Garland and Heckbert 1997) over an index
+// buffer, vertices only move onto other existing vertices so the result
+// indexes the same vertex buffer. Vertices on borders and on attribute seams
+// (several vertices at one position) are kept in place.
+//
+// Returns the simplified indices, with at most targetIndexCount of them if
+// it could get there, and sets error to the distance between the original
+// and the simplified surface, estimated from the worst collapse.
+std::vector<uint32_t> simplifyMesh(const std::vector<Vertex>& vertices,
+                                   const uint32_t* indices,
+                                   std::size_t indexCount,
+                                   std::size_t targetIndexCount, float& error);
+
+} // namespace scene
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef MESHLET_BUILDER_TUTO_HPP
+#define MESHLET_BUILDER_TUTO_HPP
+
+#include "mesh_data.hpp"
+
+namespace scene {
+
+// Splits the full resolution level of mesh into meshlets of at most
+// maxMeshletVertices vertices and maxMeshletTriangles triangles, filling
+// mesh.meshlets, mesh.meshletVertices and mesh.meshletTriangles. Triangles
+// are taken in index buffer order, so the index buffer should already be
+// optimized for the vertex cache to get compact meshlets.
+void buildMeshlets(MeshData& mesh);
+
+} // namespace scene
+
+#endif
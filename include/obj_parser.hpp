@@ -0,0 +1,45 @@
+#ifndef OBJ_PARSER_TUTO_HPP
+#define OBJ_PARSER_TUTO_HPP
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "material.hpp"
+#include "mesh_data.hpp"
+#include "thread_pool.hpp"
+
+namespace scene {
+
+// Streaming OBJ front-end producing the same meshes as buildMeshes() on the
+// tinyobj output, one per o/g group that has faces, further split where
+// usemtl changes the material.
+//
+// The file is memory mapped and cut into line aligned chunks. A first pass
+// counts the "v"/"vt" statements of every chunk so that a second, parallel
+// pass can write positions and texture coordinates (swizzled and V flipped)
+// straight to their final slot and resolve face indices, including negative
+// ones. Faces are kept as compact (position, texcoord) pairs and fed to the
+// vertex dedup; normals, colors and the tinyobj attrib_t are never built.
+//
+// materials gets a default material followed by those of the mtllib
+// libraries, MeshData::material indexes it. Faces before any usemtl, or with
+// a material no library defines, use the default one. libraries, if given,
+// gets the paths of the mtllib libraries, including those that can't be read.
+std::vector<MeshData> parseObj(const std::string& objPath, ThreadPool& pool,
+                               std::vector<MaterialData>& materials,
+                               std::vector<std::string>* libraries = nullptr);
+
+// Same, but the shapes are deduplicated in waves of a few million corners
+// and each wave is handed to onMeshes, on the calling thread and in file
+// order, as soon as it is built. materials is filled before the first call.
+// onMeshes may consume the meshes, returning false stops the parsing.
+// Returns false if it was stopped.
+bool parseObj(const std::string& objPath, ThreadPool& pool,
+              std::vector<MaterialData>& materials,
+              std::vector<std::string>* libraries,
+              const std::function<bool(std::vector<MeshData>&)>& onMeshes);
+
+} // namespace scene
+
+#endif
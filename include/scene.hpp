@@ -9,8 +9,19 @@
 #define GLM_FORCE_MESSAGES
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
 #include <vector>
 
+#include "material.hpp"
+#include "mesh_builder.hpp"
+#include "mesh_data.hpp"
 #include "vulkan/buffer_manager.hpp"
 #include "vulkan/mesh.hpp"
 
@@ -25,11 +36,47 @@ struct UniformBufferObject {
 };
 
 struct Scene {
-    Scene(vulkan::BufferManager& bufferManager, const std::string& objPath);
+    Scene(vulkan::BufferManager& bufferManager, const std::string& objPath,
+          const LoadOptions& options = {});
 
-    std::vector<vulkan::Mesh> meshes;
+    // Mesh owns GPU buffers, a deque never moves them
+    std::deque<vulkan::Mesh> meshes;
+    // Mesh::material() indexes them, the first one is the default material
+    std::vector<MaterialData> materials;
+};
 
-    glm::mat4 getModelMatrix() const;
+// Scene loaded on a background thread: parsing, dedup and upload all happen
+// off the render thread, and meshes are handed to the renderer one by one as
+// soon as their buffers are resident.
+class AsyncScene {
+  public:
+    AsyncScene(vulkan::BufferManager& bufferManager, const std::string& objPath,
+               const LoadOptions& options = {});
+    ~AsyncScene();
+
+    AsyncScene(const AsyncScene&) = delete;
+    AsyncScene& operator=(const AsyncScene&) = delete;
+
+    // the materials the meshes index, once they are known and before any
+    // mesh is resident; empty afterwards
+    std::optional<std::vector<MaterialData>> takeMaterials();
+    // meshes that became resident since the last call, rethrows the loading
+    // error if there was one
+    std::vector<const vulkan::Mesh*> takeResidentMeshes();
+    bool isLoaded() const;
+
+  private:
+    void _load(vulkan::BufferManager& bufferManager, const std::string& objPath,
+               const LoadOptions& options);
+
+    std::mutex _mutex;
+    std::optional<std::vector<MaterialData>> _materials;
+    std::vector<std::unique_ptr<vulkan::Mesh>> _meshes;
+    std::size_t _taken = 0;
+    std::exception_ptr _error;
+    std::atomic<bool> _cancelled{false};
+    std::atomic<bool> _loaded{false};
+    std::thread _thread;
 };
 
 struct Camera {
@@ -60,22 +107,4 @@ struct Camera {
 
 } // namespace scene
 
-namespace std {
-template <> struct hash<scene::Vertex> {
-    std::size_t operator()(const scene::Vertex& vertex) const {
-        auto hasher = std::hash<float>();
-        auto x = hasher(vertex.pos.x);
-        auto y = hasher(vertex.pos.y);
-        auto z = hasher(vertex.pos.z);
-        auto r = hasher(vertex.color.r);
-        auto g = hasher(vertex.color.g);
-        auto b = hasher(vertex.color.b);
-        auto u = hasher(vertex.texCoord.x);
-        auto v = hasher(vertex.texCoord.y);
-
-        return x ^ y ^ z ^ r ^ g ^ b ^ u ^ v;
-    }
-};
-} // namespace std
-
 #endif
@@ -0,0 +1,111 @@
+#ifndef THREAD_POOL_TUTO_HPP
+#define THREAD_POOL_TUTO_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace scene {
+
+class ThreadPool {
+  public:
+    // 0 means one thread per hardware core
+    explicit ThreadPool(std::size_t threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // number of threads taking part in parallelFor (workers + caller)
+    std::size_t size() const {
+        return _workers.size() + 1;
+    }
+
+    template <class F> auto submit(F&& task) -> std::future<decltype(task())>;
+
+    // runs fn(i) for every i in [0, count) and returns once all are done,
+    // the calling thread takes part in the work
+    template <class F> void parallelFor(std::size_t count, F&& fn);
+
+  private:
+    void _enqueue(std::function<void()> task);
+    void _workerLoop();
+
+    std::vector<std::thread> _workers;
+    std::deque<std::function<void()>> _tasks;
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    bool _stopping = false;
+};
+
+template <class F>
+auto ThreadPool::submit(F&& task) -> std::future<decltype(task())> {
+    using R = decltype(task());
+    auto packaged
+        = std::make_shared<std::packaged_task<R()>>(std::forward<F>(task));
+    auto future = packaged->get_future();
+    if (_workers.empty()) {
+        (*packaged)();
+    } else {
+        _enqueue([packaged]() { (*packaged)(); });
+    }
+    return future;
+}
+
+template <class F> void ThreadPool::parallelFor(std::size_t count, F&& fn) {
+    if (count == 0) {
+        return;
+    }
+
+    struct State {
+        std::atomic<std::size_t> next{0};
+        std::atomic<std::size_t> done{0};
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::exception_ptr error;
+    };
+    auto state = std::make_shared<State>();
+
+    auto run = [state, count, &fn]() {
+        std::size_t i;
+        while ((i = state->next.fetch_add(1)) < count) {
+            try {
+                fn(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (!state->error) {
+                    state->error = std::current_exception();
+                }
+            }
+            if (state->done.fetch_add(1) + 1 == count) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->cv.notify_all();
+            }
+        }
+    };
+
+    auto helpers = std::min(_workers.size(), count - 1);
+    for (std::size_t i = 0; i < helpers; ++i) {
+        _enqueue(run);
+    }
+    run();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->cv.wait(lock, [&]() { return state->done.load() == count; });
+    if (state->error) {
+        std::rethrow_exception(state->error);
+    }
+}
+
+} // namespace scene
+
+#endif
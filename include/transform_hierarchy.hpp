@@ -0,0 +1,82 @@
+#ifndef TRANSFORM_HIERARCHY_TUTO_HPP
+#define TRANSFORM_HIERARCHY_TUTO_HPP
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_FORCE_MESSAGES
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+namespace scene {
+
+// placement of a node relative to its parent, applied as scale, rotation
+// then translation
+struct Transform {
+    glm::vec3 translation{0.0f};
+    glm::quat rotation{1.0f, 0.0f, 0.0f, 0.0f};
+    glm::vec3 scale{1.0f};
+};
+
+using NodeId = uint32_t;
+constexpr NodeId noParent = std::numeric_limits<NodeId>::max();
+
+// Local and world transforms of a tree of nodes, stored as arrays of each
+// component sorted by depth so a level only reads the finished world
+// matrices of the one before. Changing a local transform marks the node
+// dirty, update() recomputes the world matrices of the dirty nodes and their
+// descendants, each level in parallel. Node ids are stable, the storage
+// order is not. The renderer places the meshes of its scene with one, see
+// Renderer::transforms().
+class TransformHierarchy {
+  public:
+    // parent must already exist
+    NodeId add(const Transform& local, NodeId parent = noParent);
+    void setLocal(NodeId node, const Transform& local);
+    Transform local(NodeId node) const;
+
+    // returns the number of world matrices recomputed
+    std::size_t update(ThreadPool& pool);
+    // as of the last update()
+    const glm::mat4& worldMatrix(NodeId node) const {
+        return _worlds[_slots[node]];
+    }
+    // world matrix of node i at destination[i] for every node, e.g. into a
+    // mapped buffer to upload all of them at once
+    void copyWorldMatrices(glm::mat4* destination) const;
+
+    std::size_t size() const {
+        return _ids.size();
+    }
+
+  private:
+    void _sortByDepth();
+
+    // by slot, in depth order once sorted
+    std::vector<glm::vec3> _translations;
+    std::vector<glm::quat> _rotations;
+    std::vector<glm::vec3> _scales;
+    std::vector<glm::mat4> _worlds;
+    std::vector<uint32_t> _parentSlots;
+    std::vector<uint32_t> _depths;
+    std::vector<uint8_t> _dirty;
+    std::vector<NodeId> _ids;
+
+    // by node id
+    std::vector<uint32_t> _slots;
+
+    // slots [_levels[d], _levels[d + 1]) are at depth d
+    std::vector<uint32_t> _levels;
+    bool _sorted = true;
+    bool _anyDirty = false;
+};
+
+} // namespace scene
+
+#endif
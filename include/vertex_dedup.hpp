@@ -0,0 +1,80 @@
+#ifndef VERTEX_DEDUP_TUTO_HPP
+#define VERTEX_DEDUP_TUTO_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#include "mesh_data.hpp"
+
+namespace scene {
+
+// -0.0f turned into 0.0f, so that the raw bits of vertices equal as floats
+// (OBJ exporters often write -0.000000) are the same
+inline Vertex withoutNegativeZeros(Vertex vertex) {
+    vertex.pos += glm::vec3(0.0f);
+    vertex.color += glm::vec3(0.0f);
+    vertex.texCoord += glm::vec2(0.0f);
+    return vertex;
+}
+
+// hash over the raw bits of every vertex component, the components are mixed
+// in order so swapped coordinates don't collide. The vertex must already be
+// without negative zeros.
+uint64_t hashCanonicalVertex(const Vertex& vertex);
+
+inline uint64_t hashVertex(const Vertex& vertex) {
+    return hashCanonicalVertex(withoutNegativeZeros(vertex));
+}
+
+inline bool sameCanonicalVertexBits(const Vertex& a, const Vertex& b) {
+    return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+}
+
+inline bool sameVertexBits(const Vertex& a, const Vertex& b) {
+    return sameCanonicalVertexBits(withoutNegativeZeros(a),
+                                   withoutNegativeZeros(b));
+}
+
+// Flat open addressing (linear probing) table used to deduplicate vertices.
+// Slots only hold an index into the output vertex array plus a hash tag, so
+// a lookup touches one cache line of slots and at most one vertex.
+class VertexDeduplicator {
+  public:
+    // expectedCount is an upper bound of the unique vertices, usually the
+    // number of indices of the shape
+    VertexDeduplicator(std::vector<Vertex>& vertices,
+                       std::size_t expectedCount);
+
+    // index of the vertex in the output array, appended without negative
+    // zeros if not seen yet
+    uint32_t insert(const Vertex& vertex);
+
+  private:
+    struct Slot {
+        uint32_t index;
+        uint32_t tag;
+    };
+    static constexpr uint32_t emptySlot = UINT32_MAX;
+
+    void _rehash(std::size_t capacity);
+
+    std::vector<Vertex>& _vertices;
+    std::vector<Slot> _slots;
+    std::size_t _mask = 0;
+    std::size_t _count = 0;
+};
+
+} // namespace scene
+
+namespace std {
+template <> struct hash<scene::Vertex> {
+    std::size_t operator()(const scene::Vertex& vertex) const {
+        return static_cast<std::size_t>(scene::hashVertex(vertex));
+    }
+};
+} // namespace std
+
+#endif
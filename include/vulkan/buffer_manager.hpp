@@ -3,12 +3,18 @@
 
 #include <vulkan/vulkan.hpp>
 
+#include <atomic>
 #include <cstring>
+#include <deque>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <vector>
 
 #include "vk_mem_alloc.h"
 #include "vulkan/context.hpp"
+#include "vulkan/range_allocator.hpp"
 
 namespace vulkan {
 
@@ -26,51 +32,251 @@ struct Image {
     void destroy(VmaAllocator allocator);
 };
 
+// range of a block of the geometry arena, in bytes
+struct GeometryRange {
+    std::size_t block;
+    vk::Buffer buffer;
+    vk::DeviceSize offset;
+    vk::DeviceSize size;
+};
+
+// size of the device local buffers of the geometry arena, bigger ranges get
+// a block of their own
+constexpr vk::DeviceSize geometryBlockSize = 64 * 1024 * 1024;
+
+// uploads bigger than a quarter of the staging ring get a buffer of their own
+constexpr vk::DeviceSize stagingRingSize = 64 * 1024 * 1024;
+
+// initial size of the instance buffer, doubled when it is full
+constexpr vk::DeviceSize instanceBufferSize = 64 * 1024;
+
+// Fence of a submit reading staging slices, shared by the slices and the
+// UploadBatch that submits it. Destroyed with the last owner. Other threads
+// only wait for it once submitted is set, the batch may never be submitted
+// if recording it failed.
+class UploadFence {
+  public:
+    explicit UploadFence(vk::Device device);
+    ~UploadFence();
+
+    UploadFence(const UploadFence&) = delete;
+    UploadFence& operator=(const UploadFence&) = delete;
+
+    bool done() const;
+    // throws if the fence isn't submitted, it would never be signalled
+    void wait() const;
+
+    vk::Fence fence;
+    // set by the batch once the submit signalling fence went through
+    std::atomic<bool> submitted{false};
+
+  private:
+    vk::Device _device;
+};
+
+// mapped copy of the data of an upload, see BufferManager::stage
+struct StagingSlice {
+    vk::Buffer buffer;
+    vk::DeviceSize offset;
+};
+
+class UploadBatch;
+
 class BufferManager {
   public:
     BufferManager(Context& context);
+    ~BufferManager();
+
+    BufferManager(const BufferManager&) = delete;
+    BufferManager& operator=(const BufferManager&) = delete;
 
     Buffer createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage,
                         VmaMemoryUsage vmaUsage);
     Image createImage(uint32_t width, uint32_t height, uint32_t mipLevels,
                       vk::Format format, vk::ImageTiling tiling,
                       vk::ImageUsageFlags usage, VmaMemoryUsage vmaUsage);
+    // Static data in device local memory. Written in place when that memory
+    // is mapped, see directWrites(), otherwise copied from the staging ring;
+    // without a batch, the copy is submitted and waited for on its own.
     template <class T>
     Buffer createTwoLevelBuffer(const std::vector<T>& sceneData,
                                 vk::BufferUsageFlags addUsage);
-    void copyBuffer(vk::Buffer srcBuffer, vk::Buffer dstBuffer,
-                    vk::DeviceSize size);
-    void copyBufferToImage(vk::Buffer buffer, vk::Image image, uint32_t width,
-                           uint32_t height);
+    template <class T>
+    Buffer createTwoLevelBuffer(const T* data, std::size_t count,
+                                vk::BufferUsageFlags addUsage);
+    template <class T>
+    Buffer createTwoLevelBuffer(UploadBatch& batch,
+                                const std::vector<T>& sceneData,
+                                vk::BufferUsageFlags addUsage);
+    template <class T>
+    Buffer createTwoLevelBuffer(UploadBatch& batch, const T* data,
+                                std::size_t count,
+                                vk::BufferUsageFlags addUsage);
+    // Staging ring: a large persistently mapped buffer handing out slices
+    // in order, each reused once its fence is signalled. The copies reading
+    // a slice must be submitted with its fence, see UploadBatch. Thread
+    // safe, a thread must submit its slices before staging with another
+    // fence.
+    StagingSlice stage(const void* data, vk::DeviceSize size,
+                       const std::shared_ptr<UploadFence>& fence);
     void destroyBuffer(Buffer buffer);
     void destroyImage(Image image);
 
+    // Geometry arena: vertices and indices of every mesh live in a few large
+    // buffers usable as both, so draws only differ by their offsets. The
+    // range offset is a multiple of sizeof(T). Thread safe.
+    template <class T>
+    GeometryRange uploadGeometry(const T* data, std::size_t count);
+    template <class T>
+    GeometryRange uploadGeometry(const std::vector<T>& data);
+    template <class T>
+    GeometryRange uploadGeometry(UploadBatch& batch, const T* data,
+                                 std::size_t count);
+    template <class T>
+    GeometryRange uploadGeometry(UploadBatch& batch,
+                                 const std::vector<T>& data);
+    void freeGeometry(const GeometryRange& range);
+
+    // Instance buffer: a single storage buffer holding the per instance data
+    // of every mesh, read by the vertex shaders. The upload is waited for.
+    // A full buffer is replaced by a bigger one once the device is idle, so
+    // this must not run while a frame is being recorded.
+    GeometryRange allocateInstances(const void* data, vk::DeviceSize size,
+                                    vk::DeviceSize alignment);
+    void freeInstances(const GeometryRange& range);
+    vk::Buffer instanceBuffer() const {
+        return _instances.buffer;
+    }
+    // changes every time instanceBuffer() is replaced
+    uint32_t instanceBufferVersion() const {
+        return _instanceVersion;
+    }
+
+    Context& context() {
+        return _context;
+    }
+    // whether static data goes straight to device local memory: the device
+    // has a host visible device local heap about as large as its memory
+    // (integrated GPU, resizable BAR, software renderer)
+    bool directWrites() const {
+        return _directMemoryType.has_value();
+    }
+
     VmaAllocator allocator;
 
   private:
+    struct GeometryBlock {
+        Buffer buffer;
+        RangeAllocator ranges;
+        // written in place when mapped
+        char* mapped = nullptr;
+    };
+
+    // part of the ring used by a slice
+    struct StagingRegion {
+        vk::DeviceSize begin;
+        vk::DeviceSize end;
+        std::shared_ptr<UploadFence> fence;
+    };
+    struct DedicatedStaging {
+        Buffer buffer;
+        std::shared_ptr<UploadFence> fence;
+    };
+
+    // a null batch uploads on its own
+    Buffer _createTwoLevelBuffer(UploadBatch* batch, const void* data,
+                                 vk::DeviceSize size,
+                                 vk::BufferUsageFlags addUsage);
+    GeometryRange _allocateGeometry(vk::DeviceSize size,
+                                    vk::DeviceSize alignment);
+    void _uploadGeometry(UploadBatch* batch, const GeometryRange& range,
+                         const void* data);
+    std::optional<vk::DeviceSize> _allocateStaging(vk::DeviceSize size);
+    void _reclaimStaging();
+    StagingSlice _stageDedicated(const void* data, vk::DeviceSize size,
+                                 const std::shared_ptr<UploadFence>& fence);
+    // picks _directMemoryType and reports the choice
+    void _chooseGeometryMemory();
+    // in _directMemoryType, empty without it or when the buffer can't use it
+    std::optional<Buffer> _createDirectBuffer(vk::DeviceSize size,
+                                              vk::BufferUsageFlags usage);
+    // replaces the instance buffer by one with room for size more bytes
+    void _growInstances(vk::DeviceSize size);
+
     Context& _context;
+    std::optional<uint32_t> _directMemoryType;
+    std::mutex _geometryMutex;
+    std::vector<GeometryBlock> _geometryBlocks;
+
+    std::mutex _stagingMutex;
+    Buffer _stagingRing;
+    char* _stagingMapped = nullptr;
+    // end of the newest region
+    vk::DeviceSize _stagingHead = 0;
+    // oldest first
+    std::deque<StagingRegion> _stagingRegions;
+    std::vector<DedicatedStaging> _dedicatedStaging;
+
+    Buffer _instances;
+    RangeAllocator _instanceRanges{instanceBufferSize};
+    uint32_t _instanceVersion = 1;
 };
 
 template <class T>
 Buffer BufferManager::createTwoLevelBuffer(const std::vector<T>& sceneData,
                                            vk::BufferUsageFlags addUsage) {
-    auto size = sizeof(T) * sceneData.size();
-    auto buffer
-        = createBuffer(size, vk::BufferUsageFlagBits::eTransferDst | addUsage,
-                       VMA_MEMORY_USAGE_CPU_TO_GPU);
+    return createTwoLevelBuffer(sceneData.data(), sceneData.size(), addUsage);
+}
+
+template <class T>
+Buffer BufferManager::createTwoLevelBuffer(const T* sceneData,
+                                           std::size_t count,
+                                           vk::BufferUsageFlags addUsage) {
+    return _createTwoLevelBuffer(nullptr, sceneData, sizeof(T) * count,
+                                 addUsage);
+}
+
+template <class T>
+Buffer BufferManager::createTwoLevelBuffer(UploadBatch& batch,
+                                           const std::vector<T>& sceneData,
+                                           vk::BufferUsageFlags addUsage) {
+    return createTwoLevelBuffer(batch, sceneData.data(), sceneData.size(),
+                                addUsage);
+}
+
+template <class T>
+Buffer BufferManager::createTwoLevelBuffer(UploadBatch& batch,
+                                           const T* sceneData,
+                                           std::size_t count,
+                                           vk::BufferUsageFlags addUsage) {
+    return _createTwoLevelBuffer(&batch, sceneData, sizeof(T) * count,
+                                 addUsage);
+}
 
-    Buffer stagingBuffer = createBuffer(
-        size, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_ONLY);
-    void* data;
-    vmaMapMemory(allocator, stagingBuffer.allocation, &data);
-    std::memcpy(data, sceneData.data(), static_cast<std::size_t>(size));
-    vmaUnmapMemory(allocator, stagingBuffer.allocation);
+template <class T>
+GeometryRange BufferManager::uploadGeometry(const T* data, std::size_t count) {
+    auto range = _allocateGeometry(sizeof(T) * count, sizeof(T));
+    _uploadGeometry(nullptr, range, data);
+    return range;
+}
 
-    copyBuffer(stagingBuffer.buffer, buffer.buffer, size);
+template <class T>
+GeometryRange BufferManager::uploadGeometry(const std::vector<T>& data) {
+    return uploadGeometry(data.data(), data.size());
+}
 
-    stagingBuffer.destroy(allocator);
+template <class T>
+GeometryRange BufferManager::uploadGeometry(UploadBatch& batch, const T* data,
+                                            std::size_t count) {
+    auto range = _allocateGeometry(sizeof(T) * count, sizeof(T));
+    _uploadGeometry(&batch, range, data);
+    return range;
+}
 
-    return buffer;
+template <class T>
+GeometryRange BufferManager::uploadGeometry(UploadBatch& batch,
+                                            const std::vector<T>& data) {
+    return uploadGeometry(batch, data.data(), data.size());
 }
 
 } // namespace vulkan
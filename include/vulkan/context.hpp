@@ -3,7 +3,10 @@
 
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <tuple>
 #include <vulkan/vulkan.hpp>
 
@@ -16,19 +19,51 @@ class Context {
     void destroy();
     void deviceWaitIdle();
 
-    vk::CommandBuffer beginSingleTimeCommands();
+    // usable from any thread, each thread records from its own pools;
+    // transfer command buffers are for transferQueue, the others for
+    // graphicsQueue
+    vk::CommandBuffer beginSingleTimeCommands(bool transfer = false);
     void endSingleTimeCommands(vk::CommandBuffer commandBuffer);
+    // ends and submits to graphicsQueue without waiting, fence is signalled
+    // once the commands are done; they must be freed afterwards on the same
+    // thread
+    void submitSingleTimeCommands(vk::CommandBuffer commandBuffer,
+                                  vk::Fence fence);
+    void freeSingleTimeCommands(vk::CommandBuffer commandBuffer,
+                                bool transfer = false);
+
+    // whether transferQueue is a queue of a transfer only family, whose
+    // resources must be handed over to the graphics family
+    bool hasTransferQueue() const {
+        return transferFamily != graphicsFamily;
+    }
+    // lock of transferQueue, queueMutex when it is the graphics queue
+    std::mutex& transferQueueMutex() {
+        return hasTransferQueue() ? _transferQueueMutex : queueMutex;
+    }
+
+    // graphicsQueue and presentQueue are shared with loader threads, every
+    // submit, present or wait idle must hold this lock
+    std::mutex queueMutex;
 
     vk::SurfaceKHR surface;
     vk::PhysicalDevice physicalDevice;
     vk::Device device;
     vk::Queue graphicsQueue;
     vk::Queue presentQueue;
+    // for uploads, graphicsQueue on devices without a transfer only family
+    vk::Queue transferQueue;
+    uint32_t graphicsFamily = 0;
+    uint32_t transferFamily = 0;
 
     VmaAllocator allocator;
     vk::CommandPool commandPool;
     vk::DebugUtilsMessengerEXT debugMessenger;
     vk::Instance instance;
+    vk::PhysicalDeviceFeatures enabledFeatures;
+    // from VK_KHR_draw_indirect_count, null when the device doesn't have it
+    PFN_vkCmdDrawIndexedIndirectCountKHR cmdDrawIndexedIndirectCount
+        = nullptr;
 
   private:
     static vk::SurfaceKHR _createSurface(GLFWwindow* window,
@@ -37,7 +72,14 @@ class Context {
     std::tuple<vk::Device, vk::Queue, vk::Queue> _createLogicalDevice();
 
     VmaAllocator _createAllocator();
-    vk::CommandPool _createCommandPool();
+    vk::CommandPool _createCommandPool(uint32_t queueFamily);
+    vk::CommandPool _threadCommandPool(bool transfer);
+
+    std::thread::id _mainThread;
+    std::mutex _poolMutex;
+    // by thread and queue, transfer or graphics
+    std::map<std::pair<std::thread::id, bool>, vk::CommandPool> _threadPools;
+    std::mutex _transferQueueMutex;
     VkDebugUtilsMessengerEXT _setupDebugMessenger();
     vk::Instance _createInstance();
 };
@@ -0,0 +1,73 @@
+#ifndef VULKAN_DEPTH_PYRAMID_HPP
+#define VULKAN_DEPTH_PYRAMID_HPP
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "vulkan/buffer_manager.hpp"
+#include "vulkan/depth_info.hpp"
+
+namespace vulkan {
+
+class Context;
+
+// Mip chain of the depth buffer where every texel keeps the farthest depth
+// of the area it covers, built in compute. Level 0 has the size of the depth
+// buffer, a texel of level l covers the 2^l x 2^l texels of level 0 starting
+// at its coordinates times 2^l, the last row and column also cover what the
+// rounding down of odd sizes drops. The image stays in the general layout.
+class DepthPyramid {
+  public:
+    DepthPyramid(Context& context, BufferManager& bufferManager,
+                 const DepthResources& depthResources, vk::Extent2D extent);
+    ~DepthPyramid();
+
+    DepthPyramid(const DepthPyramid&) = delete;
+    DepthPyramid& operator=(const DepthPyramid&) = delete;
+
+    // records the build from the depth buffer, outside of a render pass and
+    // after the draws writing it. The depth buffer is back in the depth
+    // attachment layout afterwards, the pyramid is ready for compute reads.
+    void build(vk::CommandBuffer cmdBuffer);
+
+    vk::Extent2D extent() const {
+        return _extent;
+    }
+    // every level, for texelFetch with a nearest sampler
+    vk::ImageView view() const {
+        return _view;
+    }
+    vk::Sampler sampler() const {
+        return _sampler;
+    }
+
+  private:
+    void _createDescriptorSets();
+    void _createPipeline();
+    vk::ShaderModule _createShaderModule(const std::string& path);
+
+    Context& _context;
+    BufferManager& _bufferManager;
+    const DepthResources& _depthResources;
+
+    vk::Extent2D _extent;
+    uint32_t _levelCount;
+    Image _image;
+    vk::ImageView _view;
+    std::vector<vk::ImageView> _levelViews;
+    vk::Sampler _sampler;
+
+    vk::DescriptorSetLayout _descriptorSetLayout;
+    vk::DescriptorPool _descriptorPool;
+    // set i reads level i - 1, or the depth buffer, and writes level i
+    std::vector<vk::DescriptorSet> _descriptorSets;
+    vk::PipelineLayout _layout;
+    vk::Pipeline _pipeline;
+};
+
+} // namespace vulkan
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef VULKAN_DRAW_LIST_HPP
+#define VULKAN_DRAW_LIST_HPP
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "vulkan/buffer_manager.hpp"
+#include "vulkan/mesh.hpp"
+
+namespace vulkan {
+
+// Draws of a frame, written to host visible buffers of the swapchain image
+// that stay mapped: one VkDrawIndexedIndirectCommand and one ObjectData per
+// draw. The firstInstance of draw d is d << instanceShift(), so the vertex
+// shaders find the ObjectData of the draw and the index of the instance in
+// gl_InstanceIndex. Indirect draws with different meshes can share a single
+// call, nothing is bound or copied per object and the instances stay in the
+// instance buffer of the BufferManager.
+class DrawList {
+  public:
+    DrawList(BufferManager& bufferManager, std::size_t imageCount);
+    ~DrawList();
+
+    DrawList(const DrawList&) = delete;
+    DrawList& operator=(const DrawList&) = delete;
+
+    // empties the list of image, whose previous frame must be done, and
+    // makes room for drawCount draws of at most maxInstanceCount instances
+    void reset(uint32_t image, std::size_t drawCount,
+               uint32_t maxInstanceCount);
+    // ObjectData of a draw of mesh placed in the world by model, whose
+    // command is recorded elsewhere; returns its firstInstance
+    uint32_t addInstances(uint32_t image, const Mesh& mesh,
+                          const glm::mat4& model);
+    // appends command at the end of the commands of image
+    void addCommand(uint32_t image,
+                    const vk::DrawIndexedIndirectCommand& command);
+    // makes the writes visible to the device
+    void flush(uint32_t image);
+
+    std::size_t commandCount(uint32_t image) const {
+        return _images[image].commandCount;
+    }
+    vk::Buffer commandBuffer(uint32_t image) const {
+        return _images[image].commands.buffer;
+    }
+    // storage buffer of ObjectData, replaced when reset() grows it
+    vk::Buffer objectBuffer(uint32_t image) const {
+        return _images[image].objects.buffer;
+    }
+    // 0 until the first objects are added
+    std::size_t objectCapacity(uint32_t image) const {
+        return _images[image].objectCapacity;
+    }
+    // pushed to the vertex shaders, enough bits for the largest instance
+    // count of the frame
+    uint32_t instanceShift(uint32_t image) const {
+        return _images[image].instanceShift;
+    }
+
+  private:
+    struct ImageDraws {
+        Buffer commands, objects;
+        vk::DrawIndexedIndirectCommand* mappedCommands = nullptr;
+        ObjectData* mappedObjects = nullptr;
+        std::size_t capacity = 0;
+        std::size_t objectCapacity = 0;
+        std::size_t commandCount = 0;
+        std::size_t objectCount = 0;
+        uint32_t instanceShift = 0;
+    };
+
+    void _destroyCommands(ImageDraws& draws);
+    void _destroyObjects(ImageDraws& draws);
+
+    BufferManager& _bufferManager;
+    std::vector<ImageDraws> _images;
+};
+
+} // namespace vulkan
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef VULKAN_FRUSTUM_CULLER_HPP
+#define VULKAN_FRUSTUM_CULLER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "vulkan/mesh.hpp"
+
+namespace vulkan {
+
+// Bounding volumes of the meshes of the scene in structure of arrays form,
+// tested against the frustum several meshes at a time with AVX when the
+// compiler targets it, SSE2 otherwise and plain loops on other CPUs.
+class FrustumCuller {
+  public:
+    void clear();
+    // appends bounds[first, first + count), mesh i of the culler is the i-th
+    // added
+    void add(const std::vector<MeshBounds>& bounds, std::size_t first,
+             std::size_t count);
+    std::size_t size() const {
+        return _count;
+    }
+
+    // appends to visible the indices in [first, first + count) of the
+    // meshes whose sphere and box both intersect the six planes, which point
+    // inside the frustum as in CullView
+    void cull(const glm::vec4 (&planes)[6], std::size_t first,
+              std::size_t count, std::vector<uint32_t>& visible) const;
+
+  private:
+    // arrays are padded so that a batch starting at any mesh stays inside
+    // them, the results of the padding are dropped
+    std::vector<float> _centerX, _centerY, _centerZ, _radius;
+    std::vector<float> _extentX, _extentY, _extentZ;
+    std::size_t _count = 0;
+};
+
+} // namespace vulkan
+
+#endif
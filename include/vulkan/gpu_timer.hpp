@@ -0,0 +1,41 @@
+#ifndef VULKAN_GPU_TIMER_HPP
+#define VULKAN_GPU_TIMER_HPP
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+namespace vulkan {
+
+class Context;
+
+// GPU time of the command buffer of every swapchain image, from a pair of
+// timestamp queries. Does nothing when the graphics queue has no timestamps.
+class GpuTimer {
+  public:
+    GpuTimer(Context& context, std::size_t imageCount);
+    ~GpuTimer();
+
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    // recorded at the start and the end of the command buffer of image
+    void writeBegin(vk::CommandBuffer cmdBuffer, std::size_t image);
+    void writeEnd(vk::CommandBuffer cmdBuffer, std::size_t image);
+
+    void markSubmitted(std::size_t image);
+    // milliseconds taken by the last submission of image, if it completed
+    std::optional<double> read(std::size_t image);
+
+  private:
+    Context& _context;
+    vk::QueryPool _queryPool;
+    double _timestampPeriod = 0.0;
+    std::vector<bool> _submitted;
+};
+
+} // namespace vulkan
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef VULKAN_MATERIALS_HPP
+#define VULKAN_MATERIALS_HPP
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "material.hpp"
+#include "vulkan/buffer_manager.hpp"
+#include "vulkan/sampler.hpp"
+#include "vulkan/texture.hpp"
+
+namespace vulkan {
+
+class Context;
+
+// Same layout as MaterialConstants in shader.vert and shader_packed.vert
+struct MaterialConstants {
+    glm::vec4 diffuse;
+};
+
+// GPU side of the materials of a scene. Textures are loaded once per path,
+// materials without one (or whose texture can't be loaded) sample a white
+// texture. Each material has a descriptor set, set 1 of the mesh pipelines,
+// with its texture and the constants of every material, which the vertex
+// shaders index with ObjectData::material.
+class Materials {
+  public:
+    // starts with a single white default material
+    Materials(Context& context, BufferManager& bufferManager);
+    ~Materials();
+
+    Materials(const Materials&) = delete;
+    Materials& operator=(const Materials&) = delete;
+
+    // replaces the materials, the device must not be using the previous ones
+    void set(const std::vector<scene::MaterialData>& materials);
+
+    std::size_t size() const {
+        return _descriptorSets.size();
+    }
+    std::size_t textureCount() const {
+        return _textures.size();
+    }
+    vk::DescriptorSetLayout descriptorSetLayout() const {
+        return _descriptorSetLayout;
+    }
+    // unknown materials get the default one
+    vk::DescriptorSet descriptorSet(uint32_t material) const {
+        return _descriptorSets[material < size() ? material : 0];
+    }
+
+  private:
+    void _destroy();
+    vk::DescriptorSetLayout _createDescriptorSetLayout();
+
+    Context& _context;
+    BufferManager& _bufferManager;
+
+    vk::DescriptorSetLayout _descriptorSetLayout;
+    vk::DescriptorPool _descriptorPool;
+    std::vector<vk::DescriptorSet> _descriptorSets;
+    // the white texture comes first
+    std::vector<std::unique_ptr<Texture>> _textures;
+    std::unique_ptr<Sampler> _sampler;
+    Buffer _constants;
+};
+
+} // namespace vulkan
+
+#endif
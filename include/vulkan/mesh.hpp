@@ -4,6 +4,7 @@
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #define GLM_FORCE_MESSAGES
+#include <algorithm>
 #include <array>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -32,21 +33,251 @@ struct Vertex {
 
 bool operator==(const Vertex& a, const Vertex& b);
 
+// layout of a vertex buffer on the GPU, each one has its own pipeline
+enum class VertexFormat {
+    // Vertex as is, 32 bytes
+    Full,
+    // PackedVertex, 12 bytes, for meshes with a single vertex color
+    Packed,
+};
+
+// Position quantized to 16 bit snorm inside the mesh bounding box and
+// texture coordinates to 16 bit unorm inside their bounds, shader_packed.vert
+// maps them back with the VertexDecode of the mesh.
+struct PackedVertex {
+    // w is padding, formats with three 16 bit components are optional
+    int16_t pos[4];
+    uint16_t texCoord[2];
+
+    static vk::VertexInputBindingDescription getBindingDescription();
+    static std::array<vk::VertexInputAttributeDescription, 2>
+    getAttributeDescriptions();
+};
+
+// Maps the packed vertices of a mesh back to object space in
+// shader_packed.vert
+struct VertexDecode {
+    // pos = posOffset + posScale * packed.pos
+    glm::vec4 posOffset;
+    glm::vec4 posScale;
+    // texCoord = texCoordOffset + texCoordScale * packed.texCoord
+    glm::vec2 texCoordOffset;
+    glm::vec2 texCoordScale;
+    glm::vec4 color;
+};
+
+// One copy of a mesh: meshes without instances are drawn once with the
+// default values
+struct InstanceData {
+    glm::mat4 model{1.0f};
+    // multiplies the vertex color
+    glm::vec4 color{1.0f};
+};
+
+// ObjectData::firstInstance of meshes without instances
+constexpr uint32_t noInstances = ~0u;
+
+// Everything the vertex shaders know about one draw, same layout as
+// ObjectData in shader.vert and shader_packed.vert. A frame has one per draw
+// in a storage buffer, see DrawList. Each instance multiplies model by its
+// own, read from the instance buffer of the BufferManager.
+struct ObjectData {
+    glm::mat4 model{1.0f};
+    VertexDecode decode;
+    uint32_t material;
+    // index of the InstanceData of the first instance, or noInstances
+    uint32_t firstInstance;
+    uint32_t padding[2];
+};
+
+// range of the index buffer drawing one level of detail, error is the object
+// space distance to the full resolution surface
+struct MeshLod {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float error;
+};
+
+// meshes with at most this many vertices get 16 bit indices
+constexpr std::size_t maxShortIndexVertices = 1 << 16;
+
+constexpr std::size_t maxMeshletVertices = 64;
+constexpr std::size_t maxMeshletTriangles = 124;
+
+// Cluster of triangles of the full resolution level, with its culling data.
+// Same layout as in meshlet_cull.comp. Triangles are packed as three 8 bit
+// indices into the meshlet vertices, which index the mesh vertex buffer.
+struct Meshlet {
+    // bounding sphere
+    glm::vec3 center;
+    float radius;
+    // normal cone: the whole meshlet faces away from a camera at p when
+    // dot(center - p, coneAxis) >= coneCutoff * |center - p| + radius
+    glm::vec3 coneAxis;
+    float coneCutoff;
+    uint32_t vertexOffset;
+    uint32_t triangleOffset;
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+};
+
+// view over the geometry of one mesh, owned by a scene::MeshData or mapped
+// from a cache file
+struct MeshView {
+    const Vertex* vertices;
+    std::size_t vertexCount;
+    const uint32_t* indices;
+    std::size_t indexCount;
+    const MeshLod* lods;
+    std::size_t lodCount;
+    const Meshlet* meshlets;
+    std::size_t meshletCount;
+    const uint32_t* meshletVertices;
+    std::size_t meshletVertexCount;
+    const uint32_t* meshletTriangles;
+    std::size_t meshletTriangleCount;
+};
+
+// what the level of detail selection needs to know about the view
+struct LodView {
+    glm::vec3 cameraPosition;
+    // viewport height / (2 tan(fovy / 2)), pixels per unit at distance 1
+    float projectionScale;
+    // largest screen space error accepted, in pixels
+    float maxPixelError = 1.0f;
+};
+
+// bounding volumes of a mesh, the box and the sphere share their center
+struct MeshBounds {
+    glm::vec3 center;
+    float radius;
+    // half size of the axis aligned box
+    glm::vec3 extents;
+};
+
+// largest factor model scales a length by
+float maxScale(const glm::mat4& model);
+// bounds of a mesh placed by model: the box around the transformed box, and
+// the sphere grown by the largest scale
+MeshBounds transformBounds(const MeshBounds& bounds, const glm::mat4& model);
+
+// buffers the draws of a mesh read, consecutive meshes with the same binding
+// are drawn without rebinding anything
+struct GeometryBinding {
+    vk::Buffer vertexBuffer;
+    vk::Buffer indexBuffer;
+    vk::IndexType indexType;
+};
+
+bool operator==(const GeometryBinding& a, const GeometryBinding& b);
+bool operator!=(const GeometryBinding& a, const GeometryBinding& b);
+
+// GPU copy of the meshlets of a mesh, read by the culling compute shader
+struct MeshletBuffers {
+    Buffer meshlets, vertices, triangles;
+    uint32_t meshletCount = 0;
+};
+
 class Mesh {
   public:
     Mesh(BufferManager& bufferManager, std::vector<Vertex> vertices,
          std::vector<uint32_t> indices);
+    // without lods the whole index buffer is the only level of detail, the
+    // packed format falls back to the full one when vertex colors differ.
+    // The buffers are filled once batch is done, without a batch the upload
+    // is submitted and waited for on its own.
+    Mesh(BufferManager& bufferManager, const MeshView& view,
+         VertexFormat format = VertexFormat::Full,
+         UploadBatch* batch = nullptr);
     ~Mesh();
 
-    void writeCmdBuffer(vk::CommandBuffer cmdBuffer,
-                        vk::DescriptorSet descriptorSet,
-                        vk::PipelineLayout pipelineLayout) const;
+    // coarsest level whose error projects to at most view.maxPixelError,
+    // with the mesh placed in the world by model
+    std::size_t selectLod(const LodView& view, const glm::mat4& model) const;
+    const MeshLod& lod(std::size_t level) const {
+        return _lods[level];
+    }
+    VertexFormat vertexFormat() const {
+        return _vertexFormat;
+    }
+    // of every instance when the mesh has some
+    const MeshBounds& bounds() const {
+        return _instanceCount > 0 ? _instanceBounds : _bounds;
+    }
+
+    // Draws the mesh once per instance instead of once, with a single call.
+    // The instances are uploaded to the instance buffer of the BufferManager,
+    // and stay there until they are replaced; no frame in flight may be
+    // reading the previous ones.
+    void setInstances(const std::vector<InstanceData>& instances);
+    // number of copies each draw of the mesh makes
+    uint32_t instanceCount() const {
+        return std::max(_instanceCount, 1u);
+    }
+    bool hasInstances() const {
+        return _instanceCount > 0;
+    }
+    // index of the first InstanceData of the mesh in the instance buffer,
+    // noInstances without instances
+    uint32_t firstInstanceData() const;
+
+    GeometryBinding geometryBinding() const;
+    // small number telling the geometry bindings apart, for sort keys; two
+    // bindings may share one
+    uint32_t geometryId() const;
+    // first vertex of the mesh in the bound vertex buffer
+    int32_t vertexOffset() const {
+        return _vertexOffset;
+    }
+    void bindGeometry(vk::CommandBuffer cmdBuffer) const;
+    // per draw data of the packed format, see DrawList
+    const VertexDecode& vertexDecode() const {
+        return _decode;
+    }
+    // index of the material the mesh is drawn with, 0 by default
+    uint32_t material() const {
+        return _material;
+    }
+    void setMaterial(uint32_t material) {
+        _material = material;
+    }
+
+    // firstInstance selects the ObjectData of the draw, see DrawList
+    vk::DrawIndexedIndirectCommand drawCommand(std::size_t lod,
+                                               uint32_t firstInstance) const;
+    // the geometry binding of the mesh and the descriptor sets must be bound
+    void writeCmdBuffer(vk::CommandBuffer cmdBuffer, std::size_t lod,
+                        uint32_t firstInstance) const;
+
+    const MeshletBuffers& meshlets() const {
+        return _meshlets;
+    }
+    // draws the full resolution level from an index list of the index type
+    // of the mesh and the VkDrawIndexedIndirectCommand at commandOffset,
+    // written by the meshlet culling; this replaces the bound index buffer
+    void writeCulledCmdBuffer(vk::CommandBuffer cmdBuffer,
+                              vk::Buffer indexBuffer,
+                              vk::Buffer indirectBuffer,
+                              vk::DeviceSize commandOffset) const;
 
   private:
     BufferManager& _bufferManager;
 
-    Buffer vertexBuffer, indexBuffer;
-    uint32_t indexCount;
+    // ranges of the geometry arena
+    GeometryRange _vertexRange, _indexRange;
+    int32_t _vertexOffset;
+    uint32_t _firstIndex;
+    // 16 bit when the vertices allow it
+    vk::IndexType _indexType;
+    VertexFormat _vertexFormat;
+    VertexDecode _decode;
+    uint32_t _material = 0;
+    std::vector<MeshLod> _lods;
+    MeshletBuffers _meshlets;
+    MeshBounds _bounds;
+    GeometryRange _instances;
+    uint32_t _instanceCount = 0;
+    MeshBounds _instanceBounds;
 };
 } // namespace vulkan
 
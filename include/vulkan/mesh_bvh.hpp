@@ -0,0 +1,77 @@
+#ifndef VULKAN_MESH_BVH_HPP
+#define VULKAN_MESH_BVH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "thread_pool.hpp"
+#include "vulkan/frustum_culler.hpp"
+#include "vulkan/mesh.hpp"
+
+namespace vulkan {
+
+struct Ray {
+    glm::vec3 origin;
+    // not necessarily normalized, distances are in units of its length
+    glm::vec3 direction;
+};
+
+struct RayHit {
+    // index of the mesh in the bounds the hierarchy was built from
+    uint32_t mesh;
+    // along the ray, to the entry point of the mesh bounding box
+    float distance;
+};
+
+// Bounding volume hierarchy over the boxes of the meshes of a scene, built
+// with binned SAH. Subtrees below the first levels are built in parallel.
+class MeshBvh {
+  public:
+    void build(const std::vector<MeshBounds>& bounds, scene::ThreadPool& pool);
+    // takes new bounds for the meshes of the last build and recomputes the
+    // boxes of the nodes around them, keeping the tree: culling stays exact
+    // but gets slower the more the meshes moved since the build
+    void refit(const std::vector<MeshBounds>& bounds);
+    std::size_t size() const {
+        return _order.size();
+    }
+
+    // appends to visible the index of the meshes intersecting the frustum,
+    // planes as in CullView. Subtrees fully inside are taken without testing
+    // their meshes, leaves partly inside are tested with a FrustumCuller.
+    void cull(const glm::vec4 (&planes)[6],
+              std::vector<uint32_t>& visible) const;
+    // closest mesh whose bounding box the ray enters, if any
+    std::optional<RayHit> raycast(const Ray& ray) const;
+
+  private:
+    struct Node {
+        glm::vec3 min;
+        // meshes of the subtree are _order[first, first + count)
+        uint32_t first;
+        glm::vec3 max;
+        uint32_t count;
+        // children are left and left + 1, 0 for leaves
+        uint32_t left;
+    };
+
+    void _split(std::vector<Node>& nodes, std::size_t node,
+                const std::vector<MeshBounds>& bounds);
+    void _buildSubtree(std::vector<Node>& nodes,
+                       const std::vector<MeshBounds>& bounds);
+    void _cullNode(uint32_t node, const glm::vec4 (&planes)[6],
+                   uint32_t planeMask, std::vector<uint32_t>& visible) const;
+
+    std::vector<Node> _nodes;
+    // mesh indices in leaf order
+    std::vector<uint32_t> _order;
+    // bounds of the meshes in leaf order
+    FrustumCuller _leafCuller;
+    std::vector<MeshBounds> _leafBounds;
+};
+
+} // namespace vulkan
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef VULKAN_MESHLET_CULLER_HPP
+#define VULKAN_MESHLET_CULLER_HPP
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "vulkan/buffer_manager.hpp"
+#include "vulkan/mesh.hpp"
+
+namespace vulkan {
+
+class Context;
+
+// Same layout as the push constants of meshlet_cull.comp. Planes point
+// inside the frustum. The culler moves them and the camera to the space of
+// each mesh and fills in the fields after cameraPosition.
+struct CullView {
+    glm::vec4 planes[6];
+    glm::vec3 cameraPosition;
+    uint32_t meshletCount;
+    // start of the range of the mesh in the index list, in indices
+    uint32_t firstIndex;
+    // draw command of the mesh
+    uint32_t command;
+    // the mesh has 16 bit indices, packed two per word
+    uint32_t index16;
+};
+
+// mesh drawn from its culled meshlets, firstInstance as in DrawList
+struct CulledDraw {
+    const Mesh* mesh;
+    uint32_t firstInstance;
+    // places the mesh in the world, see MeshletCuller::canCull()
+    glm::mat4 model;
+};
+
+// Drops the meshlets outside of the frustum or facing away from the camera
+// in a compute pass, which writes the remaining triangles to an index list
+// and their count to an indirect draw command. Every mesh culled in a frame
+// gets a range of a single index list of the swapchain image, in its own
+// index type, and one command of a single command buffer.
+class MeshletCuller {
+  public:
+    MeshletCuller(Context& context, BufferManager& bufferManager);
+    ~MeshletCuller();
+
+    MeshletCuller(const MeshletCuller&) = delete;
+    MeshletCuller& operator=(const MeshletCuller&) = delete;
+
+    // the normal cones of the meshlets only survive rotations, translations
+    // and uniform scales
+    static bool canCull(const glm::mat4& model);
+
+    // records the culling of the meshes of draws for image, outside of a
+    // render pass, the previous frame of image must be done. view is in
+    // world space.
+    void cull(vk::CommandBuffer cmdBuffer, uint32_t image,
+              const std::vector<CulledDraw>& draws, const CullView& view);
+    // draws what the last cull of draws[draw] for image kept, the vertex
+    // buffer of the mesh must be bound and its index buffer gets replaced
+    void draw(vk::CommandBuffer cmdBuffer, uint32_t image, uint32_t draw,
+              const Mesh& mesh);
+    // forgets the meshlets of every mesh and frees the index lists, the
+    // device must be idle
+    void clear();
+
+  private:
+    // index list and draw commands of a swapchain image, set 1
+    struct ImageTarget {
+        Buffer indices, commands;
+        vk::DeviceSize indexCapacity = 0;
+        std::size_t commandCapacity = 0;
+        vk::DescriptorSet descriptorSet;
+    };
+
+    ImageTarget& _reserve(uint32_t image, vk::DeviceSize indexSize,
+                          std::size_t commandCount);
+    // meshlets of mesh, set 0
+    vk::DescriptorSet _meshDescriptorSet(const Mesh& mesh);
+    vk::DescriptorSet _allocateDescriptorSet(vk::DescriptorSetLayout layout);
+    vk::DescriptorSetLayout _createDescriptorSetLayout(uint32_t bindingCount);
+    vk::ShaderModule _createShaderModule(const std::string& path);
+
+    Context& _context;
+    BufferManager& _bufferManager;
+
+    vk::DescriptorSetLayout _meshSetLayout, _imageSetLayout;
+    vk::PipelineLayout _layout;
+    vk::Pipeline _pipeline;
+    std::vector<vk::DescriptorPool> _descriptorPools;
+    uint32_t _freeDescriptorSets = 0;
+    std::map<const Mesh*, vk::DescriptorSet> _meshSets;
+    std::vector<ImageTarget> _images;
+};
+
+} // namespace vulkan
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef VULKAN_OCCLUSION_CULLER_HPP
+#define VULKAN_OCCLUSION_CULLER_HPP
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "vulkan/buffer_manager.hpp"
+#include "vulkan/depth_pyramid.hpp"
+#include "vulkan/mesh.hpp"
+
+namespace vulkan {
+
+class Context;
+
+enum class OcclusionPhase : uint32_t {
+    // meshes visible last frame, drawn before the depth pyramid is built
+    Early = 0,
+    // meshes the early phase skipped and the depth pyramid doesn't hide
+    Late = 1,
+};
+
+// Same layout as the push constants of occlusion_cull.comp
+struct OcclusionView {
+    glm::mat4 viewProjection;
+    glm::vec2 pyramidSize;
+    uint32_t objectCount;
+    uint32_t phase;
+    uint32_t lateOffset;
+};
+
+// Two phase occlusion culling of the indirect draws of a DrawList, in
+// compute. Every command of the frame gets an object with the bounds of its
+// mesh, the visibility of each mesh is kept from one frame to the next by
+// its id. Each phase writes the visible commands of a batch at the start of
+// the range of the batch in culledCommands, and their number to the batch
+// counts for vkCmdDrawIndexedIndirectCount. The rest of the range is filled
+// with zeros, so drawing the whole range works too.
+class OcclusionCuller {
+  public:
+    OcclusionCuller(Context& context, BufferManager& bufferManager,
+                    std::size_t imageCount);
+    ~OcclusionCuller();
+
+    OcclusionCuller(const OcclusionCuller&) = delete;
+    OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+
+    // empties the objects of image, whose previous frame must be done, and
+    // makes room for objectCount objects in batchCount batches of meshes
+    // with ids below meshCount
+    void reset(uint32_t image, std::size_t objectCount,
+               std::size_t batchCount, std::size_t meshCount);
+    // batch of commands drawn by a single call, starting at firstCommand
+    void addBatch(uint32_t image, uint32_t firstCommand);
+    // object i goes with command i of the DrawList
+    void addObject(uint32_t image, const MeshBounds& bounds, uint32_t meshId,
+                   uint32_t batch);
+    // makes the writes visible to the device
+    void flush(uint32_t image);
+
+    // records a phase outside of a render pass, commands is the command
+    // buffer of the DrawList of image. The late phase reads the pyramid.
+    void cull(vk::CommandBuffer cmdBuffer, uint32_t image, OcclusionPhase phase,
+              vk::Buffer commands, const DepthPyramid& pyramid,
+              const glm::mat4& viewProjection);
+
+    vk::Buffer culledCommands(uint32_t image) const {
+        return _images[image].culled.buffer;
+    }
+    // first command of a batch starting at firstCommand in culledCommands
+    std::size_t culledFirst(uint32_t image, OcclusionPhase phase,
+                            std::size_t firstCommand) const;
+    vk::Buffer countBuffer(uint32_t image) const {
+        return _images[image].batches.buffer;
+    }
+    vk::DeviceSize countOffset(uint32_t batch, OcclusionPhase phase) const;
+
+  private:
+    // same layouts as occlusion_cull.comp
+    struct Object {
+        glm::vec3 center;
+        uint32_t meshId;
+        glm::vec3 extents;
+        uint32_t batch;
+    };
+    struct Batch {
+        uint32_t first;
+        uint32_t earlyCount;
+        uint32_t lateCount;
+        uint32_t padding;
+    };
+
+    struct ImageObjects {
+        Buffer objects, batches, culled;
+        Object* mappedObjects = nullptr;
+        Batch* mappedBatches = nullptr;
+        std::size_t objectCapacity = 0;
+        std::size_t batchCapacity = 0;
+        std::size_t objectCount = 0;
+        std::size_t batchCount = 0;
+        vk::DescriptorSet descriptorSet;
+    };
+
+    void _destroyObjects(ImageObjects& objects);
+    void _destroyBatches(ImageObjects& objects);
+    void _writeDescriptorSet(ImageObjects& objects, vk::Buffer commands,
+                             const DepthPyramid& pyramid);
+    vk::DescriptorSetLayout _createDescriptorSetLayout();
+    vk::ShaderModule _createShaderModule(const std::string& path);
+
+    Context& _context;
+    BufferManager& _bufferManager;
+
+    vk::DescriptorSetLayout _descriptorSetLayout;
+    vk::DescriptorPool _descriptorPool;
+    vk::PipelineLayout _layout;
+    vk::Pipeline _pipeline;
+    std::vector<ImageObjects> _images;
+
+    // shared by every image, one visibility per mesh id
+    Buffer _history;
+    std::size_t _historyCapacity = 0;
+    bool _clearHistory = false;
+};
+
+} // namespace vulkan
+
+#endif
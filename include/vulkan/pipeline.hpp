@@ -2,13 +2,20 @@
 #define VULKAN_PIPELINE_HPP
 
 #include <string>
+#include <vector>
 #include <vulkan/vulkan.hpp>
 
+#include "vulkan/mesh.hpp"
+
 namespace vulkan {
 
+// the layout is the same for every vertex format, so descriptor sets can be
+// shared: set 0 for the frame, set 1 for the material
 struct Pipeline {
-    Pipeline(vk::Device device, vk::DescriptorSetLayout dsl,
-             vk::Extent2D extent, vk::RenderPass renderPass);
+    Pipeline(vk::Device device,
+             const std::vector<vk::DescriptorSetLayout>& setLayouts,
+             vk::Extent2D extent, vk::RenderPass renderPass,
+             VertexFormat vertexFormat = VertexFormat::Full);
     ~Pipeline();
 
     vk::PipelineLayout layout;
@@ -0,0 +1,39 @@
+#ifndef VULKAN_RANGE_ALLOCATOR_HPP
+#define VULKAN_RANGE_ALLOCATOR_HPP
+
+#include <cstdint>
+#include <map>
+#include <optional>
+
+namespace vulkan {
+
+// First fit free list over [0, capacity), neighbouring free ranges are merged
+// back together when freed. Alignments don't need to be powers of two, so
+// ranges can be aligned to a vertex stride.
+class RangeAllocator {
+  public:
+    explicit RangeAllocator(uint64_t capacity);
+
+    // offset of a new range of size bytes, if one fits
+    std::optional<uint64_t> allocate(uint64_t size, uint64_t alignment);
+    void free(uint64_t offset, uint64_t size);
+    // extends [0, capacity), the ranges in use keep their offsets
+    void grow(uint64_t capacity);
+
+    uint64_t capacity() const {
+        return _capacity;
+    }
+    uint64_t freeSize() const {
+        return _freeSize;
+    }
+
+  private:
+    uint64_t _capacity;
+    uint64_t _freeSize;
+    // offset -> size of every free range
+    std::map<uint64_t, uint64_t> _free;
+};
+
+} // namespace vulkan
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef VULKAN_RENDER_QUEUE_HPP
+#define VULKAN_RENDER_QUEUE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "thread_pool.hpp"
+#include "vulkan/mesh.hpp"
+
+namespace vulkan {
+
+// passes are drawn in this order
+enum class DrawPass : uint32_t {
+    Opaque = 0,
+    // back to front, after every opaque draw
+    Transparent = 1,
+};
+
+// Sort key of a draw, from the most significant bits:
+// - opaque: pass (2), pipeline (2), material (14), geometry (14), depth (32)
+// - transparent: pass (2), inverted depth (32), pipeline, material, geometry
+// so opaque draws change state as little as possible and go front to back
+// among the draws sharing all of it. Fields are masked to their width,
+// depth is the view space distance, negative ones count as 0.
+uint64_t makeSortKey(DrawPass pass, uint32_t pipeline, uint32_t material,
+                     uint32_t geometry, float depth);
+
+// one draw of a mesh, with its instances
+struct DrawPacket {
+    uint64_t key;
+    const Mesh* mesh;
+    // identifies the mesh from one frame to the next, see OcclusionCuller,
+    // and indexes its world matrix and bounds
+    uint32_t meshId;
+};
+
+// Draws of a frame in the order they are recorded. Filled by the renderer
+// every frame, then sorted by key with a least significant digit radix sort
+// whose passes are split between the threads of a pool. Digits that are the
+// same in every key are skipped.
+class RenderQueue {
+  public:
+    void clear() {
+        _packets.clear();
+    }
+    void reserve(std::size_t count) {
+        _packets.reserve(count);
+    }
+    void push(const DrawPacket& packet) {
+        _packets.push_back(packet);
+    }
+    // stable, equal keys keep their push order
+    void sort(scene::ThreadPool& pool);
+
+    const std::vector<DrawPacket>& packets() const {
+        return _packets;
+    }
+    std::size_t size() const {
+        return _packets.size();
+    }
+
+  private:
+    std::vector<DrawPacket> _packets;
+    std::vector<DrawPacket> _scratch;
+};
+
+} // namespace vulkan
+
+#endif
@@ -3,16 +3,22 @@
 
 #include <vulkan/vulkan.hpp>
 
+#include <chrono>
 #include <cstring>
 #include <memory>
+#include <optional>
 #include <string>
 #include <tuple>
 #include <vector>
 
 #include "game.hpp"
 #include "scene.hpp"
+#include "transform_hierarchy.hpp"
 #include "vk_mem_alloc.h"
 #include "vulkan/context.hpp"
+#include "vulkan/frustum_culler.hpp"
+#include "vulkan/mesh_bvh.hpp"
+#include "vulkan/render_queue.hpp"
 #include "vulkan/swapchain.hpp"
 
 namespace app {
@@ -23,6 +29,14 @@ namespace vulkan {
 
 const int MAX_FRAMES_IN_FLIGHT = 2;
 
+// CPU time spent culling and recording the last frame and GPU time of an
+// earlier one
+struct FrameTimes {
+    double cullMs = 0.0;
+    double recordMs = 0.0;
+    std::optional<double> gpuMs;
+};
+
 class Renderer {
     struct SyncObject {
         vk::Semaphore imageAvailable;
@@ -44,18 +58,93 @@ class Renderer {
     void updateUniformBuffer(uint32_t currentImage);
 
     void setScene(const scene::Scene& scene);
+    // meshes of the scene are drawn as soon as they are resident
+    void setScene(scene::AsyncScene& scene);
+    // meshes owned by the caller, e.g. generated by a benchmark
+    void setMeshes(std::vector<const Mesh*> meshes);
     void setViewMatrix(glm::mat4 viewMatrix);
+    void setDrawMode(DrawMode drawMode);
+    // hides the indirect draws behind the depth of the meshes drawn in the
+    // previous frame, on by default
+    void setOcclusionCulling(bool enabled);
+    // closest mesh of the scene whose bounding box the ray hits, in world
+    // space; meshes of a scene still loading are only found once it's done
+    std::optional<RayHit> pick(const Ray& ray) const;
+
+    // Placement of the meshes in the world, reset with the scene: mesh i of
+    // the scene (and of RayHit) is drawn with the world matrix of
+    // meshNode(i), a child of sceneRoot(). Local transforms may change, or
+    // nodes be added, between frames; the world matrices are updated at the
+    // start of the next one.
+    scene::TransformHierarchy& transforms() {
+        return _transforms;
+    }
+    scene::NodeId sceneRoot() const {
+        return _sceneRoot;
+    }
+    scene::NodeId meshNode(std::size_t mesh) const {
+        return _meshNodes[mesh];
+    }
+    const FrameTimes& lastFrameTimes() const {
+        return _lastFrameTimes;
+    }
 
     BufferManager& bufferManager;
     Context& context;
 
   private:
     std::vector<SyncObject> _createSyncObjects();
+    void _pollAsyncScene();
+    // a new hierarchy with a node per mesh
+    void _resetTransforms();
+    void _addMeshes(const std::vector<const Mesh*>& meshes);
+    // world matrices and bounds of the meshes that are new or moved, then
+    // the culling structures over them
+    void _updateTransforms();
+    void _buildBvh();
+    // one packet per visible mesh, sorted
+    void _fillRenderQueue();
+    void _reportFrameStats(uint32_t imageIndex);
+    glm::mat4 _projectionMatrix() const;
+    CullView _cullView() const;
 
     glm::mat4 _viewMatrix;
     const app::Window& _appWindow;
     std::unique_ptr<Swapchain> _swapchain;
     std::vector<SyncObject> _syncObjects;
+    // fence of the frame last rendered to each swapchain image
+    std::vector<vk::Fence> _imagesInFlight;
+    std::vector<const Mesh*> _meshes;
+    scene::TransformHierarchy _transforms;
+    scene::NodeId _sceneRoot = 0;
+    // by mesh
+    std::vector<scene::NodeId> _meshNodes;
+    std::vector<glm::mat4> _worldMatrices;
+    std::vector<MeshBounds> _worldBounds;
+    // meshes whose world bounds are known
+    std::size_t _placedMeshCount = 0;
+    // over the world bounds of the first _bvhMeshCount meshes, built once a
+    // scene is loaded and refit when they move
+    MeshBvh _bvh;
+    std::size_t _bvhMeshCount = 0;
+    // the meshes added since, culled one by one while the scene loads
+    FrustumCuller _pendingMeshes;
+    bool _loading = false;
+    // builds the bvh and sorts the render queue
+    scene::ThreadPool _pool;
+    std::vector<uint32_t> _visibleIndices;
+    RenderQueue _renderQueue;
+    scene::AsyncScene* _asyncScene = nullptr;
+
+    FrameTimes _lastFrameTimes;
+    double _gpuTime = 0.0;
+    double _cullTime = 0.0;
+    double _recordTime = 0.0;
+    std::size_t _culledMeshes = 0;
+    std::size_t _gpuFrames = 0;
+    std::size_t _triangles = 0;
+    std::size_t _frames = 0;
+    std::chrono::high_resolution_clock::time_point _lastGpuReport;
     std::size_t currentFrame = 0;
     bool _mustRecreateSwapchain = false;
 
@@ -12,10 +12,15 @@
 #include "vk_mem_alloc.h"
 #include "vulkan/buffer_manager.hpp"
 #include "vulkan/depth_info.hpp"
+#include "vulkan/depth_pyramid.hpp"
+#include "vulkan/draw_list.hpp"
+#include "vulkan/gpu_timer.hpp"
+#include "vulkan/materials.hpp"
 #include "vulkan/mesh.hpp"
+#include "vulkan/meshlet_culler.hpp"
+#include "vulkan/occlusion_culler.hpp"
 #include "vulkan/pipeline.hpp"
-#include "vulkan/sampler.hpp"
-#include "vulkan/texture.hpp"
+#include "vulkan/render_queue.hpp"
 
 namespace app {
 class Window;
@@ -33,6 +38,15 @@ struct SwapchainBuffer {
     vk::ImageView imageView;
 };
 
+enum class DrawMode {
+    // one vkCmdDrawIndexed per mesh
+    Direct,
+    // commands written to a DrawList, one vkCmdDrawIndexedIndirect per run of
+    // meshes with the same pipeline and geometry, or per mesh when the device
+    // has no multiDrawIndirect
+    Indirect,
+};
+
 struct Swapchain {
     Swapchain(Context& context, BufferManager& bufferManager, int width,
               int height);
@@ -40,17 +54,33 @@ struct Swapchain {
     void recreate(int width, int height);
     void updateUniformBuffer(uint32_t currentImage,
                              scene::UniformBufferObject ubo);
-    void beginMeshUpdates();
-    void addMesh(const Mesh* mesh);
-    void endMeshUpdates();
+    // records the commands of image for this frame, picking the level of
+    // detail of every mesh, culling the meshlets of the ones drawn at full
+    // resolution and the indirect draws hidden by the depth of the others;
+    // returns the number of triangles submitted before the occlusion
+    // culling. The draws are recorded in the order of the sorted queue.
+    // models and bounds place the meshes in the world, by
+    // DrawPacket::meshId. The previous frame of image must be done.
+    std::size_t recordCommandBuffer(uint32_t image, const RenderQueue& queue,
+                                    const std::vector<glm::mat4>& models,
+                                    const std::vector<MeshBounds>& bounds,
+                                    const LodView& lodView,
+                                    const CullView& cullView,
+                                    const glm::mat4& viewProjection);
 
     vk::SwapchainKHR swapchain;
     vk::Format format;
     vk::Extent2D extent;
     std::vector<SwapchainBuffer> imageBuffers;
     vk::RenderPass renderPass;
+    // the same pass split around the build of the depth pyramid: the early
+    // one clears and keeps the attachments, the late one loads and presents
+    vk::RenderPass earlyRenderPass;
+    vk::RenderPass lateRenderPass;
 
     std::unique_ptr<Pipeline> pipeline;
+    // for meshes uploaded with VertexFormat::Packed
+    std::unique_ptr<Pipeline> packedPipeline;
 
     std::vector<vk::Framebuffer> swapchainFramebuffers;
     vk::DescriptorPool descriptorPool;
@@ -61,11 +91,19 @@ struct Swapchain {
     // uniform buffers
     std::vector<Buffer> uniformBuffers;
 
-    // textures
-    std::unique_ptr<Texture> texture;
-    std::unique_ptr<Sampler> sampler;
+    // of the meshes, Mesh::material() indexes them
+    std::unique_ptr<Materials> materials;
 
     std::unique_ptr<DepthResources> depthResources;
+    std::unique_ptr<GpuTimer> gpuTimer;
+    std::unique_ptr<MeshletCuller> meshletCuller;
+    std::unique_ptr<DrawList> drawList;
+    std::unique_ptr<DepthPyramid> depthPyramid;
+    std::unique_ptr<OcclusionCuller> occlusionCuller;
+    // falls back to direct draws without drawIndirectFirstInstance
+    DrawMode drawMode = DrawMode::Indirect;
+    // of the indirect draws, in two phases around the depth pyramid
+    bool occlusionCulling = true;
 
   private:
     void _innerInit(int width, int height);
@@ -75,20 +113,30 @@ struct Swapchain {
     _createSwapChain(int width, int height);
     std::vector<SwapchainBuffer>
     _createImageViews(std::vector<vk::Image> images, vk::Format format);
-    vk::RenderPass _createRenderPass();
+    vk::RenderPass _createRenderPass(bool clear, bool present);
     std::vector<vk::Framebuffer> _createFramebuffers();
     vk::DescriptorPool _createDescriptorPool();
     vk::DescriptorSetLayout _createDescriptorSetLayout();
     std::vector<vk::DescriptorSet> _createDescriptorSets();
     void _updateDescriptorSets();
+    // points binding 1 of the set of image at the objects of the draw list
+    void _bindObjects(uint32_t image);
     std::vector<vk::CommandBuffer> _createCommandBuffers();
-    void _updateCommandBuffers();
     std::vector<Buffer> _createUniformBuffers(std::size_t imageSize);
-
-    std::vector<const Mesh*> _meshes;
+    // draws commandCount commands of buffer, or only the first ones up to
+    // the count at countOffset of countBuffer when the device can
+    void _drawIndirect(vk::CommandBuffer cmdBuffer, vk::Buffer buffer,
+                       std::size_t firstCommand, std::size_t commandCount,
+                       vk::Buffer countBuffer = {},
+                       vk::DeviceSize countOffset = 0);
 
     Context& _context;
     BufferManager& _bufferManager;
+    // of the object buffer binding 1 of each descriptor set points at, the
+    // capacity only grows so it tells the buffers apart
+    std::vector<std::size_t> _boundObjectCapacities;
+    // BufferManager::instanceBufferVersion() binding 2 points at
+    std::vector<uint32_t> _boundInstanceVersions;
 };
 
 } // namespace vulkan
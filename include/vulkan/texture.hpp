@@ -11,17 +11,32 @@ namespace vulkan {
 
 class Texture {
   public:
+    // the upload is recorded into batch, or submitted and waited for on its
+    // own without one
     Texture(const std::string& path, BufferManager& bufferManager,
-            Context& context);
+            Context& context, UploadBatch* batch = nullptr);
+    // from width * height RGBA8 pixels
+    Texture(const stbi_uc* pixels, uint32_t width, uint32_t height,
+            BufferManager& bufferManager, Context& context,
+            UploadBatch* batch = nullptr);
     ~Texture();
 
+    Texture(const Texture&) = delete;
+    Texture& operator=(const Texture&) = delete;
+
     uint32_t mipLevels;
     Image textureImage;
     vk::ImageView textureImageView;
 
   private:
-    std::pair<Image, uint32_t> _createTextureImage(const std::string& path);
-    void _generateMipLevels(vk::Image image, vk::Format format, uint32_t width,
+    std::pair<Image, uint32_t> _createTextureImage(const std::string& path,
+                                                   UploadBatch& batch);
+    std::pair<Image, uint32_t> _createTextureImage(const stbi_uc* pixels,
+                                                   uint32_t width,
+                                                   uint32_t height,
+                                                   UploadBatch& batch);
+    void _generateMipLevels(vk::CommandBuffer commandBuffer, vk::Image image,
+                            vk::Format format, uint32_t width,
                             uint32_t height, uint32_t mipLevels);
 
     BufferManager& _bufferManager;
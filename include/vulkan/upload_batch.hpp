@@ -0,0 +1,89 @@
+#ifndef VULKAN_UPLOAD_BATCH_HPP
+#define VULKAN_UPLOAD_BATCH_HPP
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "vulkan/buffer_manager.hpp"
+
+namespace vulkan {
+
+// Uploads recorded into a single command buffer and submitted at once,
+// instead of a blocking submit per copy. The data is staged in the staging
+// ring of the BufferManager until the fence of the batch is signalled, and
+// every upload is visible to the commands submitted after the batch. A batch
+// is used by a single thread, the destructor submits it if needed and waits
+// for it, logging the errors wait() would throw.
+//
+// With a transfer queue the copies run there, then a release barrier of
+// every written range hands it to the graphics family. The graphics queue
+// waits on a semaphore, acquires them and runs the commands that need it,
+// its submit signals the fence.
+class UploadBatch {
+  public:
+    explicit UploadBatch(BufferManager& bufferManager);
+    ~UploadBatch();
+
+    UploadBatch(const UploadBatch&) = delete;
+    UploadBatch& operator=(const UploadBatch&) = delete;
+
+    void copyBuffer(const void* data, vk::DeviceSize size,
+                    vk::Buffer dstBuffer, vk::DeviceSize dstOffset = 0);
+    // the image must be in the transfer destination layout, its mipLevels
+    // levels are handed over with the first one
+    void copyBufferToImage(const void* data, vk::DeviceSize size,
+                           vk::Image image, uint32_t width, uint32_t height,
+                           uint32_t mipLevels = 1);
+    // recorded with the copies, only for the transitions a transfer queue
+    // can do, e.g. to the transfer destination layout
+    void transitionImageLayout(vk::Image image, vk::Format format,
+                               vk::ImageLayout oldLayout,
+                               vk::ImageLayout newLayout, uint32_t mipLevels);
+    // for the commands needing the graphics queue, e.g. the blits of mip
+    // levels; they run after every copy
+    vk::CommandBuffer graphicsCommandBuffer();
+    // counts an upload the BufferManager wrote straight to device memory
+    // instead of recording a copy, see BufferManager::directWrites()
+    void addDirectWrite(vk::DeviceSize size) {
+        _uploadedSize += size;
+    }
+    // bytes staged or written directly so far, callers submit once it gets
+    // large
+    vk::DeviceSize uploadedSize() const {
+        return _uploadedSize;
+    }
+
+    // submits every recorded command, nothing can be recorded afterwards
+    const std::shared_ptr<UploadFence>& submit();
+    bool submitted() const {
+        return _submitted;
+    }
+    // submits if needed and blocks until the uploads are done
+    void wait();
+
+  private:
+    void _submitTransfer();
+
+    BufferManager& _bufferManager;
+    Context& _context;
+    bool _transfer;
+    // on the transfer queue when there is one
+    vk::CommandBuffer _copyCommands;
+    // on the graphics queue, the same as _copyCommands without transfer
+    // queue; the acquires are recorded at submit
+    vk::CommandBuffer _acquireCommands;
+    vk::CommandBuffer _graphicsCommands;
+    vk::Semaphore _copiesDone;
+    std::vector<vk::BufferMemoryBarrier> _bufferReleases;
+    std::vector<vk::ImageMemoryBarrier> _imageReleases;
+    std::shared_ptr<UploadFence> _fence;
+    vk::DeviceSize _uploadedSize = 0;
+    bool _submitted = false;
+};
+
+} // namespace vulkan
+
+#endif
@@ -28,6 +28,8 @@ const bool enableValidationLayers = true;
 struct QueueFamilyIndices {
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;
+    // transfer without graphics or compute, usually a DMA engine; optional
+    std::optional<uint32_t> transferFamily;
 
     bool isComplete() const {
         return graphicsFamily.has_value() && presentFamily.has_value();
@@ -78,11 +80,16 @@ uint32_t findMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags properties,
 
 vk::ImageView createImageView(vk::Image image, vk::Format format,
                               vk::ImageAspectFlags aspectFlags,
-                              uint32_t mipLevels, vk::Device device);
+                              uint32_t mipLevels, vk::Device device,
+                              uint32_t baseMipLevel = 0);
 
 void transitionImageLayout(vk::Image image, vk::Format format,
                            vk::ImageLayout oldLayout, vk::ImageLayout newLayout,
                            uint32_t mipLevels, Context& context);
+// records the barrier into commandBuffer instead of submitting it
+void transitionImageLayout(vk::CommandBuffer commandBuffer, vk::Image image,
+                           vk::Format format, vk::ImageLayout oldLayout,
+                           vk::ImageLayout newLayout, uint32_t mipLevels);
 
 bool hasStencilComponent(vk::Format format);
 
@@ -6,9 +6,10 @@ layout(location = 1) in vec2 fragTexCoord;
 
 layout(location = 0) out vec4 outColor;
 
-layout(binding = 1) uniform sampler2D texSampler;
+// texture of the material
+layout(set = 1, binding = 0) uniform sampler2D texSampler;
 
 void main() {
-    // outColor = vec4(fragColor, 1.0);
-    outColor = texture(texSampler, fragTexCoord);
+    // fragColor carries the vertex, instance and material colors
+    outColor = texture(texSampler, fragTexCoord) * vec4(fragColor, 1.0);
 }
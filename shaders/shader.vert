@@ -7,6 +7,49 @@ layout(binding = 0) uniform UniformBufferObject {
     mat4 proj;
 } ubo;
 
+// DrawList::instanceShift(): gl_InstanceIndex is the draw index shifted left
+// by it plus the instance index in the draw
+layout(push_constant) uniform Draws {
+    uint instanceShift;
+} draws;
+
+// vulkan::ObjectData, one per draw
+struct ObjectData {
+    mat4 model;
+    vec4 posOffset;
+    vec4 posScale;
+    vec4 texCoordDecode;
+    vec4 decodeColor;
+    uint material;
+    uint firstInstance;
+};
+
+layout(std430, binding = 1) readonly buffer Objects {
+    ObjectData objects[];
+};
+
+// vulkan::InstanceData of every mesh, shared by all the draws
+struct InstanceData {
+    mat4 model;
+    vec4 color;
+};
+
+layout(std430, binding = 2) readonly buffer Instances {
+    InstanceData instances[];
+};
+
+// vulkan::noInstances
+const uint noInstances = 0xffffffffu;
+
+// vulkan::MaterialConstants, indexed by ObjectData::material
+struct MaterialConstants {
+    vec4 diffuse;
+};
+
+layout(std430, set = 1, binding = 1) readonly buffer Materials {
+    MaterialConstants materials[];
+};
+
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inTexCoord;
@@ -15,7 +58,18 @@ layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
-    fragColor = inColor;
+    uint draw = gl_InstanceIndex >> draws.instanceShift;
+    uint instance = gl_InstanceIndex - (draw << draws.instanceShift);
+    ObjectData object = objects[draw];
+    mat4 model = object.model;
+    vec3 color = vec3(1.0);
+    if (object.firstInstance != noInstances) {
+        InstanceData data = instances[object.firstInstance + instance];
+        model = model * data.model;
+        color = data.color.rgb;
+    }
+    gl_Position = ubo.proj * ubo.view * ubo.model * model
+                  * vec4(inPosition, 1.0);
+    fragColor = inColor * color * materials[object.material].diffuse.rgb;
     fragTexCoord = inTexCoord;
-} 
+}
@@ -0,0 +1,82 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// shader.vert for vulkan::PackedVertex: the vertex input already turns the
+// 16 bit snorm and unorm components into floats in [-1, 1] and [0, 1], the
+// VertexDecode of the mesh comes with the object
+
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 model;
+    mat4 view;
+    mat4 proj;
+} ubo;
+
+// DrawList::instanceShift(): gl_InstanceIndex is the draw index shifted left
+// by it plus the instance index in the draw
+layout(push_constant) uniform Draws {
+    uint instanceShift;
+} draws;
+
+// vulkan::ObjectData, one per draw
+struct ObjectData {
+    mat4 model;
+    vec4 posOffset;
+    vec4 posScale;
+    // xy offset, zw scale
+    vec4 texCoordDecode;
+    vec4 decodeColor;
+    uint material;
+    uint firstInstance;
+};
+
+layout(std430, binding = 1) readonly buffer Objects {
+    ObjectData objects[];
+};
+
+// vulkan::InstanceData of every mesh, shared by all the draws
+struct InstanceData {
+    mat4 model;
+    vec4 color;
+};
+
+layout(std430, binding = 2) readonly buffer Instances {
+    InstanceData instances[];
+};
+
+// vulkan::noInstances
+const uint noInstances = 0xffffffffu;
+
+// vulkan::MaterialConstants, indexed by ObjectData::material
+struct MaterialConstants {
+    vec4 diffuse;
+};
+
+layout(std430, set = 1, binding = 1) readonly buffer Materials {
+    MaterialConstants materials[];
+};
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 2) in vec2 inTexCoord;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+
+void main() {
+    uint draw = gl_InstanceIndex >> draws.instanceShift;
+    uint instance = gl_InstanceIndex - (draw << draws.instanceShift);
+    ObjectData object = objects[draw];
+    mat4 model = object.model;
+    vec3 color = vec3(1.0);
+    if (object.firstInstance != noInstances) {
+        InstanceData data = instances[object.firstInstance + instance];
+        model = model * data.model;
+        color = data.color.rgb;
+    }
+    vec3 position = object.posOffset.xyz + object.posScale.xyz * inPosition;
+    gl_Position = ubo.proj * ubo.view * ubo.model * model
+                  * vec4(position, 1.0);
+    fragColor = object.decodeColor.rgb * color
+                * materials[object.material].diffuse.rgb;
+    fragTexCoord = object.texCoordDecode.xy
+                   + object.texCoordDecode.zw * inTexCoord;
+}
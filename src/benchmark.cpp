@@ -0,0 +1,232 @@
+#include "benchmark.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "mesh_builder.hpp"
+#include "obj_parser.hpp"
+#include "thread_pool.hpp"
+#include "transform_hierarchy.hpp"
+#include "vertex_dedup.hpp"
+
+namespace app {
+
+namespace {
+
+using clock = std::chrono::high_resolution_clock;
+
+// the hash scene.hpp used to provide, kept as a reference point
+struct XorVertexHash {
+    std::size_t operator()(const scene::Vertex& vertex) const {
+        auto hasher = std::hash<float>();
+        return hasher(vertex.pos.x) ^ hasher(vertex.pos.y)
+               ^ hasher(vertex.pos.z) ^ hasher(vertex.color.r)
+               ^ hasher(vertex.color.g) ^ hasher(vertex.color.b)
+               ^ hasher(vertex.texCoord.x) ^ hasher(vertex.texCoord.y);
+    }
+};
+
+template <class F> double bestOf(int runs, F&& f) {
+    double best = std::numeric_limits<double>::max();
+    for (int run = 0; run < runs; ++run) {
+        auto start = clock::now();
+        f();
+        best = std::min(
+            best, std::chrono::duration<double>(clock::now() - start).count());
+    }
+    return best;
+}
+
+template <class Hash>
+std::size_t dedupWithMap(const std::vector<std::vector<scene::Vertex>>& corners,
+                         std::size_t& collisions) {
+    std::size_t total = 0;
+    collisions = 0;
+    for (const auto& shape : corners) {
+        std::unordered_map<scene::Vertex, uint32_t, Hash> uniqueVertices;
+        std::vector<scene::Vertex> vertices;
+        std::vector<uint32_t> indices;
+        indices.reserve(shape.size());
+        for (const auto& vertex : shape) {
+            auto [it, newVertex]
+                = uniqueVertices.try_emplace(vertex, vertices.size());
+            if (newVertex) {
+                vertices.push_back(vertex);
+            }
+            indices.push_back(it->second);
+        }
+        for (std::size_t b = 0; b < uniqueVertices.bucket_count(); ++b) {
+            auto size = uniqueVertices.bucket_size(b);
+            collisions += size > 1 ? size - 1 : 0;
+        }
+        total += vertices.size();
+    }
+    return total;
+}
+
+std::size_t dedupWithFlatTable(
+    const std::vector<std::vector<scene::Vertex>>& corners) {
+    std::size_t total = 0;
+    for (const auto& shape : corners) {
+        std::vector<scene::Vertex> vertices;
+        std::vector<uint32_t> indices;
+        indices.reserve(shape.size());
+        scene::VertexDeduplicator uniqueVertices(vertices, shape.size());
+        for (const auto& vertex : shape) {
+            indices.push_back(uniqueVertices.insert(vertex));
+        }
+        total += vertices.size();
+    }
+    return total;
+}
+
+void runDedupBenchmark(const tinyobj::attrib_t& attrib,
+                       const std::vector<tinyobj::shape_t>& shapes) {
+    std::vector<std::vector<scene::Vertex>> corners;
+    std::size_t cornerCount = 0;
+    for (const auto& shape : shapes) {
+        std::vector<scene::Vertex> shapeCorners;
+        shapeCorners.reserve(shape.mesh.indices.size());
+        for (const auto& index : shape.mesh.indices) {
+            shapeCorners.push_back(scene::makeObjVertex(attrib, index));
+        }
+        cornerCount += shapeCorners.size();
+        corners.push_back(std::move(shapeCorners));
+    }
+
+    std::size_t unique = 0, collisions = 0;
+    auto report = [&](const char* name, double seconds) {
+        std::cout << "dedup " << name << ": " << seconds * 1000.0 << " ms, "
+                  << static_cast<double>(cornerCount) / seconds
+                  << " indices/s, " << unique << " unique vertices";
+    };
+
+    auto xorTime = bestOf(3, [&]() {
+        unique = dedupWithMap<XorVertexHash>(corners, collisions);
+    });
+    report("unordered_map + xor hash", xorTime);
+    std::cout << ", " << collisions << " bucket collisions" << std::endl;
+
+    auto mixTime = bestOf(3, [&]() {
+        unique = dedupWithMap<std::hash<scene::Vertex>>(corners, collisions);
+    });
+    report("unordered_map + mixed hash", mixTime);
+    std::cout << ", " << collisions << " bucket collisions" << std::endl;
+
+    auto flatTime
+        = bestOf(3, [&]() { unique = dedupWithFlatTable(corners); });
+    report("flat table", flatTime);
+    std::cout << std::endl;
+}
+
+} // namespace
+
+int runLoadBenchmark(const std::string& objPath, std::size_t maxThreads) {
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string warn, err;
+    auto start = clock::now();
+    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err,
+                          objPath.c_str())) {
+        std::cerr << warn << err << std::endl;
+        return 1;
+    }
+    std::cout << "tinyobj parse: "
+              << std::chrono::duration<double, std::milli>(clock::now()
+                                                           - start)
+                     .count()
+              << " ms" << std::endl;
+
+    runDedupBenchmark(attrib, shapes);
+
+    for (std::size_t threads = 1; threads <= maxThreads; ++threads) {
+        scene::ThreadPool pool(threads);
+        std::size_t vertexCount = 0;
+
+        auto best = bestOf(3, [&]() {
+            auto meshes = scene::buildMeshes(attrib, shapes, pool);
+            vertexCount = 0;
+            for (const auto& mesh : meshes) {
+                vertexCount += mesh.vertices.size();
+            }
+        });
+
+        std::cout << threads << " threads: build " << best * 1000.0 << " ms, "
+                  << static_cast<double>(shapes.size()) / best << " shapes/s, "
+                  << static_cast<double>(vertexCount) / best << " vertices/s";
+
+        std::vector<scene::MaterialData> materials;
+        auto parse = bestOf(
+            3, [&]() { scene::parseObj(objPath, pool, materials); });
+        std::cout << ", streaming parse + build " << parse * 1000.0 << " ms"
+                  << std::endl;
+    }
+
+    return 0;
+}
+
+int runTransformBenchmark(std::size_t nodeCount, std::size_t maxThreads) {
+    // a forest of small trees: about one root per thousand nodes and random
+    // parents among the earlier nodes of the tree, a few levels deep
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+    scene::TransformHierarchy hierarchy;
+    std::vector<scene::NodeId> roots;
+    for (std::size_t i = 0; i < nodeCount; ++i) {
+        scene::Transform local;
+        local.translation = {offset(gen), offset(gen), offset(gen)};
+        local.rotation = glm::normalize(
+            glm::quat(1.0f, offset(gen), offset(gen), offset(gen)));
+        auto parent = scene::noParent;
+        if (i % 1000 == 0) {
+            roots.push_back(static_cast<scene::NodeId>(i));
+        } else {
+            parent = roots.back()
+                     + static_cast<scene::NodeId>(gen() % (i - roots.back()));
+        }
+        hierarchy.add(local, parent);
+    }
+    std::vector<glm::mat4> worlds(nodeCount);
+
+    std::cout << "bench-transforms: " << nodeCount << " nodes, "
+              << roots.size() << " roots" << std::endl;
+    for (std::size_t threads = 1; threads <= maxThreads; ++threads) {
+        scene::ThreadPool pool(threads);
+        std::size_t updated = 0;
+
+        auto full = bestOf(5, [&]() {
+            for (auto root : roots) {
+                hierarchy.setLocal(root, hierarchy.local(root));
+            }
+            updated = hierarchy.update(pool);
+        });
+        std::cout << threads << " threads: every node " << full * 1000.0
+                  << " ms (" << updated << " nodes)";
+
+        // 1% of the nodes move, with their subtrees
+        auto partial = bestOf(5, [&]() {
+            for (std::size_t i = 0; i < nodeCount / 100; ++i) {
+                auto node = static_cast<scene::NodeId>(gen() % nodeCount);
+                hierarchy.setLocal(node, hierarchy.local(node));
+            }
+            updated = hierarchy.update(pool);
+        });
+        std::cout << ", 1% moved " << partial * 1000.0 << " ms (" << updated
+                  << " nodes)";
+
+        auto copy
+            = bestOf(5, [&]() { hierarchy.copyWorldMatrices(worlds.data()); });
+        std::cout << ", copy " << copy * 1000.0 << " ms" << std::endl;
+    }
+
+    return 0;
+}
+
+} // namespace app
@@ -0,0 +1,151 @@
+#include "benchmark.hpp"
+
+#include <cmath>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "scene.hpp"
+#include "vulkan/context.hpp"
+#include "vulkan/renderer.hpp"
+#include "window.hpp"
+
+namespace app {
+
+namespace {
+
+constexpr std::size_t width = 1000;
+constexpr std::size_t height = 800;
+
+// cube of half size h around center, counter clockwise faces
+void addCube(glm::vec3 center, float h, std::vector<scene::Vertex>& vertices,
+             std::vector<uint32_t>& indices) {
+    for (int axis = 0; axis < 3; ++axis) {
+        for (float side : {-1.0f, 1.0f}) {
+            glm::vec3 n{0.0f}, u{0.0f}, v{0.0f};
+            n[axis] = side;
+            u[(axis + 1) % 3] = 1.0f;
+            v[(axis + 2) % 3] = 1.0f;
+
+            auto first = static_cast<uint32_t>(vertices.size());
+            const glm::vec2 corners[] = {{-1, -1}, {1, -1}, {1, 1}, {-1, 1}};
+            for (const auto& c : corners) {
+                vertices.emplace_back(center + h * (n + c.x * u + c.y * v),
+                                      glm::vec3{1.0f, 1.0f, 1.0f},
+                                      (c + 1.0f) * 0.5f);
+            }
+            // u x v is +axis, the negative side turns the other way
+            if (side > 0.0f) {
+                indices.insert(indices.end(), {first, first + 1, first + 2,
+                                               first, first + 2, first + 3});
+            } else {
+                indices.insert(indices.end(), {first, first + 2, first + 1,
+                                               first, first + 3, first + 2});
+            }
+        }
+    }
+}
+
+} // namespace
+
+int runDrawBenchmark(std::size_t meshCount, std::size_t frames) {
+    try {
+        WindowContext windowContext;
+        Window window(width, height, "Vulkan draw benchmark");
+
+        vulkan::Context context(window.inner());
+        vulkan::BufferManager bufferManager(context);
+        vulkan::Renderer renderer(window, context, bufferManager);
+
+        auto side = static_cast<std::size_t>(
+            std::ceil(std::sqrt(static_cast<double>(meshCount))));
+        std::vector<std::unique_ptr<vulkan::Mesh>> meshes;
+        std::vector<const vulkan::Mesh*> meshPointers;
+        meshes.reserve(meshCount);
+        for (std::size_t i = 0; i < meshCount; ++i) {
+            std::vector<scene::Vertex> vertices;
+            std::vector<uint32_t> indices;
+            addCube({static_cast<float>(i % side), 0.0f,
+                     static_cast<float>(i / side)},
+                    0.3f, vertices, indices);
+            scene::MeshData data;
+            data.vertices = std::move(vertices);
+            data.indices = std::move(indices);
+            meshes.push_back(std::make_unique<vulkan::Mesh>(
+                bufferManager, data.view(), vulkan::VertexFormat::Packed));
+            meshPointers.push_back(meshes.back().get());
+        }
+        renderer.setMeshes(meshPointers);
+
+        auto gridSize = static_cast<float>(side);
+        renderer.setViewMatrix(glm::lookAt(
+            glm::vec3{gridSize * 0.5f, gridSize * 0.6f, -gridSize * 0.3f},
+            glm::vec3{gridSize * 0.5f, 0.0f, gridSize * 0.5f},
+            glm::vec3{0.0f, 1.0f, 0.0f}));
+
+        std::cout << "bench-draw: " << meshCount << " meshes, " << frames
+                  << " frames per mode\n";
+        // false when the window was closed
+        auto run = [&](const char* name) {
+            double recordTime = 0.0, gpuTime = 0.0;
+            std::size_t gpuFrames = 0;
+            for (std::size_t frame = 0; frame < frames; ++frame) {
+                if (window.shouldClose()) {
+                    return false;
+                }
+                windowContext.pollEvents();
+                renderer.drawFrame();
+
+                const auto& times = renderer.lastFrameTimes();
+                recordTime += times.recordMs;
+                // the first frames report timestamps of the previous mode
+                if (times.gpuMs && frame >= 4) {
+                    gpuTime += *times.gpuMs;
+                    ++gpuFrames;
+                }
+            }
+            std::cout << "  " << name << ": CPU "
+                      << recordTime / static_cast<double>(frames)
+                      << " ms/frame recording, GPU "
+                      << (gpuFrames > 0 ? gpuTime / gpuFrames : 0.0)
+                      << " ms/frame\n";
+            return true;
+        };
+
+        const std::pair<vulkan::DrawMode, const char*> modes[] = {
+            {vulkan::DrawMode::Direct, "direct"},
+            {vulkan::DrawMode::Indirect, "indirect"},
+        };
+        for (const auto& [mode, name] : modes) {
+            renderer.setDrawMode(mode);
+            if (!run(name)) {
+                context.deviceWaitIdle();
+                return 1;
+            }
+        }
+
+        // the same grid as copies of the first cube, moved to its cells
+        std::vector<vulkan::InstanceData> instances(meshCount);
+        for (std::size_t i = 0; i < meshCount; ++i) {
+            instances[i].model = glm::translate(
+                glm::mat4{1.0f}, glm::vec3{static_cast<float>(i % side), 0.0f,
+                                           static_cast<float>(i / side)});
+        }
+        context.deviceWaitIdle();
+        meshes.front()->setInstances(instances);
+        renderer.setMeshes({meshes.front().get()});
+        if (!run("instanced")) {
+            context.deviceWaitIdle();
+            return 1;
+        }
+        context.deviceWaitIdle();
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+} // namespace app
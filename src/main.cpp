@@ -3,13 +3,17 @@
 #include <glm/mat4x4.hpp>
 #include <glm/vec4.hpp>
 
+#include <algorithm>
 #include <chrono>
 #include <exception>
 #include <iostream>
 #include <optional>
+#include <stdexcept>
+#include <string>
 #include <thread>
 #include <vector>
 
+#include "benchmark.hpp"
 #include "game.hpp"
 #include "scene.hpp"
 #include "vulkan/context.hpp"
@@ -56,7 +60,92 @@ class FpsWatcher {
     int _counter;
 };
 
-int main() {
+// "none", "all" or a comma separated list of cache, overdraw and fetch
+uint32_t parseOptimizations(const std::string& list) {
+    if (list == "none") {
+        return 0;
+    }
+    if (list == "all") {
+        return scene::allMeshOptimizations;
+    }
+
+    uint32_t optimizations = 0;
+    std::size_t begin = 0;
+    while (begin <= list.size()) {
+        auto end = std::min(list.find(',', begin), list.size());
+        auto name = list.substr(begin, end - begin);
+        if (name == "cache") {
+            optimizations |= scene::OptimizeVertexCache;
+        } else if (name == "overdraw") {
+            optimizations |= scene::OptimizeOverdraw;
+        } else if (name == "fetch") {
+            optimizations |= scene::OptimizeVertexFetch;
+        } else if (name == "lods") {
+            optimizations |= scene::GenerateLods;
+        } else if (name == "meshlets") {
+            optimizations |= scene::BuildMeshlets;
+        } else if (name == "split") {
+            optimizations |= scene::SplitForShortIndices;
+        } else {
+            throw std::invalid_argument("unknown mesh optimization " + name);
+        }
+        begin = end + 1;
+    }
+    return optimizations;
+}
+
+int main(int argc, char** argv) {
+    if (argc >= 3 && std::string(argv[1]) == "--bench-load") {
+        std::size_t maxThreads
+            = argc >= 4 ? std::stoul(argv[3])
+                        : std::max(1u, std::thread::hardware_concurrency());
+        return app::runLoadBenchmark(argv[2], maxThreads);
+    }
+
+    if (argc >= 2 && std::string(argv[1]) == "--bench-transforms") {
+        std::size_t nodeCount = argc >= 3 ? std::stoul(argv[2]) : 100000;
+        std::size_t maxThreads
+            = argc >= 4 ? std::stoul(argv[3])
+                        : std::max(1u, std::thread::hardware_concurrency());
+        return app::runTransformBenchmark(nodeCount, maxThreads);
+    }
+
+    if (argc >= 2 && std::string(argv[1]) == "--bench-draw") {
+        std::size_t meshCount = argc >= 3 ? std::stoul(argv[2]) : 10000;
+        std::size_t frames = argc >= 4 ? std::stoul(argv[3]) : 300;
+        return app::runDrawBenchmark(meshCount, frames);
+    }
+
+    scene::LoadOptions loadOptions;
+    // the chalet has no MTL library
+    loadOptions.defaultTexture = "../obj/chalet/chalet.jpg";
+    bool directDraws = false;
+    bool occlusionCulling = true;
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        // e.g. --optimize none to compare the GPU time with the OBJ order
+        if (flag == "--optimize" && i + 1 < argc) {
+            try {
+                loadOptions.optimizations = parseOptimizations(argv[++i]);
+            } catch (std::exception& e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+        } else if (flag == "--full-vertices") {
+            // 32 bytes vertices instead of the 12 bytes quantized ones
+            loadOptions.vertexFormat = vulkan::VertexFormat::Full;
+        } else if (flag == "--direct-draws") {
+            // one draw call per mesh instead of the indirect batches
+            directDraws = true;
+        } else if (flag == "--no-occlusion") {
+            // every indirect draw in a single pass, no depth pyramid
+            occlusionCulling = false;
+        } else {
+            std::cerr << "unknown option " << flag << std::endl;
+            return 1;
+        }
+    }
+
     try {
         app::WindowContext windowContext;
         app::Window window(WIDTH, HEIGHT, "Vulkan window");
@@ -66,8 +155,13 @@ int main() {
         vulkan::Renderer renderer(window, context, bufferManager);
 
         Game game;
-        scene::Scene scene{bufferManager, "../obj/chalet/chalet.obj"};
+        scene::AsyncScene scene{bufferManager, "../obj/chalet/chalet.obj",
+                                loadOptions};
         renderer.setScene(scene);
+        if (directDraws) {
+            renderer.setDrawMode(vulkan::DrawMode::Direct);
+        }
+        renderer.setOcclusionCulling(occlusionCulling);
 
         app::GameRendererCoupler coupler{game, renderer};
         window.linkToCoupler(&coupler);
@@ -0,0 +1,126 @@
+#include "mapped_file.hpp"
+
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace scene {
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path) {
+    _fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                              nullptr, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (_fileHandle == INVALID_HANDLE_VALUE) {
+        _fileHandle = nullptr;
+        throw std::runtime_error("failed to open file " + path);
+    }
+
+    LARGE_INTEGER size;
+    GetFileSizeEx(_fileHandle, &size);
+    _size = static_cast<std::size_t>(size.QuadPart);
+    if (_size == 0) {
+        return;
+    }
+
+    _mappingHandle = CreateFileMappingA(_fileHandle, nullptr, PAGE_READONLY,
+                                        0, 0, nullptr);
+    if (!_mappingHandle) {
+        _unmap();
+        throw std::runtime_error("failed to map file " + path);
+    }
+    _data = static_cast<const char*>(
+        MapViewOfFile(_mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if (!_data) {
+        _unmap();
+        throw std::runtime_error("failed to map file " + path);
+    }
+}
+
+void MappedFile::_unmap() {
+    if (_data) {
+        UnmapViewOfFile(_data);
+    }
+    if (_mappingHandle) {
+        CloseHandle(_mappingHandle);
+    }
+    if (_fileHandle) {
+        CloseHandle(_fileHandle);
+    }
+    _data = nullptr;
+    _mappingHandle = _fileHandle = nullptr;
+    _size = 0;
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("failed to open file " + path);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error("failed to stat file " + path);
+    }
+    _size = static_cast<std::size_t>(st.st_size);
+    if (_size == 0) {
+        close(fd);
+        return;
+    }
+
+    void* data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        _size = 0;
+        throw std::runtime_error("failed to map file " + path);
+    }
+    madvise(data, _size, MADV_SEQUENTIAL);
+    _data = static_cast<const char*>(data);
+}
+
+void MappedFile::_unmap() {
+    if (_data) {
+        munmap(const_cast<char*>(_data), _size);
+    }
+    _data = nullptr;
+    _size = 0;
+}
+
+#endif
+
+MappedFile::~MappedFile() {
+    _unmap();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept {
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        _unmap();
+        std::swap(_data, other._data);
+        std::swap(_size, other._size);
+#ifdef _WIN32
+        std::swap(_fileHandle, other._fileHandle);
+        std::swap(_mappingHandle, other._mappingHandle);
+#endif
+    }
+    return *this;
+}
+
+} // namespace scene
@@ -0,0 +1,51 @@
+#include "material.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace scene {
+
+std::vector<MaterialData> parseMtl(const std::string& mtlPath) {
+    std::ifstream file(mtlPath);
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open MTL file " + mtlPath);
+    }
+    auto directory = std::filesystem::path(mtlPath).parent_path();
+
+    std::vector<MaterialData> materials;
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream stream(line);
+        std::string keyword;
+        if (!(stream >> keyword) || keyword[0] == '#') {
+            continue;
+        }
+
+        if (keyword == "newmtl") {
+            materials.emplace_back();
+            stream >> materials.back().name;
+        } else if (materials.empty()) {
+            continue;
+        } else if (keyword == "Kd") {
+            auto& diffuse = materials.back().diffuse;
+            stream >> diffuse.r >> diffuse.g >> diffuse.b;
+        } else if (keyword == "map_Kd") {
+            // options such as -s come first, the file name is last
+            std::string token, texture;
+            while (stream >> token) {
+                texture = token;
+            }
+            std::replace(texture.begin(), texture.end(), '\\', '/');
+            if (!texture.empty()) {
+                materials.back().diffuseTexture
+                    = (directory / texture).generic_string();
+            }
+        }
+    }
+    return materials;
+}
+
+} // namespace scene
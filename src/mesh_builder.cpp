@@ -0,0 +1,131 @@
+#include "mesh_builder.hpp"
+
+#include <algorithm>
+
+#include "obj_parser.hpp"
+#include "vertex_dedup.hpp"
+
+namespace scene {
+
+namespace {
+
+struct WorkItem {
+    std::size_t shape;
+    std::size_t begin, end;
+};
+
+void deduplicateRange(const tinyobj::attrib_t& attrib,
+                      const std::vector<tinyobj::index_t>& shapeIndices,
+                      std::size_t begin, std::size_t end, MeshData& out) {
+    VertexDeduplicator uniqueVertices(out.vertices, end - begin);
+    auto& indices = out.indices;
+    indices.reserve(end - begin);
+
+    for (auto i = begin; i < end; ++i) {
+        indices.push_back(
+            uniqueVertices.insert(makeObjVertex(attrib, shapeIndices[i])));
+    }
+}
+
+} // namespace
+
+Vertex makeObjVertex(const tinyobj::attrib_t& attrib,
+                     const tinyobj::index_t& index) {
+    // fix for coordinates
+    glm::vec3 pos{
+        attrib.vertices[3 * index.vertex_index + 1],
+        attrib.vertices[3 * index.vertex_index + 2],
+        attrib.vertices[3 * index.vertex_index + 0],
+    };
+
+    // fix for uv coord
+    glm::vec2 texCoord{0.0f, 0.0f};
+    if (index.texcoord_index >= 0) {
+        texCoord = glm::vec2{
+            attrib.texcoords[2 * index.texcoord_index + 0],
+            1.0f - attrib.texcoords[2 * index.texcoord_index + 1],
+        };
+    }
+
+    glm::vec3 color{1.0, 1.0, 1.0};
+
+    return Vertex{pos, color, texCoord};
+}
+
+MeshData mergeMeshChunks(std::vector<MeshData>& chunks, std::size_t begin,
+                         std::size_t end) {
+    if (end - begin == 1) {
+        return std::move(chunks[begin]);
+    }
+
+    std::size_t vertexCount = 0, indexCount = 0;
+    for (auto c = begin; c < end; ++c) {
+        vertexCount += chunks[c].vertices.size();
+        indexCount += chunks[c].indices.size();
+    }
+
+    MeshData mesh;
+    mesh.indices.reserve(indexCount);
+    VertexDeduplicator uniqueVertices(mesh.vertices, vertexCount);
+
+    std::vector<uint32_t> remap;
+    for (auto c = begin; c < end; ++c) {
+        auto& chunk = chunks[c];
+
+        remap.resize(chunk.vertices.size());
+        for (std::size_t v = 0; v < chunk.vertices.size(); ++v) {
+            remap[v] = uniqueVertices.insert(chunk.vertices[v]);
+        }
+
+        for (auto index : chunk.indices) {
+            mesh.indices.push_back(remap[index]);
+        }
+
+        chunk = MeshData{};
+    }
+
+    return mesh;
+}
+
+std::vector<MeshData> buildMeshes(const tinyobj::attrib_t& attrib,
+                                  const std::vector<tinyobj::shape_t>& shapes,
+                                  ThreadPool& pool) {
+    std::vector<WorkItem> items;
+    std::vector<std::size_t> firstItem;
+    firstItem.reserve(shapes.size() + 1);
+
+    for (std::size_t s = 0; s < shapes.size(); ++s) {
+        firstItem.push_back(items.size());
+        auto count = shapes[s].mesh.indices.size();
+        std::size_t begin = 0;
+        do {
+            auto end = std::min(count, begin + dedupChunkSize);
+            items.push_back(WorkItem{s, begin, end});
+            begin = end;
+        } while (begin < count);
+    }
+    firstItem.push_back(items.size());
+
+    std::vector<MeshData> chunks(items.size());
+    pool.parallelFor(items.size(), [&](std::size_t i) {
+        const auto& item = items[i];
+        deduplicateRange(attrib, shapes[item.shape].mesh.indices, item.begin,
+                         item.end, chunks[i]);
+    });
+
+    std::vector<MeshData> meshes(shapes.size());
+    pool.parallelFor(shapes.size(), [&](std::size_t s) {
+        meshes[s] = mergeMeshChunks(chunks, firstItem[s], firstItem[s + 1]);
+    });
+
+    return meshes;
+}
+
+std::vector<MeshData> loadObjMeshes(const std::string& objPath,
+                                    ThreadPool& pool,
+                                    std::vector<MaterialData>& materials,
+                                    std::vector<std::string>* libraries) {
+    return parseObj(objPath, pool, materials, libraries);
+}
+
+} // namespace scene
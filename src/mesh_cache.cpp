@@ -0,0 +1,466 @@
+#include "mesh_cache.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+namespace scene {
+
+namespace {
+
+constexpr char cacheMagic[8] = {'V', 'K', 'L', 'M', 'E', 'S', 'H', '\0'};
+constexpr uint32_t cacheVersion = 6;
+constexpr std::size_t dataAlignment = 16;
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t vertexSize;
+    uint64_t sourceSize;
+    int64_t sourceMtime;
+    uint64_t contentHash;
+    uint32_t meshCount;
+    uint32_t pathLength;
+    uint32_t optimizations;
+    uint32_t materialCount;
+    // MaterialRecords, each followed by its name and texture path
+    uint64_t materialsOffset;
+    uint32_t libraryCount;
+    uint32_t padding;
+    // LibraryRecords, each followed by its path
+    uint64_t librariesOffset;
+};
+
+// arrays stored for every mesh, in file order
+enum Section {
+    VertexSection,
+    IndexSection,
+    LodSection,
+    MeshletSection,
+    MeshletVertexSection,
+    MeshletTriangleSection,
+    sectionCount
+};
+
+constexpr std::size_t sectionElementSize[sectionCount] = {
+    sizeof(Vertex),  sizeof(uint32_t), sizeof(MeshLod),
+    sizeof(Meshlet), sizeof(uint32_t), sizeof(uint32_t),
+};
+
+struct MeshRecord {
+    struct {
+        uint64_t offset;
+        uint64_t count;
+    } sections[sectionCount];
+    uint32_t material;
+    uint32_t padding;
+};
+
+struct MaterialRecord {
+    float diffuse[3];
+    uint32_t nameLength;
+    uint32_t textureLength;
+};
+
+// a library that couldn't be read has missingLibrary as its size
+struct LibraryRecord {
+    uint64_t size;
+    int64_t mtime;
+    uint32_t pathLength;
+    uint32_t padding;
+};
+
+constexpr uint64_t missingLibrary = ~uint64_t(0);
+
+struct SectionData {
+    const void* data;
+    std::size_t count;
+};
+
+template <class T>
+const T* sectionData(const MappedFile& file, const MeshRecord& record,
+                     Section section) {
+    return reinterpret_cast<const T*>(file.data()
+                                      + record.sections[section].offset);
+}
+
+std::array<SectionData, sectionCount> meshSections(const MeshData& mesh) {
+    return {{
+        {mesh.vertices.data(), mesh.vertices.size()},
+        {mesh.indices.data(), mesh.indices.size()},
+        {mesh.lods.data(), mesh.lods.size()},
+        {mesh.meshlets.data(), mesh.meshlets.size()},
+        {mesh.meshletVertices.data(), mesh.meshletVertices.size()},
+        {mesh.meshletTriangles.data(), mesh.meshletTriangles.size()},
+    }};
+}
+
+std::size_t alignUp(std::size_t value, std::size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+std::size_t recordsOffset(uint32_t pathLength) {
+    return alignUp(sizeof(CacheHeader) + pathLength, alignof(MeshRecord));
+}
+
+CacheHeader readHeader(const MappedFile& file) {
+    CacheHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    return header;
+}
+
+MeshRecord readRecord(const MappedFile& file, std::size_t index) {
+    auto header = readHeader(file);
+    MeshRecord record;
+    std::memcpy(&record,
+                file.data() + recordsOffset(header.pathLength)
+                    + index * sizeof(MeshRecord),
+                sizeof(record));
+    return record;
+}
+
+// calls f(record, name, texture) for every material, returns false if they
+// don't fit in the file
+template <class F> bool forEachMaterial(const MappedFile& file, F&& f) {
+    auto header = readHeader(file);
+    auto offset = static_cast<std::size_t>(header.materialsOffset);
+    for (uint32_t i = 0; i < header.materialCount; ++i) {
+        if (offset + sizeof(MaterialRecord) > file.size()) {
+            return false;
+        }
+        MaterialRecord record;
+        std::memcpy(&record, file.data() + offset, sizeof(record));
+        offset += sizeof(record);
+        if (offset + record.nameLength + record.textureLength > file.size()) {
+            return false;
+        }
+        auto name = file.data() + offset;
+        auto texture = name + record.nameLength;
+        f(record, std::string(name, record.nameLength),
+          std::string(texture, record.textureLength));
+        offset += record.nameLength + record.textureLength;
+    }
+    return true;
+}
+
+int64_t sourceMtime(const std::string& path) {
+    return static_cast<int64_t>(
+        std::filesystem::last_write_time(path).time_since_epoch().count());
+}
+
+LibraryRecord libraryRecord(const std::string& path) {
+    LibraryRecord record = {};
+    record.size = missingLibrary;
+    record.pathLength = static_cast<uint32_t>(path.size());
+    std::error_code ec;
+    auto size = std::filesystem::file_size(path, ec);
+    if (ec) {
+        return record;
+    }
+    auto mtime = std::filesystem::last_write_time(path, ec);
+    if (ec) {
+        return record;
+    }
+    record.size = size;
+    record.mtime = static_cast<int64_t>(mtime.time_since_epoch().count());
+    return record;
+}
+
+// true if the libraries fit in the file and none of them changed since the
+// cache was written
+bool librariesUnchanged(const MappedFile& file) {
+    auto header = readHeader(file);
+    auto size = file.size();
+    if (header.librariesOffset > size) {
+        return false;
+    }
+    auto offset = static_cast<std::size_t>(header.librariesOffset);
+    for (uint32_t i = 0; i < header.libraryCount; ++i) {
+        if (size - offset < sizeof(LibraryRecord)) {
+            return false;
+        }
+        LibraryRecord stored;
+        std::memcpy(&stored, file.data() + offset, sizeof(stored));
+        offset += sizeof(stored);
+        if (size - offset < stored.pathLength) {
+            return false;
+        }
+        std::string path(file.data() + offset, stored.pathLength);
+        offset += stored.pathLength;
+
+        auto current = libraryRecord(path);
+        if (current.size != stored.size || current.mtime != stored.mtime) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint64_t mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+uint64_t contentHash(const std::string& path) {
+    MappedFile file(path);
+    auto data = file.data();
+    auto size = file.size();
+
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ size;
+    std::size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        h = mix(h ^ word) + 0x9e3779b97f4a7c15ull;
+    }
+    uint64_t tail = 0;
+    if (i < size) {
+        std::memcpy(&tail, data + i, size - i);
+    }
+    return mix(h ^ tail);
+}
+
+} // namespace
+
+std::string MeshCache::cachePath(const std::string& sourcePath) {
+    return sourcePath + ".meshcache";
+}
+
+std::optional<MeshCache> MeshCache::open(const std::string& sourcePath,
+                                         uint32_t optimizations) {
+    auto path = cachePath(sourcePath);
+    std::error_code ec;
+    if (!std::filesystem::exists(path, ec)
+        || !std::filesystem::exists(sourcePath, ec)) {
+        return {};
+    }
+
+    MappedFile file(path);
+    if (file.size() < sizeof(CacheHeader)) {
+        return {};
+    }
+
+    CacheHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0
+        || header.version != cacheVersion
+        || header.vertexSize != sizeof(Vertex)
+        || header.optimizations != optimizations) {
+        return {};
+    }
+
+    auto recordsEnd = recordsOffset(header.pathLength)
+                      + header.meshCount * sizeof(MeshRecord);
+    if (file.size() < recordsEnd) {
+        return {};
+    }
+    std::string storedPath(file.data() + sizeof(CacheHeader),
+                           header.pathLength);
+    if (storedPath != sourcePath) {
+        return {};
+    }
+
+    auto sourceSize = std::filesystem::file_size(sourcePath);
+    if (header.sourceSize != sourceSize) {
+        return {};
+    }
+
+    auto mtime = sourceMtime(sourcePath);
+    if (header.sourceMtime != mtime) {
+        // same size but touched: only the content can tell
+        if (header.contentHash != contentHash(sourcePath)) {
+            return {};
+        }
+        // refresh the stored mtime so the next start skips the hash
+        std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+        f.seekp(offsetof(CacheHeader, sourceMtime));
+        f.write(reinterpret_cast<const char*>(&mtime), sizeof(mtime));
+    }
+
+    if (!librariesUnchanged(file)) {
+        return {};
+    }
+
+    MeshCache cache(std::move(file));
+    auto checkMaterial
+        = [](const MaterialRecord&, const std::string&, const std::string&) {};
+    if (!forEachMaterial(cache._file, checkMaterial)) {
+        return {};
+    }
+    for (std::size_t i = 0; i < cache.meshCount(); ++i) {
+        auto record = readRecord(cache._file, i);
+        for (std::size_t s = 0; s < sectionCount; ++s) {
+            // written so that a corrupt offset or count can't wrap around
+            const auto& section = record.sections[s];
+            auto size = cache._file.size();
+            if (section.offset > size
+                || section.count
+                       > (size - section.offset) / sectionElementSize[s]) {
+                return {};
+            }
+        }
+        if (record.material >= header.materialCount) {
+            return {};
+        }
+    }
+    return cache;
+}
+
+void MeshCache::write(const std::string& sourcePath,
+                      const std::vector<std::string>& libraries,
+                      const std::vector<MeshData>& meshes,
+                      const std::vector<MaterialData>& materials,
+                      uint32_t optimizations) {
+    CacheHeader header = {};
+    std::memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.version = cacheVersion;
+    header.vertexSize = sizeof(Vertex);
+    header.sourceSize = std::filesystem::file_size(sourcePath);
+    header.sourceMtime = sourceMtime(sourcePath);
+    header.contentHash = contentHash(sourcePath);
+    header.meshCount = static_cast<uint32_t>(meshes.size());
+    header.pathLength = static_cast<uint32_t>(sourcePath.size());
+    header.optimizations = optimizations;
+    header.materialCount = static_cast<uint32_t>(materials.size());
+    header.libraryCount = static_cast<uint32_t>(libraries.size());
+
+    std::vector<MeshRecord> records;
+    records.reserve(meshes.size());
+    auto offset = alignUp(recordsOffset(header.pathLength)
+                              + meshes.size() * sizeof(MeshRecord),
+                          dataAlignment);
+    for (const auto& mesh : meshes) {
+        MeshRecord record = {};
+        record.material = mesh.material;
+        auto sections = meshSections(mesh);
+        for (std::size_t s = 0; s < sectionCount; ++s) {
+            record.sections[s].offset = offset;
+            record.sections[s].count = sections[s].count;
+            offset = alignUp(offset + sections[s].count * sectionElementSize[s],
+                             dataAlignment);
+        }
+        records.push_back(record);
+    }
+    header.materialsOffset = offset;
+    for (const auto& material : materials) {
+        offset += sizeof(MaterialRecord) + material.name.size()
+                  + material.diffuseTexture.size();
+    }
+    header.librariesOffset = offset;
+
+    auto path = cachePath(sourcePath);
+    auto tmpPath = path + ".tmp";
+    {
+        std::ofstream f(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!f.is_open()) {
+            throw std::runtime_error("failed to create mesh cache " + path);
+        }
+
+        std::size_t written = 0;
+        auto put = [&](const void* data, std::size_t size) {
+            f.write(static_cast<const char*>(data), size);
+            written += size;
+        };
+        auto padTo = [&](std::size_t target) {
+            static const char zeros[dataAlignment] = {};
+            while (written < target) {
+                put(zeros, std::min(dataAlignment, target - written));
+            }
+        };
+
+        put(&header, sizeof(header));
+        put(sourcePath.data(), sourcePath.size());
+        padTo(recordsOffset(header.pathLength));
+        put(records.data(), records.size() * sizeof(MeshRecord));
+        for (std::size_t i = 0; i < meshes.size(); ++i) {
+            auto sections = meshSections(meshes[i]);
+            for (std::size_t s = 0; s < sectionCount; ++s) {
+                padTo(records[i].sections[s].offset);
+                put(sections[s].data,
+                    sections[s].count * sectionElementSize[s]);
+            }
+        }
+        padTo(header.materialsOffset);
+        for (const auto& material : materials) {
+            MaterialRecord record;
+            record.diffuse[0] = material.diffuse.r;
+            record.diffuse[1] = material.diffuse.g;
+            record.diffuse[2] = material.diffuse.b;
+            record.nameLength = static_cast<uint32_t>(material.name.size());
+            record.textureLength
+                = static_cast<uint32_t>(material.diffuseTexture.size());
+            put(&record, sizeof(record));
+            put(material.name.data(), material.name.size());
+            put(material.diffuseTexture.data(),
+                material.diffuseTexture.size());
+        }
+        for (const auto& library : libraries) {
+            auto record = libraryRecord(library);
+            put(&record, sizeof(record));
+            put(library.data(), library.size());
+        }
+
+        if (!f) {
+            throw std::runtime_error("failed to write mesh cache " + path);
+        }
+    }
+    std::filesystem::rename(tmpPath, path);
+}
+
+MeshCache::MeshCache(MappedFile file) : _file(std::move(file)) {
+}
+
+std::size_t MeshCache::meshCount() const {
+    return readHeader(_file).meshCount;
+}
+
+std::vector<MaterialData> MeshCache::materials() const {
+    std::vector<MaterialData> materials;
+    forEachMaterial(_file, [&](const MaterialRecord& record, std::string name,
+                               std::string texture) {
+        MaterialData material;
+        material.name = std::move(name);
+        material.diffuse = glm::vec3(record.diffuse[0], record.diffuse[1],
+                                     record.diffuse[2]);
+        material.diffuseTexture = std::move(texture);
+        materials.push_back(std::move(material));
+    });
+    return materials;
+}
+
+MeshView MeshCache::mesh(std::size_t index) const {
+    auto record = readRecord(_file, index);
+
+    auto count = [&](Section s) {
+        return static_cast<std::size_t>(record.sections[s].count);
+    };
+
+    return MeshView{
+        sectionData<Vertex>(_file, record, VertexSection),
+        count(VertexSection),
+        sectionData<uint32_t>(_file, record, IndexSection),
+        count(IndexSection),
+        sectionData<MeshLod>(_file, record, LodSection),
+        count(LodSection),
+        sectionData<Meshlet>(_file, record, MeshletSection),
+        count(MeshletSection),
+        sectionData<uint32_t>(_file, record, MeshletVertexSection),
+        count(MeshletVertexSection),
+        sectionData<uint32_t>(_file, record, MeshletTriangleSection),
+        count(MeshletTriangleSection),
+    };
+}
+
+uint32_t MeshCache::material(std::size_t index) const {
+    return readRecord(_file, index).material;
+}
+
+} // namespace scene
@@ -0,0 +1,428 @@
+#include "mesh_optimizer.hpp"
+
+#include <algorithm>
+#include <limits>
+
+#include "mesh_simplify.hpp"
+#include "meshlet_builder.hpp"
+
+namespace scene {
+
+namespace {
+
+// triangles using each vertex, as offsets into a flat list
+struct TriangleAdjacency {
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> triangles;
+
+    TriangleAdjacency(const std::vector<uint32_t>& indices,
+                      std::size_t vertexCount)
+        : offsets(vertexCount + 1, 0), triangles(indices.size()) {
+        for (auto index : indices) {
+            ++offsets[index + 1];
+        }
+        for (std::size_t v = 0; v < vertexCount; ++v) {
+            offsets[v + 1] += offsets[v];
+        }
+
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (std::size_t i = 0; i < indices.size(); ++i) {
+            triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+    }
+};
+
+// cache misses of every triangle, same FIFO as analyzeVertexCache()
+std::vector<uint8_t> triangleMisses(const std::vector<uint32_t>& indices,
+                                    std::size_t vertexCount,
+                                    std::size_t cacheSize) {
+    std::vector<uint8_t> misses(indices.size() / 3, 0);
+    std::vector<std::size_t> entered(vertexCount, 0);
+    std::size_t time = cacheSize + 1;
+    for (std::size_t i = 0; i < misses.size() * 3; ++i) {
+        auto index = indices[i];
+        if (time - entered[index] > cacheSize) {
+            entered[index] = time++;
+            ++misses[i / 3];
+        }
+    }
+    return misses;
+}
+
+struct Cluster {
+    std::size_t begin, end; // triangles
+    float sortKey;
+};
+
+} // namespace
+
+double VertexCacheStats::acmr() const {
+    return triangles ? static_cast<double>(misses) / triangles : 0.0;
+}
+
+double VertexCacheStats::atvr() const {
+    return vertices ? static_cast<double>(misses) / vertices : 0.0;
+}
+
+VertexCacheStats& VertexCacheStats::operator+=(const VertexCacheStats& other) {
+    misses += other.misses;
+    triangles += other.triangles;
+    vertices += other.vertices;
+    return *this;
+}
+
+VertexCacheStats analyzeVertexCache(const uint32_t* indices,
+                                    std::size_t indexCount,
+                                    std::size_t vertexCount,
+                                    std::size_t cacheSize) {
+    VertexCacheStats stats;
+    stats.triangles = indexCount / 3;
+
+    // a vertex is in the FIFO if it entered less than cacheSize misses ago
+    std::vector<std::size_t> entered(vertexCount, 0);
+    std::vector<bool> used(vertexCount, false);
+    std::size_t time = cacheSize + 1;
+    for (std::size_t i = 0; i < indexCount; ++i) {
+        auto index = indices[i];
+        if (time - entered[index] > cacheSize) {
+            entered[index] = time++;
+            ++stats.misses;
+        }
+        if (!used[index]) {
+            used[index] = true;
+            ++stats.vertices;
+        }
+    }
+    return stats;
+}
+
+void optimizeVertexCache(std::vector<uint32_t>& indices,
+                         std::size_t vertexCount, std::size_t cacheSize) {
+    auto triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return;
+    }
+
+    TriangleAdjacency adjacency(indices, vertexCount);
+    std::vector<uint32_t> live(vertexCount);
+    for (std::size_t v = 0; v < vertexCount; ++v) {
+        live[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+    }
+
+    std::vector<std::size_t> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnd;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> output;
+    output.reserve(triangleCount * 3);
+
+    std::size_t time = cacheSize + 1;
+    std::size_t cursor = 0;
+    while (cursor < vertexCount && live[cursor] == 0) {
+        ++cursor;
+    }
+    // vertex to fan around next, -1 once every triangle is emitted
+    int64_t fanning = cursor < vertexCount ? static_cast<int64_t>(cursor) : -1;
+
+    while (fanning >= 0) {
+        candidates.clear();
+        auto begin = adjacency.offsets[fanning];
+        auto end = adjacency.offsets[fanning + 1];
+        for (auto t = begin; t < end; ++t) {
+            auto triangle = adjacency.triangles[t];
+            if (emitted[triangle]) {
+                continue;
+            }
+            emitted[triangle] = true;
+            for (std::size_t k = 0; k < 3; ++k) {
+                auto v = indices[triangle * 3 + k];
+                output.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                --live[v];
+                if (time - cacheTime[v] > cacheSize) {
+                    cacheTime[v] = time++;
+                }
+            }
+        }
+
+        // prefer the candidate that entered the cache the earliest but will
+        // still be in it once all its remaining triangles are emitted, none
+        // of them is a dead end
+        fanning = -1;
+        std::size_t best = 0;
+        for (auto v : candidates) {
+            if (live[v] == 0) {
+                continue;
+            }
+            std::size_t priority = 0;
+            if (time - cacheTime[v] + 2 * live[v] <= cacheSize) {
+                priority = time - cacheTime[v];
+            }
+            if (priority > best) {
+                best = priority;
+                fanning = v;
+            }
+        }
+
+        if (fanning < 0) {
+            // dead end: back to a recently used vertex, or the next live one
+            while (!deadEnd.empty()) {
+                auto v = deadEnd.back();
+                deadEnd.pop_back();
+                if (live[v] > 0) {
+                    fanning = v;
+                    break;
+                }
+            }
+        }
+        if (fanning < 0) {
+            while (cursor < vertexCount && live[cursor] == 0) {
+                ++cursor;
+            }
+            if (cursor < vertexCount) {
+                fanning = static_cast<int64_t>(cursor);
+            }
+        }
+    }
+
+    indices = std::move(output);
+}
+
+void optimizeOverdraw(std::vector<uint32_t>& indices,
+                      const std::vector<Vertex>& vertices, float threshold) {
+    auto triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return;
+    }
+
+    // hard boundaries: triangles whose 3 vertices all miss the cache, where
+    // Tipsify jumped to a new fan
+    auto misses = triangleMisses(indices, vertices.size(), vertexCacheSize);
+    std::vector<std::size_t> starts;
+    for (std::size_t t = 0; t < triangleCount; ++t) {
+        if (t == 0 || misses[t] == 3) {
+            starts.push_back(t);
+        }
+    }
+    starts.push_back(triangleCount);
+
+    // soft boundaries: cut a hard cluster as soon as the ACMR of the part
+    // so far, starting from an empty cache, is close enough to the ACMR of
+    // the whole cluster
+    std::vector<Cluster> clusters;
+    std::vector<std::size_t> entered(vertices.size(), 0);
+    std::size_t time = 0;
+    auto miss = [&](uint32_t index) -> std::size_t {
+        if (time - entered[index] > vertexCacheSize) {
+            entered[index] = time++;
+            return 1;
+        }
+        return 0;
+    };
+    for (std::size_t c = 0; c + 1 < starts.size(); ++c) {
+        auto begin = starts[c], end = starts[c + 1];
+        std::size_t total = 0;
+        for (auto t = begin; t < end; ++t) {
+            total += misses[t];
+        }
+        auto target = threshold * static_cast<float>(total) / (end - begin);
+
+        std::size_t clusterBegin = begin, clusterMisses = 0;
+        time += vertexCacheSize + 1;
+        for (auto t = begin; t < end; ++t) {
+            clusterMisses += miss(indices[t * 3 + 0]) + miss(indices[t * 3 + 1])
+                             + miss(indices[t * 3 + 2]);
+            auto size = t + 1 - clusterBegin;
+            if (t + 1 < end
+                && static_cast<float>(clusterMisses) / size <= target) {
+                clusters.push_back({clusterBegin, t + 1, 0.0f});
+                clusterBegin = t + 1;
+                clusterMisses = 0;
+                time += vertexCacheSize + 1;
+            }
+        }
+        clusters.push_back({clusterBegin, end, 0.0f});
+    }
+
+    // area weighted centroids and normals
+    glm::vec3 meshCenter{0.0f, 0.0f, 0.0f};
+    float meshArea = 0.0f;
+    std::vector<glm::vec3> centers(clusters.size()), normals(clusters.size());
+    for (std::size_t c = 0; c < clusters.size(); ++c) {
+        glm::vec3 center{0.0f, 0.0f, 0.0f}, normal{0.0f, 0.0f, 0.0f};
+        float area = 0.0f;
+        for (auto t = clusters[c].begin; t < clusters[c].end; ++t) {
+            const auto& a = vertices[indices[t * 3 + 0]].pos;
+            const auto& b = vertices[indices[t * 3 + 1]].pos;
+            const auto& d = vertices[indices[t * 3 + 2]].pos;
+            auto cross = glm::cross(b - a, d - a);
+            auto triangleArea = glm::length(cross);
+            center += (a + b + d) * (triangleArea / 3.0f);
+            normal += cross;
+            area += triangleArea;
+        }
+        meshCenter += center;
+        meshArea += area;
+        centers[c] = area > 0.0f ? center / area : center;
+        normals[c] = normal;
+    }
+    if (meshArea > 0.0f) {
+        meshCenter /= meshArea;
+    }
+
+    for (std::size_t c = 0; c < clusters.size(); ++c) {
+        auto normalLength = glm::length(normals[c]);
+        clusters[c].sortKey
+            = normalLength > 0.0f
+                  ? glm::dot(centers[c] - meshCenter, normals[c] / normalLength)
+                  : 0.0f;
+    }
+    std::stable_sort(clusters.begin(), clusters.end(),
+                     [](const Cluster& a, const Cluster& b) {
+                         return a.sortKey > b.sortKey;
+                     });
+
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+    for (const auto& cluster : clusters) {
+        output.insert(output.end(), indices.begin() + cluster.begin * 3,
+                      indices.begin() + cluster.end * 3);
+    }
+    indices = std::move(output);
+}
+
+void generateLods(MeshData& mesh, bool optimizeCache) {
+    constexpr std::size_t maxLods = 8;
+    constexpr std::size_t minLodTriangles = 64;
+
+    mesh.lods.clear();
+    mesh.lods.push_back({0, static_cast<uint32_t>(mesh.indices.size()), 0.0f});
+
+    auto previous = mesh.indices;
+    float error = 0.0f;
+    while (mesh.lods.size() < maxLods
+           && previous.size() / 3 > minLodTriangles) {
+        float lodError;
+        auto lod = simplifyMesh(mesh.vertices, previous.data(), previous.size(),
+                                previous.size() / 2, lodError);
+        if (lod.size() > previous.size() * 3 / 4) {
+            // mostly locked borders and seams left
+            break;
+        }
+        // each level is simplified from the previous one, errors add up
+        error += lodError;
+        if (optimizeCache) {
+            optimizeVertexCache(lod, mesh.vertices.size());
+        }
+
+        mesh.lods.push_back({static_cast<uint32_t>(mesh.indices.size()),
+                             static_cast<uint32_t>(lod.size()), error});
+        mesh.indices.insert(mesh.indices.end(), lod.begin(), lod.end());
+        previous = std::move(lod);
+    }
+}
+
+void optimizeVertexFetch(MeshData& mesh) {
+    constexpr auto unused = std::numeric_limits<uint32_t>::max();
+    std::vector<uint32_t> remap(mesh.vertices.size(), unused);
+    std::vector<Vertex> vertices;
+    vertices.reserve(mesh.vertices.size());
+    for (auto& index : mesh.indices) {
+        if (remap[index] == unused) {
+            remap[index] = static_cast<uint32_t>(vertices.size());
+            vertices.push_back(mesh.vertices[index]);
+        }
+        index = remap[index];
+    }
+    mesh.vertices = std::move(vertices);
+}
+
+std::vector<MeshData> splitMesh(const MeshData& mesh,
+                                std::size_t maxVertices) {
+    std::vector<MeshData> parts;
+    constexpr auto absent = std::numeric_limits<uint32_t>::max();
+    std::vector<uint32_t> remap(mesh.vertices.size(), absent);
+
+    MeshData part;
+    part.material = mesh.material;
+    std::vector<uint32_t> partVertices;
+    auto flush = [&]() {
+        for (auto vertex : partVertices) {
+            remap[vertex] = absent;
+        }
+        partVertices.clear();
+        parts.push_back(std::move(part));
+        part = MeshData();
+        part.material = mesh.material;
+    };
+
+    for (std::size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+        const auto* triangle = &mesh.indices[i];
+        std::size_t newVertices = 0;
+        for (std::size_t k = 0; k < 3; ++k) {
+            newVertices += remap[triangle[k]] == absent;
+        }
+        if (part.vertices.size() + newVertices > maxVertices) {
+            flush();
+        }
+
+        for (std::size_t k = 0; k < 3; ++k) {
+            auto& slot = remap[triangle[k]];
+            if (slot == absent) {
+                slot = static_cast<uint32_t>(part.vertices.size());
+                part.vertices.push_back(mesh.vertices[triangle[k]]);
+                partVertices.push_back(triangle[k]);
+            }
+            part.indices.push_back(slot);
+        }
+    }
+    if (!part.indices.empty()) {
+        flush();
+    }
+    return parts;
+}
+
+void optimizeMeshes(std::vector<MeshData>& meshes, uint32_t optimizations,
+                    ThreadPool& pool) {
+    if (optimizations & SplitForShortIndices) {
+        std::vector<std::vector<MeshData>> parts(meshes.size());
+        pool.parallelFor(meshes.size(), [&](std::size_t i) {
+            if (meshes[i].vertices.size() > vulkan::maxShortIndexVertices) {
+                parts[i] = splitMesh(meshes[i], vulkan::maxShortIndexVertices);
+            }
+        });
+
+        std::vector<MeshData> split;
+        for (std::size_t i = 0; i < meshes.size(); ++i) {
+            if (parts[i].empty()) {
+                split.push_back(std::move(meshes[i]));
+            }
+            for (auto& part : parts[i]) {
+                split.push_back(std::move(part));
+            }
+        }
+        meshes = std::move(split);
+    }
+
+    pool.parallelFor(meshes.size(), [&](std::size_t i) {
+        auto& mesh = meshes[i];
+        if (optimizations & OptimizeVertexCache) {
+            optimizeVertexCache(mesh.indices, mesh.vertices.size());
+        }
+        if (optimizations & OptimizeOverdraw) {
+            optimizeOverdraw(mesh.indices, mesh.vertices);
+        }
+        if (optimizations & GenerateLods) {
+            generateLods(mesh, optimizations & OptimizeVertexCache);
+        }
+        if (optimizations & OptimizeVertexFetch) {
+            optimizeVertexFetch(mesh);
+        }
+        if (optimizations & BuildMeshlets) {
+            buildMeshlets(mesh);
+        }
+    });
+}
+
+} // namespace scene
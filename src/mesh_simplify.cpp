@@ -0,0 +1,280 @@
+#include "mesh_simplify.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace scene {
+
+namespace {
+
+// symmetric 4x4 matrix of the squared distance to a set of planes, weighted
+// by the area of the triangles they come from
+struct Quadric {
+    double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+    double b0 = 0, b1 = 0, b2 = 0, c = 0;
+    double weight = 0;
+
+    void addPlane(const glm::vec3& normal, double d, double area) {
+        double x = normal.x, y = normal.y, z = normal.z;
+        a00 += area * x * x;
+        a01 += area * x * y;
+        a02 += area * x * z;
+        a11 += area * y * y;
+        a12 += area * y * z;
+        a22 += area * z * z;
+        b0 += area * x * d;
+        b1 += area * y * d;
+        b2 += area * z * d;
+        c += area * d * d;
+        weight += area;
+    }
+
+    Quadric& operator+=(const Quadric& q) {
+        a00 += q.a00;
+        a01 += q.a01;
+        a02 += q.a02;
+        a11 += q.a11;
+        a12 += q.a12;
+        a22 += q.a22;
+        b0 += q.b0;
+        b1 += q.b1;
+        b2 += q.b2;
+        c += q.c;
+        weight += q.weight;
+        return *this;
+    }
+
+    // mean squared distance of p to the planes
+    double error(const glm::vec3& p) const {
+        double x = p.x, y = p.y, z = p.z;
+        double e = a00 * x * x + a11 * y * y + a22 * z * z
+                   + 2 * (a01 * x * y + a02 * x * z + a12 * y * z)
+                   + 2 * (b0 * x + b1 * y + b2 * z) + c;
+        return weight > 0 ? std::max(e / weight, 0.0) : 0.0;
+    }
+};
+
+struct Collapse {
+    uint32_t from, to;
+    double cost;
+};
+
+bool samePosition(const Vertex& a, const Vertex& b) {
+    return a.pos.x == b.pos.x && a.pos.y == b.pos.y && a.pos.z == b.pos.z;
+}
+
+// maps every vertex to the first vertex sharing its position
+std::vector<uint32_t> positionGroups(const std::vector<Vertex>& vertices) {
+    std::vector<uint32_t> order(vertices.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        const auto& pa = vertices[a].pos;
+        const auto& pb = vertices[b].pos;
+        if (pa.x != pb.x) {
+            return pa.x < pb.x;
+        }
+        if (pa.y != pb.y) {
+            return pa.y < pb.y;
+        }
+        if (pa.z != pb.z) {
+            return pa.z < pb.z;
+        }
+        return a < b;
+    });
+
+    std::vector<uint32_t> group(vertices.size());
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        group[order[i]]
+            = i > 0 && samePosition(vertices[order[i]], vertices[order[i - 1]])
+                  ? group[order[i - 1]]
+                  : order[i];
+    }
+    return group;
+}
+
+} // namespace
+
+std::vector<uint32_t> simplifyMesh(const std::vector<Vertex>& vertices,
+                                   const uint32_t* indices,
+                                   std::size_t indexCount,
+                                   std::size_t targetIndexCount, float& error) {
+    std::vector<uint32_t> result(indices, indices + indexCount);
+    error = 0.0f;
+
+    auto vertexCount = vertices.size();
+    auto group = positionGroups(vertices);
+
+    // seams: several vertices at one position
+    std::vector<uint32_t> groupSize(vertexCount, 0);
+    for (std::size_t v = 0; v < vertexCount; ++v) {
+        ++groupSize[group[v]];
+    }
+    std::vector<bool> locked(vertexCount, false);
+    for (std::size_t v = 0; v < vertexCount; ++v) {
+        locked[v] = groupSize[group[v]] > 1;
+    }
+
+    // borders: position edges used by a single triangle
+    std::vector<uint64_t> edges;
+    edges.reserve(indexCount);
+    for (std::size_t i = 0; i < indexCount; i += 3) {
+        for (std::size_t k = 0; k < 3; ++k) {
+            uint64_t a = group[indices[i + k]];
+            uint64_t b = group[indices[i + (k + 1) % 3]];
+            edges.push_back(std::min(a, b) << 32 | std::max(a, b));
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    for (std::size_t i = 0; i < edges.size();) {
+        auto j = i;
+        while (j < edges.size() && edges[j] == edges[i]) {
+            ++j;
+        }
+        if (j - i == 1) {
+            locked[edges[i] >> 32] = true;
+            locked[edges[i] & 0xffffffffu] = true;
+        }
+        i = j;
+    }
+    for (std::size_t v = 0; v < vertexCount; ++v) {
+        if (locked[group[v]]) {
+            locked[v] = true;
+        }
+    }
+
+    // one quadric per position
+    std::vector<Quadric> quadrics(vertexCount);
+    for (std::size_t i = 0; i < indexCount; i += 3) {
+        const auto& p0 = vertices[indices[i + 0]].pos;
+        const auto& p1 = vertices[indices[i + 1]].pos;
+        const auto& p2 = vertices[indices[i + 2]].pos;
+        auto normal = glm::cross(p1 - p0, p2 - p0);
+        auto length = glm::length(normal);
+        if (length == 0.0f) {
+            continue;
+        }
+        normal /= length;
+        double d = -glm::dot(normal, p0);
+        for (std::size_t k = 0; k < 3; ++k) {
+            quadrics[group[indices[i + k]]].addPlane(normal, d, length * 0.5);
+        }
+    }
+
+    std::vector<uint32_t> remap(vertexCount);
+    std::vector<bool> touched(vertexCount);
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+    std::vector<uint32_t> adjacency;
+    std::vector<Collapse> collapses;
+    double maxCost = 0.0;
+
+    // each pass collapses a set of independent edges, cheapest first
+    while (result.size() > targetIndexCount) {
+        std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+        for (auto index : result) {
+            ++adjacencyOffsets[index + 1];
+        }
+        std::partial_sum(adjacencyOffsets.begin(), adjacencyOffsets.end(),
+                         adjacencyOffsets.begin());
+        adjacency.resize(result.size());
+        std::vector<uint32_t> fill(adjacencyOffsets.begin(),
+                                   adjacencyOffsets.end() - 1);
+        for (std::size_t i = 0; i < result.size(); ++i) {
+            adjacency[fill[result[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+
+        collapses.clear();
+        for (std::size_t i = 0; i < result.size(); i += 3) {
+            for (std::size_t k = 0; k < 3; ++k) {
+                auto from = result[i + k];
+                auto to = result[i + (k + 1) % 3];
+                if (locked[from] || from == to) {
+                    continue;
+                }
+                auto q = quadrics[group[from]];
+                q += quadrics[group[to]];
+                collapses.push_back({from, to, q.error(vertices[to].pos)});
+            }
+        }
+        if (collapses.empty()) {
+            break;
+        }
+        std::sort(collapses.begin(), collapses.end(),
+                  [](const Collapse& a, const Collapse& b) {
+                      return a.cost < b.cost;
+                  });
+
+        std::iota(remap.begin(), remap.end(), 0);
+        std::fill(touched.begin(), touched.end(), false);
+        auto trianglesToRemove = (result.size() - targetIndexCount) / 3;
+        std::size_t removed = 0;
+        for (const auto& collapse : collapses) {
+            if (removed >= trianglesToRemove) {
+                break;
+            }
+            if (touched[collapse.from] || touched[collapse.to]) {
+                continue;
+            }
+
+            // reject collapses that flip a triangle around from
+            bool flips = false;
+            std::size_t shared = 0;
+            const auto& target = vertices[collapse.to].pos;
+            for (auto t = adjacencyOffsets[collapse.from];
+                 t < adjacencyOffsets[collapse.from + 1] && !flips; ++t) {
+                const auto* tri = &result[adjacency[t] * 3];
+                if (tri[0] == collapse.to || tri[1] == collapse.to
+                    || tri[2] == collapse.to) {
+                    ++shared;
+                    continue;
+                }
+                std::size_t k = tri[0] == collapse.from   ? 0
+                                : tri[1] == collapse.from ? 1
+                                                          : 2;
+                const auto& p1 = vertices[tri[(k + 1) % 3]].pos;
+                const auto& p2 = vertices[tri[(k + 2) % 3]].pos;
+                const auto& p0 = vertices[collapse.from].pos;
+                auto before = glm::cross(p1 - p0, p2 - p0);
+                auto after = glm::cross(p1 - target, p2 - target);
+                flips = glm::dot(before, after) <= 0.0f;
+            }
+            if (flips) {
+                continue;
+            }
+
+            remap[collapse.from] = collapse.to;
+            quadrics[group[collapse.to]] += quadrics[group[collapse.from]];
+            // the flip test above assumed the neighbours stay in place
+            for (auto t = adjacencyOffsets[collapse.from];
+                 t < adjacencyOffsets[collapse.from + 1]; ++t) {
+                for (std::size_t k = 0; k < 3; ++k) {
+                    touched[result[adjacency[t] * 3 + k]] = true;
+                }
+            }
+            maxCost = std::max(maxCost, collapse.cost);
+            removed += shared;
+        }
+        if (removed == 0) {
+            break;
+        }
+
+        std::size_t write = 0;
+        for (std::size_t i = 0; i < result.size(); i += 3) {
+            auto a = remap[result[i + 0]];
+            auto b = remap[result[i + 1]];
+            auto c = remap[result[i + 2]];
+            if (a == b || b == c || a == c) {
+                continue;
+            }
+            result[write++] = a;
+            result[write++] = b;
+            result[write++] = c;
+        }
+        result.resize(write);
+    }
+
+    error = static_cast<float>(std::sqrt(maxCost));
+    return result;
+}
+
+} // namespace scene
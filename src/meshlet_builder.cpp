@@ -0,0 +1,127 @@
+#include "meshlet_builder.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace scene {
+
+namespace {
+
+void computeBounds(const MeshData& mesh, Meshlet& meshlet) {
+    const auto* vertices = &mesh.meshletVertices[meshlet.vertexOffset];
+    const auto* triangles = &mesh.meshletTriangles[meshlet.triangleOffset];
+
+    glm::vec3 minPos = mesh.vertices[vertices[0]].pos;
+    glm::vec3 maxPos = minPos;
+    for (uint32_t v = 1; v < meshlet.vertexCount; ++v) {
+        minPos = glm::min(minPos, mesh.vertices[vertices[v]].pos);
+        maxPos = glm::max(maxPos, mesh.vertices[vertices[v]].pos);
+    }
+    meshlet.center = (minPos + maxPos) * 0.5f;
+    meshlet.radius = 0.0f;
+    for (uint32_t v = 0; v < meshlet.vertexCount; ++v) {
+        auto distance
+            = glm::distance(meshlet.center, mesh.vertices[vertices[v]].pos);
+        meshlet.radius = std::max(meshlet.radius, distance);
+    }
+
+    // the cone axis is the average normal, its cutoff the sine of the
+    // largest angle between the axis and a triangle normal
+    std::vector<glm::vec3> normals;
+    glm::vec3 axis{0.0f, 0.0f, 0.0f};
+    for (uint32_t t = 0; t < meshlet.triangleCount; ++t) {
+        auto packed = triangles[t];
+        const auto& p0 = mesh.vertices[vertices[packed & 0xff]].pos;
+        const auto& p1 = mesh.vertices[vertices[(packed >> 8) & 0xff]].pos;
+        const auto& p2 = mesh.vertices[vertices[(packed >> 16) & 0xff]].pos;
+        auto normal = glm::cross(p1 - p0, p2 - p0);
+        auto length = glm::length(normal);
+        if (length > 0.0f) {
+            normals.push_back(normal / length);
+            axis += normal / length;
+        }
+    }
+
+    meshlet.coneAxis = glm::vec3{0.0f, 0.0f, 0.0f};
+    // never culled: dot(d, axis) is at most |d|
+    meshlet.coneCutoff = 1.0f;
+    auto axisLength = glm::length(axis);
+    if (normals.empty() || axisLength == 0.0f) {
+        return;
+    }
+    axis /= axisLength;
+
+    float minDot = 1.0f;
+    for (const auto& normal : normals) {
+        minDot = std::min(minDot, glm::dot(axis, normal));
+    }
+    if (minDot <= 0.1f) {
+        // normals spread over more than a half space, no useful cone
+        return;
+    }
+    meshlet.coneAxis = axis;
+    meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+}
+
+} // namespace
+
+void buildMeshlets(MeshData& mesh) {
+    mesh.meshlets.clear();
+    mesh.meshletVertices.clear();
+    mesh.meshletTriangles.clear();
+
+    auto indexCount
+        = mesh.lods.empty() ? mesh.indices.size() : mesh.lods[0].indexCount;
+    if (indexCount == 0) {
+        return;
+    }
+
+    // local index of every vertex in the current meshlet
+    constexpr auto absent = std::numeric_limits<uint8_t>::max();
+    std::vector<uint8_t> local(mesh.vertices.size(), absent);
+
+    Meshlet current = {};
+    auto flush = [&]() {
+        for (uint32_t v = 0; v < current.vertexCount; ++v) {
+            local[mesh.meshletVertices[current.vertexOffset + v]] = absent;
+        }
+        computeBounds(mesh, current);
+        mesh.meshlets.push_back(current);
+
+        current = {};
+        current.vertexOffset
+            = static_cast<uint32_t>(mesh.meshletVertices.size());
+        current.triangleOffset
+            = static_cast<uint32_t>(mesh.meshletTriangles.size());
+    };
+
+    for (std::size_t i = 0; i < indexCount; i += 3) {
+        const auto* triangle = &mesh.indices[i];
+        uint32_t newVertices = 0;
+        for (std::size_t k = 0; k < 3; ++k) {
+            newVertices += local[triangle[k]] == absent;
+        }
+        if (current.vertexCount + newVertices > vulkan::maxMeshletVertices
+            || current.triangleCount + 1 > vulkan::maxMeshletTriangles) {
+            flush();
+        }
+
+        uint32_t packed = 0;
+        for (std::size_t k = 0; k < 3; ++k) {
+            auto& slot = local[triangle[k]];
+            if (slot == absent) {
+                slot = static_cast<uint8_t>(current.vertexCount++);
+                mesh.meshletVertices.push_back(triangle[k]);
+            }
+            packed |= static_cast<uint32_t>(slot) << (8 * k);
+        }
+        mesh.meshletTriangles.push_back(packed);
+        ++current.triangleCount;
+    }
+    if (current.triangleCount > 0) {
+        flush();
+    }
+}
+
+} // namespace scene
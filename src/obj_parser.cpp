@@ -0,0 +1,535 @@
+#include "obj_parser.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <iterator>
+#include <iostream>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "mapped_file.hpp"
+#include "mesh_builder.hpp"
+#include "vertex_dedup.hpp"
+
+namespace scene {
+
+namespace {
+
+// chunks smaller than this are not worth a task
+constexpr std::size_t minChunkBytes = 1 << 20;
+
+struct Corner {
+    uint32_t position;
+    int32_t texCoord; // -1 when the face has no texture coordinates
+};
+
+struct Segment {
+    bool newShape;    // starts with an o/g statement
+    bool newMaterial; // starts with a usemtl statement naming material
+    std::string material;
+    std::vector<Corner> corners;
+};
+
+struct Chunk {
+    const char* begin;
+    const char* end;
+    std::size_t positionCount = 0, texCoordCount = 0;
+    std::size_t positionBase = 0, texCoordBase = 0;
+    std::vector<Segment> segments;
+    // file names of the mtllib statements
+    std::vector<std::string> materialLibraries;
+};
+
+struct WorkItem {
+    const std::vector<Corner>* corners;
+    std::size_t begin, end;
+};
+
+enum class Statement {
+    Position,
+    TexCoord,
+    Face,
+    Group,
+    UseMaterial,
+    MaterialLibrary,
+    Other
+};
+
+bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+const char* skipSpaces(const char* p, const char* end) {
+    while (p < end && isSpace(*p)) {
+        ++p;
+    }
+    return p;
+}
+
+// calls f(first non blank char, line end) for every non empty line
+template <class F> void forEachLine(const char* begin, const char* end, F&& f) {
+    while (begin < end) {
+        auto lineEnd = static_cast<const char*>(
+            std::memchr(begin, '\n', static_cast<std::size_t>(end - begin)));
+        if (!lineEnd) {
+            lineEnd = end;
+        }
+        auto p = skipSpaces(begin, lineEnd);
+        if (p < lineEnd) {
+            f(p, lineEnd);
+        }
+        begin = lineEnd + 1;
+    }
+}
+
+// identifies the statement and moves p past its keyword
+Statement readStatement(const char*& p, const char* end) {
+    auto keywordEnds = [&](std::size_t length) {
+        return p + length == end || (p + length < end && isSpace(p[length]));
+    };
+
+    if (*p == 'v') {
+        if (keywordEnds(1)) {
+            p += 1;
+            return Statement::Position;
+        }
+        if (p + 1 < end && p[1] == 't' && keywordEnds(2)) {
+            p += 2;
+            return Statement::TexCoord;
+        }
+    } else if (*p == 'f' && keywordEnds(1)) {
+        p += 1;
+        return Statement::Face;
+    } else if ((*p == 'o' || *p == 'g') && keywordEnds(1)) {
+        p += 1;
+        return Statement::Group;
+    } else if (end - p >= 6 && keywordEnds(6)) {
+        if (std::memcmp(p, "usemtl", 6) == 0) {
+            p += 6;
+            return Statement::UseMaterial;
+        }
+        if (std::memcmp(p, "mtllib", 6) == 0) {
+            p += 6;
+            return Statement::MaterialLibrary;
+        }
+    }
+    return Statement::Other;
+}
+
+// next space separated word, empty at the end of the line
+std::string readWord(const char*& p, const char* end) {
+    p = skipSpaces(p, end);
+    auto begin = p;
+    while (p < end && !isSpace(*p)) {
+        ++p;
+    }
+    return std::string(begin, p);
+}
+
+double powerOfTen(int exponent) {
+    static const double table[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                   1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                   1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                   1e18, 1e19, 1e20, 1e21, 1e22};
+    if (exponent >= 0 && exponent <= 22) {
+        return table[exponent];
+    }
+    return std::pow(10.0, exponent);
+}
+
+// locale independent and bounded by end: the mapped file is not null
+// terminated, so strtof can't be used
+bool parseFloat(const char*& p, const char* end, float& value) {
+    p = skipSpaces(p, end);
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+
+    double mantissa = 0.0;
+    int exponent = 0;
+    bool digits = false;
+    for (; p < end && isDigit(*p); ++p) {
+        mantissa = mantissa * 10.0 + (*p - '0');
+        digits = true;
+    }
+    if (p < end && *p == '.') {
+        for (++p; p < end && isDigit(*p); ++p) {
+            mantissa = mantissa * 10.0 + (*p - '0');
+            --exponent;
+            digits = true;
+        }
+    }
+    if (!digits) {
+        return false;
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        bool negativeExponent = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negativeExponent = *p == '-';
+            ++p;
+        }
+        int e = 0;
+        for (; p < end && isDigit(*p); ++p) {
+            e = std::min(e * 10 + (*p - '0'), 1000);
+        }
+        exponent += negativeExponent ? -e : e;
+    }
+
+    double result = exponent < 0 ? mantissa / powerOfTen(-exponent)
+                                 : mantissa * powerOfTen(exponent);
+    value = static_cast<float>(negative ? -result : result);
+    return true;
+}
+
+bool parseInt(const char*& p, const char* end, long& value) {
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+    if (p >= end || !isDigit(*p)) {
+        return false;
+    }
+    value = 0;
+    for (; p < end && isDigit(*p); ++p) {
+        value = value * 10 + (*p - '0');
+    }
+    if (negative) {
+        value = -value;
+    }
+    return true;
+}
+
+// OBJ indices are 1-based, negative ones are relative to the current count
+long resolveIndex(long index, std::size_t count) {
+    if (index > 0) {
+        return index - 1;
+    }
+    if (index < 0 && static_cast<std::size_t>(-index) <= count) {
+        return static_cast<long>(count) + index;
+    }
+    throw std::runtime_error("invalid index in OBJ face");
+}
+
+void parseFace(const char* p, const char* end, std::size_t positionCount,
+               std::size_t texCoordCount, std::vector<Corner>& out) {
+    Corner first{}, previous{};
+    int count = 0;
+
+    while ((p = skipSpaces(p, end)) < end) {
+        long position, texCoord = 0, normal;
+        if (!parseInt(p, end, position)) {
+            throw std::runtime_error("invalid OBJ face");
+        }
+        if (p < end && *p == '/') {
+            ++p;
+            if (p < end && *p != '/' && !parseInt(p, end, texCoord)) {
+                throw std::runtime_error("invalid OBJ face");
+            }
+            if (p < end && *p == '/') {
+                ++p;
+                parseInt(p, end, normal);
+            }
+        }
+
+        Corner corner;
+        corner.position
+            = static_cast<uint32_t>(resolveIndex(position, positionCount));
+        corner.texCoord
+            = texCoord == 0
+                  ? -1
+                  : static_cast<int32_t>(resolveIndex(texCoord, texCoordCount));
+
+        // polygons are triangulated as a fan, like tinyobj does
+        if (count == 0) {
+            first = corner;
+        } else if (count >= 2) {
+            out.push_back(first);
+            out.push_back(previous);
+            out.push_back(corner);
+        }
+        previous = corner;
+        ++count;
+    }
+}
+
+std::vector<Chunk> splitChunks(const char* data, std::size_t size,
+                               std::size_t maxChunks) {
+    auto chunkCount = std::max<std::size_t>(
+        1, std::min(maxChunks, size / minChunkBytes));
+    auto end = data + size;
+
+    std::vector<Chunk> chunks;
+    const char* begin = data;
+    for (std::size_t i = 1; i <= chunkCount && begin < end; ++i) {
+        auto chunkEnd = i == chunkCount ? end : data + size / chunkCount * i;
+        if (chunkEnd < begin) {
+            chunkEnd = begin;
+        }
+        // extend to the end of the current line
+        auto newline = static_cast<const char*>(std::memchr(
+            chunkEnd, '\n', static_cast<std::size_t>(end - chunkEnd)));
+        chunkEnd = newline ? newline + 1 : end;
+
+        Chunk chunk;
+        chunk.begin = begin;
+        chunk.end = chunkEnd;
+        chunks.push_back(std::move(chunk));
+        begin = chunkEnd;
+    }
+    return chunks;
+}
+
+void countAttributes(Chunk& chunk) {
+    forEachLine(chunk.begin, chunk.end, [&](const char* p, const char* end) {
+        switch (readStatement(p, end)) {
+        case Statement::Position:
+            ++chunk.positionCount;
+            break;
+        case Statement::TexCoord:
+            ++chunk.texCoordCount;
+            break;
+        default:
+            break;
+        }
+    });
+}
+
+void parseChunk(Chunk& chunk, std::vector<glm::vec3>& positions,
+                std::vector<glm::vec2>& texCoords) {
+    auto positionCount = chunk.positionBase;
+    auto texCoordCount = chunk.texCoordBase;
+    chunk.segments.push_back(Segment{false, false, {}, {}});
+
+    forEachLine(chunk.begin, chunk.end, [&](const char* p, const char* end) {
+        switch (readStatement(p, end)) {
+        case Statement::Position: {
+            float x = 0.0f, y = 0.0f, z = 0.0f;
+            if (!parseFloat(p, end, x) || !parseFloat(p, end, y)
+                || !parseFloat(p, end, z)) {
+                throw std::runtime_error("invalid OBJ vertex");
+            }
+            // fix for coordinates
+            positions[positionCount++] = glm::vec3{y, z, x};
+            break;
+        }
+        case Statement::TexCoord: {
+            float u = 0.0f, v = 0.0f;
+            if (!parseFloat(p, end, u)) {
+                throw std::runtime_error("invalid OBJ texture coordinate");
+            }
+            parseFloat(p, end, v);
+            // fix for uv coord
+            texCoords[texCoordCount++] = glm::vec2{u, 1.0f - v};
+            break;
+        }
+        case Statement::Face:
+            parseFace(p, end, positionCount, texCoordCount,
+                      chunk.segments.back().corners);
+            break;
+        case Statement::Group:
+            chunk.segments.push_back(Segment{true, false, {}, {}});
+            break;
+        case Statement::UseMaterial:
+            chunk.segments.push_back(
+                Segment{false, true, readWord(p, end), {}});
+            break;
+        case Statement::MaterialLibrary:
+            for (auto name = readWord(p, end); !name.empty();
+                 name = readWord(p, end)) {
+                chunk.materialLibraries.push_back(std::move(name));
+            }
+            break;
+        case Statement::Other:
+            break;
+        }
+    });
+}
+
+void deduplicateCorners(const WorkItem& item,
+                        const std::vector<glm::vec3>& positions,
+                        const std::vector<glm::vec2>& texCoords,
+                        MeshData& out) {
+    VertexDeduplicator uniqueVertices(out.vertices, item.end - item.begin);
+    out.indices.reserve(item.end - item.begin);
+
+    const glm::vec3 color{1.0, 1.0, 1.0};
+    for (auto i = item.begin; i < item.end; ++i) {
+        const auto& corner = (*item.corners)[i];
+        if (corner.position >= positions.size()
+            || (corner.texCoord >= 0
+                && static_cast<std::size_t>(corner.texCoord)
+                       >= texCoords.size())) {
+            throw std::runtime_error("OBJ face index out of range");
+        }
+
+        glm::vec2 texCoord{0.0f, 0.0f};
+        if (corner.texCoord >= 0) {
+            texCoord = texCoords[corner.texCoord];
+        }
+        out.indices.push_back(uniqueVertices.insert(
+            Vertex{positions[corner.position], color, texCoord}));
+    }
+}
+
+// default material then those of the libraries, by name
+std::unordered_map<std::string, uint32_t>
+loadMaterials(const std::string& objPath, const std::vector<Chunk>& chunks,
+              std::vector<MaterialData>& materials,
+              std::vector<std::string>* libraries) {
+    materials.assign(1, MaterialData{});
+    std::unordered_map<std::string, uint32_t> indices;
+
+    auto directory = std::filesystem::path(objPath).parent_path();
+    for (const auto& chunk : chunks) {
+        for (const auto& library : chunk.materialLibraries) {
+            auto path = (directory / library).generic_string();
+            if (libraries) {
+                libraries->push_back(path);
+            }
+            // like tinyobj, a missing library only loses its materials
+            std::vector<MaterialData> libraryMaterials;
+            try {
+                libraryMaterials = parseMtl(path);
+            } catch (std::exception& e) {
+                std::cerr << "obj: " << e.what() << std::endl;
+            }
+            for (auto& material : libraryMaterials) {
+                auto index = static_cast<uint32_t>(materials.size());
+                if (indices.emplace(material.name, index).second) {
+                    materials.push_back(std::move(material));
+                }
+            }
+        }
+    }
+    return indices;
+}
+
+} // namespace
+
+std::vector<MeshData> parseObj(const std::string& objPath, ThreadPool& pool,
+                               std::vector<MaterialData>& materials,
+                               std::vector<std::string>* libraries) {
+    std::vector<MeshData> meshes;
+    parseObj(objPath, pool, materials, libraries,
+             [&](std::vector<MeshData>& wave) {
+                 std::move(wave.begin(), wave.end(),
+                           std::back_inserter(meshes));
+                 return true;
+             });
+    return meshes;
+}
+
+bool parseObj(const std::string& objPath, ThreadPool& pool,
+              std::vector<MaterialData>& materials,
+              std::vector<std::string>* libraries,
+              const std::function<bool(std::vector<MeshData>&)>& onMeshes) {
+    MappedFile file(objPath);
+    auto chunks = splitChunks(file.data(), file.size(), pool.size() * 4);
+
+    pool.parallelFor(chunks.size(),
+                     [&](std::size_t i) { countAttributes(chunks[i]); });
+
+    std::size_t positionCount = 0, texCoordCount = 0;
+    for (auto& chunk : chunks) {
+        chunk.positionBase = positionCount;
+        chunk.texCoordBase = texCoordCount;
+        positionCount += chunk.positionCount;
+        texCoordCount += chunk.texCoordCount;
+    }
+
+    std::vector<glm::vec3> positions(positionCount);
+    std::vector<glm::vec2> texCoords(texCoordCount);
+    pool.parallelFor(chunks.size(), [&](std::size_t i) {
+        parseChunk(chunks[i], positions, texCoords);
+    });
+
+    auto materialIndices
+        = loadMaterials(objPath, chunks, materials, libraries);
+
+    // stitch the chunk segments back into shapes, split large shapes in
+    // several dedup work items. The material carries over to the next
+    // groups, like in tinyobj.
+    std::vector<WorkItem> items;
+    std::vector<std::size_t> firstItem;
+    std::vector<uint32_t> shapeMaterials;
+    uint32_t material = 0;
+    bool shapeHasFaces = false;
+    for (const auto& chunk : chunks) {
+        for (const auto& segment : chunk.segments) {
+            uint32_t segmentMaterial = material;
+            if (segment.newMaterial) {
+                auto found = materialIndices.find(segment.material);
+                segmentMaterial
+                    = found != materialIndices.end() ? found->second : 0;
+            }
+            if ((segment.newShape || segmentMaterial != material)
+                && shapeHasFaces) {
+                firstItem.push_back(items.size());
+                shapeMaterials.push_back(material);
+                shapeHasFaces = false;
+            }
+            material = segmentMaterial;
+            for (std::size_t begin = 0; begin < segment.corners.size();
+                 begin += dedupChunkSize) {
+                auto end
+                    = std::min(segment.corners.size(), begin + dedupChunkSize);
+                items.push_back(WorkItem{&segment.corners, begin, end});
+                shapeHasFaces = true;
+            }
+        }
+    }
+    if (shapeHasFaces) {
+        firstItem.push_back(items.size());
+        shapeMaterials.push_back(material);
+    }
+    // firstItem holds the end of every shape, make it hold the begin
+    firstItem.insert(firstItem.begin(), 0);
+
+    // enough corners for every thread to fill a dedup chunk, a wave has at
+    // least one shape
+    auto waveCorners = pool.size() * dedupChunkSize;
+    auto shapeCount = firstItem.size() - 1;
+    for (std::size_t first = 0; first < shapeCount;) {
+        auto last = first;
+        std::size_t corners = 0;
+        while (last < shapeCount && corners < waveCorners) {
+            for (auto i = firstItem[last]; i < firstItem[last + 1]; ++i) {
+                corners += items[i].end - items[i].begin;
+            }
+            ++last;
+        }
+
+        auto firstPart = firstItem[first];
+        std::vector<MeshData> parts(firstItem[last] - firstPart);
+        pool.parallelFor(parts.size(), [&](std::size_t i) {
+            deduplicateCorners(items[firstPart + i], positions, texCoords,
+                               parts[i]);
+        });
+
+        std::vector<MeshData> meshes(last - first);
+        pool.parallelFor(meshes.size(), [&](std::size_t s) {
+            auto shape = first + s;
+            meshes[s] = mergeMeshChunks(parts, firstItem[shape] - firstPart,
+                                        firstItem[shape + 1] - firstPart);
+            meshes[s].material = shapeMaterials[shape];
+        });
+        if (!onMeshes(meshes)) {
+            return false;
+        }
+        first = last;
+    }
+    return true;
+}
+
+} // namespace scene
@@ -1,59 +1,288 @@
 #include "scene.hpp"
-#include "tiny_obj_loader.h"
+#include "mesh_cache.hpp"
+#include "mesh_optimizer.hpp"
+#include "obj_parser.hpp"
+#include "thread_pool.hpp"
+#include "vulkan/upload_batch.hpp"
 #include "vulkan/utils.hpp"
 
-#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <utility>
 
 namespace scene {
 
-Scene::Scene(vulkan::BufferManager& bufferManager, const std::string& objPath) {
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-    std::string warn, err;
-    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err,
-                          objPath.c_str())) {
-        throw std::runtime_error(warn + err);
+namespace {
+
+// uploaded bytes after which a batch of mesh uploads is submitted, also
+// counting those written directly to device memory
+constexpr vk::DeviceSize uploadBatchSize = 16 * 1024 * 1024;
+
+// Calls onMaterials(materials) once, then onMesh(view, material) for every
+// mesh of the OBJ file, reading the mesh cache when possible. On a cache
+// miss the meshes come as the parser builds them, not once the whole file
+// is processed. Stops early if onMesh returns false.
+template <class M, class F>
+void loadMeshes(const std::string& objPath, const LoadOptions& options,
+                M&& onMaterials, F&& onMesh) {
+    using clock = std::chrono::high_resolution_clock;
+    auto start = clock::now();
+
+    std::optional<MeshCache> cache;
+    if (options.useCache) {
+        cache = MeshCache::open(objPath, options.optimizations);
     }
+    // the default texture isn't cached, it's an option
+    auto publishMaterials = [&](std::vector<MaterialData> materials) {
+        if (materials[0].diffuseTexture.empty()) {
+            materials[0].diffuseTexture = options.defaultTexture;
+        }
+        onMaterials(std::move(materials));
+    };
+
+    if (cache) {
+        // warm start: upload straight from the mapped cache file
+        publishMaterials(cache->materials());
+        auto count = cache->meshCount();
+        for (std::size_t i = 0; i < count; ++i) {
+            if (!onMesh(cache->mesh(i), cache->material(i))) {
+                return;
+            }
+        }
+        std::cout << "scene: " << count << " meshes loaded from cache in "
+                  << std::chrono::duration<double, std::milli>(clock::now()
+                                                               - start)
+                         .count()
+                  << " ms\n";
+        return;
+    }
+
+    // cold start: the meshes are uploaded wave by wave as the parser
+    // builds them, and kept for the cache written once they are all done
+    ThreadPool pool(options.threadCount);
+    std::vector<MaterialData> materials;
+    std::vector<std::string> libraries;
+    std::vector<MeshData> meshData;
+    bool published = false;
+    std::size_t shapeCount = 0, meshCount = 0, vertexCount = 0;
+    std::size_t lodCount = 0, meshletCount = 0;
+    VertexCacheStats before, after;
+    double optimizeTime = 0.0;
+    bool completed = parseObj(
+        objPath, pool, materials, &libraries,
+        [&](std::vector<MeshData>& meshes) {
+            if (!published) {
+                publishMaterials(materials);
+                published = true;
+            }
+            shapeCount += meshes.size();
+            for (const auto& mesh : meshes) {
+                vertexCount += mesh.vertices.size();
+            }
 
-    for (const auto& shape : shapes) {
-        std::unordered_map<Vertex, uint32_t> uniqueVertices;
-        std::vector<Vertex> vertices;
-        std::vector<uint32_t> indices;
-
-        for (const auto& index : shape.mesh.indices) {
-            // fix for coordinates
-            glm::vec3 pos{
-                attrib.vertices[3 * index.vertex_index + 1],
-                attrib.vertices[3 * index.vertex_index + 2],
-                attrib.vertices[3 * index.vertex_index + 0],
-            };
-
-            // fix for uv coord
-            glm::vec2 texCoord{
-                attrib.texcoords[2 * index.texcoord_index + 0],
-                1.0f - attrib.texcoords[2 * index.texcoord_index + 1],
-            };
-
-            glm::vec3 color{1.0, 1.0, 1.0};
-
-            Vertex vertex{pos, color, texCoord};
-            auto [it, newVertex]
-                = uniqueVertices.try_emplace(vertex, vertices.size());
-
-            if (newVertex) {
-                vertices.push_back(vertex);
+            if (options.optimizations) {
+                for (const auto& mesh : meshes) {
+                    before += analyzeVertexCache(mesh.indices.data(),
+                                                 mesh.indices.size(),
+                                                 mesh.vertices.size());
+                }
+                auto optimizeStart = clock::now();
+                optimizeMeshes(meshes, options.optimizations, pool);
+                optimizeTime += std::chrono::duration<double, std::milli>(
+                                    clock::now() - optimizeStart)
+                                    .count();
+                for (const auto& mesh : meshes) {
+                    // full resolution only, the other levels are extra
+                    // indices
+                    auto indexCount = mesh.lods.empty()
+                                          ? mesh.indices.size()
+                                          : mesh.lods[0].indexCount;
+                    after += analyzeVertexCache(mesh.indices.data(),
+                                                indexCount,
+                                                mesh.vertices.size());
+                    lodCount += std::max<std::size_t>(mesh.lods.size(), 1);
+                    meshletCount += mesh.meshlets.size();
+                }
             }
 
-            indices.push_back(it->second);
+            for (const auto& mesh : meshes) {
+                if (!onMesh(mesh.view(), mesh.material)) {
+                    return false;
+                }
+            }
+            meshCount += meshes.size();
+            if (options.useCache) {
+                std::move(meshes.begin(), meshes.end(),
+                          std::back_inserter(meshData));
+            }
+            return true;
+        });
+    if (!completed) {
+        return;
+    }
+    if (!published) {
+        publishMaterials(materials);
+    }
+
+    auto seconds
+        = std::chrono::duration<double>(clock::now() - start).count();
+    std::cout << "scene: " << shapeCount << " shapes, " << vertexCount
+              << " vertices loaded in " << seconds * 1000.0 << " ms on "
+              << pool.size() << " threads ("
+              << static_cast<double>(shapeCount) / seconds << " shapes/s, "
+              << static_cast<double>(vertexCount) / seconds
+              << " vertices/s), " << materials.size() - 1 << " materials\n";
+    if (options.optimizations) {
+        std::cout << "scene: optimized in " << optimizeTime
+                  << " ms, vertex cache ACMR " << before.acmr() << " -> "
+                  << after.acmr() << ", ATVR " << before.atvr() << " -> "
+                  << after.atvr() << ", " << meshCount << " meshes, "
+                  << lodCount << " levels of detail, " << meshletCount
+                  << " meshlets\n";
+    }
+
+    if (options.useCache) {
+        try {
+            MeshCache::write(objPath, libraries, meshData, materials,
+                             options.optimizations);
+        } catch (std::exception& e) {
+            std::cerr << "failed to write mesh cache: " << e.what()
+                      << std::endl;
         }
+    }
+}
+
+} // namespace
 
-        meshes.emplace_back(bufferManager, vertices, indices);
+Scene::Scene(vulkan::BufferManager& bufferManager, const std::string& objPath,
+             const LoadOptions& options) {
+    // submitted as they fill up, waited for when they go out of scope
+    std::vector<std::unique_ptr<vulkan::UploadBatch>> batches;
+    loadMeshes(
+        objPath, options,
+        [&](std::vector<MaterialData> loaded) {
+            materials = std::move(loaded);
+        },
+        [&](const MeshView& view, uint32_t material) {
+            if (batches.empty()
+                || batches.back()->uploadedSize() >= uploadBatchSize) {
+                if (!batches.empty()) {
+                    batches.back()->submit();
+                }
+                batches.push_back(
+                    std::make_unique<vulkan::UploadBatch>(bufferManager));
+            }
+            meshes.emplace_back(bufferManager, view, options.vertexFormat,
+                                batches.back().get());
+            meshes.back().setMaterial(material);
+            return true;
+        });
+}
+
+AsyncScene::AsyncScene(vulkan::BufferManager& bufferManager,
+                       const std::string& objPath, const LoadOptions& options)
+    : _thread([this, &bufferManager, objPath, options]() {
+          _load(bufferManager, objPath, options);
+      }) {
+}
+
+AsyncScene::~AsyncScene() {
+    _cancelled = true;
+    _thread.join();
+}
+
+std::optional<std::vector<MaterialData>> AsyncScene::takeMaterials() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return std::exchange(_materials, std::nullopt);
+}
+
+std::vector<const vulkan::Mesh*> AsyncScene::takeResidentMeshes() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_error) {
+        std::rethrow_exception(std::exchange(_error, nullptr));
+    }
+
+    std::vector<const vulkan::Mesh*> meshes;
+    for (; _taken < _meshes.size(); ++_taken) {
+        meshes.push_back(_meshes[_taken].get());
     }
+    return meshes;
+}
+
+bool AsyncScene::isLoaded() const {
+    return _loaded;
 }
 
-glm::mat4 Scene::getModelMatrix() const {
-    return glm::mat4(1);
+void AsyncScene::_load(vulkan::BufferManager& bufferManager,
+                       const std::string& objPath,
+                       const LoadOptions& options) {
+    try {
+        // The uploads happen on this thread, in batches of about
+        // uploadBatchSize bytes. A batch is submitted once full and its
+        // meshes are published once it is done, while the next one is
+        // recorded. The meshes are declared first so the batches copying
+        // to them are waited for before they are destroyed.
+        std::vector<std::unique_ptr<vulkan::Mesh>> recorded, submitted;
+        std::unique_ptr<vulkan::UploadBatch> batch, inFlight;
+        auto publish = [&]() {
+            if (!inFlight) {
+                return;
+            }
+            inFlight->wait();
+            inFlight.reset();
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (auto& mesh : submitted) {
+                _meshes.push_back(std::move(mesh));
+            }
+            submitted.clear();
+        };
+        auto flush = [&]() {
+            if (!batch) {
+                return;
+            }
+            batch->submit();
+            publish();
+            inFlight = std::move(batch);
+            submitted = std::move(recorded);
+            recorded.clear();
+        };
+
+        loadMeshes(
+            objPath, options,
+            [&](std::vector<MaterialData> materials) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _materials = std::move(materials);
+            },
+            [&](const MeshView& view, uint32_t material) {
+                if (_cancelled) {
+                    return false;
+                }
+                if (!batch) {
+                    batch = std::make_unique<vulkan::UploadBatch>(
+                        bufferManager);
+                }
+                auto mesh = std::make_unique<vulkan::Mesh>(
+                    bufferManager, view, options.vertexFormat, batch.get());
+                mesh->setMaterial(material);
+                recorded.push_back(std::move(mesh));
+                if (batch->uploadedSize() >= uploadBatchSize) {
+                    flush();
+                }
+                return true;
+            });
+        if (!_cancelled) {
+            flush();
+            publish();
+        }
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _error = std::current_exception();
+    }
+    _loaded = true;
 }
 
 Camera::Camera() {
@@ -0,0 +1,182 @@
+#include "transform_hierarchy.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <type_traits>
+
+namespace scene {
+
+namespace {
+
+// nodes of a level updated by one task
+constexpr std::size_t updateChunkSize = 2048;
+
+glm::mat4 localMatrix(const glm::vec3& translation, const glm::quat& rotation,
+                      const glm::vec3& scale) {
+    // rotation matrix of a unit quaternion, columns scaled
+    float xx = rotation.x * rotation.x, yy = rotation.y * rotation.y,
+          zz = rotation.z * rotation.z;
+    float xy = rotation.x * rotation.y, xz = rotation.x * rotation.z,
+          yz = rotation.y * rotation.z;
+    float wx = rotation.w * rotation.x, wy = rotation.w * rotation.y,
+          wz = rotation.w * rotation.z;
+
+    glm::mat4 m(1.0f);
+    m[0] = glm::vec4(1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz),
+                     2.0f * (xz - wy), 0.0f)
+           * scale.x;
+    m[1] = glm::vec4(2.0f * (xy - wz), 1.0f - 2.0f * (xx + zz),
+                     2.0f * (yz + wx), 0.0f)
+           * scale.y;
+    m[2] = glm::vec4(2.0f * (xz + wy), 2.0f * (yz - wx),
+                     1.0f - 2.0f * (xx + yy), 0.0f)
+           * scale.z;
+    m[3] = glm::vec4(translation, 1.0f);
+    return m;
+}
+
+} // namespace
+
+NodeId TransformHierarchy::add(const Transform& local, NodeId parent) {
+    auto id = static_cast<NodeId>(_ids.size());
+    auto slot = static_cast<uint32_t>(_ids.size());
+    uint32_t depth = 0;
+    uint32_t parentSlot = noParent;
+    if (parent != noParent) {
+        parentSlot = _slots[parent];
+        depth = _depths[parentSlot] + 1;
+    }
+
+    _translations.push_back(local.translation);
+    _rotations.push_back(local.rotation);
+    _scales.push_back(local.scale);
+    _worlds.emplace_back(1.0f);
+    _parentSlots.push_back(parentSlot);
+    _depths.push_back(depth);
+    _dirty.push_back(1);
+    _ids.push_back(id);
+    _slots.push_back(slot);
+
+    // nodes added in depth order keep the storage sorted
+    if (slot > 0 && depth < _depths[slot - 1]) {
+        _sorted = false;
+    }
+    if (_levels.size() < depth + 2) {
+        _levels.resize(depth + 2, slot);
+    }
+    _levels[depth + 1] = slot + 1;
+    _anyDirty = true;
+    return id;
+}
+
+void TransformHierarchy::setLocal(NodeId node, const Transform& local) {
+    auto slot = _slots[node];
+    _translations[slot] = local.translation;
+    _rotations[slot] = local.rotation;
+    _scales[slot] = local.scale;
+    _dirty[slot] = 1;
+    _anyDirty = true;
+}
+
+Transform TransformHierarchy::local(NodeId node) const {
+    auto slot = _slots[node];
+    Transform transform;
+    transform.translation = _translations[slot];
+    transform.rotation = _rotations[slot];
+    transform.scale = _scales[slot];
+    return transform;
+}
+
+std::size_t TransformHierarchy::update(ThreadPool& pool) {
+    if (!_anyDirty) {
+        return 0;
+    }
+    if (!_sorted) {
+        _sortByDepth();
+    }
+
+    std::atomic<std::size_t> updated{0};
+    for (std::size_t level = 0; level + 1 < _levels.size(); ++level) {
+        std::size_t begin = _levels[level], end = _levels[level + 1];
+        auto chunkCount = (end - begin + updateChunkSize - 1) / updateChunkSize;
+        pool.parallelFor(chunkCount, [&](std::size_t chunk) {
+            auto first = begin + chunk * updateChunkSize;
+            auto last = std::min(end, first + updateChunkSize);
+            std::size_t count = 0;
+            for (auto slot = first; slot < last; ++slot) {
+                auto parent = _parentSlots[slot];
+                // parents are done, their flag tells if the subtree moved
+                if (parent != noParent) {
+                    _dirty[slot] |= _dirty[parent];
+                }
+                if (!_dirty[slot]) {
+                    continue;
+                }
+
+                auto local = localMatrix(_translations[slot], _rotations[slot],
+                                         _scales[slot]);
+                _worlds[slot]
+                    = parent != noParent ? _worlds[parent] * local : local;
+                ++count;
+            }
+            updated += count;
+        });
+    }
+
+    std::fill(_dirty.begin(), _dirty.end(), 0);
+    _anyDirty = false;
+    return updated;
+}
+
+void TransformHierarchy::copyWorldMatrices(glm::mat4* destination) const {
+    for (std::size_t slot = 0; slot < _ids.size(); ++slot) {
+        destination[_ids[slot]] = _worlds[slot];
+    }
+}
+
+void TransformHierarchy::_sortByDepth() {
+    // counting sort by depth, stable so parents stay before their children
+    std::vector<uint32_t> levels(_levels.size(), 0);
+    for (auto depth : _depths) {
+        ++levels[depth + 1];
+    }
+    for (std::size_t level = 1; level < levels.size(); ++level) {
+        levels[level] += levels[level - 1];
+    }
+
+    auto count = _ids.size();
+    std::vector<uint32_t> newSlots(count);
+    auto next = levels;
+    for (std::size_t slot = 0; slot < count; ++slot) {
+        newSlots[slot] = next[_depths[slot]]++;
+    }
+
+    auto permute = [&](auto& values) {
+        std::remove_reference_t<decltype(values)> sorted(count);
+        for (std::size_t slot = 0; slot < count; ++slot) {
+            sorted[newSlots[slot]] = values[slot];
+        }
+        values.swap(sorted);
+    };
+    permute(_translations);
+    permute(_rotations);
+    permute(_scales);
+    permute(_worlds);
+    permute(_depths);
+    permute(_dirty);
+    permute(_ids);
+    permute(_parentSlots);
+    for (auto& parent : _parentSlots) {
+        if (parent != noParent) {
+            parent = newSlots[parent];
+        }
+    }
+    for (std::size_t slot = 0; slot < count; ++slot) {
+        _slots[_ids[slot]] = static_cast<uint32_t>(slot);
+    }
+
+    _levels = std::move(levels);
+    _sorted = true;
+}
+
+} // namespace scene
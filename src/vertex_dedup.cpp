@@ -0,0 +1,99 @@
+#include "vertex_dedup.hpp"
+
+#include <algorithm>
+
+namespace scene {
+
+namespace {
+
+constexpr uint64_t prime1 = 0x9e3779b185ebca87ull;
+constexpr uint64_t prime2 = 0xc2b2ae3d27d4eb4full;
+
+uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+std::size_t nextPowerOfTwo(std::size_t value) {
+    std::size_t result = 16;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+} // namespace
+
+uint64_t hashCanonicalVertex(const Vertex& vertex) {
+    static_assert(sizeof(Vertex) % sizeof(uint64_t) == 0,
+                  "vertex is hashed 64 bits at a time");
+    uint64_t words[sizeof(Vertex) / sizeof(uint64_t)];
+    std::memcpy(words, &vertex, sizeof(Vertex));
+
+    uint64_t h = prime2;
+    for (auto word : words) {
+        h = rotl(h ^ (word * prime1), 31) * prime2;
+    }
+
+    // final avalanche so the low bits used for the slot depend on all input
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+VertexDeduplicator::VertexDeduplicator(std::vector<Vertex>& vertices,
+                                       std::size_t expectedCount)
+    : _vertices(vertices) {
+    // at most half full, so a full table never has to grow
+    _rehash(nextPowerOfTwo(expectedCount * 2));
+    _vertices.reserve(_vertices.size() + expectedCount);
+}
+
+uint32_t VertexDeduplicator::insert(const Vertex& input) {
+    // canonical once, the stored vertices are too
+    auto vertex = withoutNegativeZeros(input);
+    auto h = hashCanonicalVertex(vertex);
+    auto tag = static_cast<uint32_t>(h >> 32);
+
+    for (auto i = static_cast<std::size_t>(h) & _mask;; i = (i + 1) & _mask) {
+        auto& slot = _slots[i];
+        if (slot.index == emptySlot) {
+            auto index = static_cast<uint32_t>(_vertices.size());
+            slot = Slot{index, tag};
+            _vertices.push_back(vertex);
+
+            if (++_count * 2 > _slots.size()) {
+                _rehash(_slots.size() * 2);
+            }
+            return index;
+        }
+        if (slot.tag == tag
+            && sameCanonicalVertexBits(_vertices[slot.index], vertex)) {
+            return slot.index;
+        }
+    }
+}
+
+void VertexDeduplicator::_rehash(std::size_t capacity) {
+    std::vector<Slot> slots(capacity, Slot{emptySlot, 0});
+    _mask = capacity - 1;
+
+    for (const auto& slot : _slots) {
+        if (slot.index == emptySlot) {
+            continue;
+        }
+        auto i = static_cast<std::size_t>(
+                     hashCanonicalVertex(_vertices[slot.index]))
+                 & _mask;
+        while (slots[i].index != emptySlot) {
+            i = (i + 1) & _mask;
+        }
+        slots[i] = slot;
+    }
+
+    _slots = std::move(slots);
+}
+
+} // namespace scene
@@ -1,7 +1,29 @@
 #include "vulkan/buffer_manager.hpp"
+#include "vulkan/upload_batch.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
 
 namespace vulkan {
 
+namespace {
+
+// multiple of the texel size and the optimal copy offset of most devices
+constexpr vk::DeviceSize stagingAlignment = 16;
+
+const vk::BufferUsageFlags instanceUsage
+    = vk::BufferUsageFlagBits::eStorageBuffer
+      | vk::BufferUsageFlagBits::eTransferDst
+      | vk::BufferUsageFlagBits::eTransferSrc;
+
+vk::DeviceSize alignStaging(vk::DeviceSize offset) {
+    return (offset + stagingAlignment - 1) / stagingAlignment
+           * stagingAlignment;
+}
+
+} // namespace
+
 void Buffer::destroy(VmaAllocator allocator) {
     vmaDestroyBuffer(allocator, buffer, allocation);
 }
@@ -10,8 +32,60 @@ void Image::destroy(VmaAllocator allocator) {
     vmaDestroyImage(allocator, image, allocation);
 }
 
+UploadFence::UploadFence(vk::Device device) : _device(device) {
+    fence = _device.createFence(vk::FenceCreateInfo());
+}
+
+UploadFence::~UploadFence() {
+    _device.destroy(fence);
+}
+
+bool UploadFence::done() const {
+    return _device.getFenceStatus(fence) == vk::Result::eSuccess;
+}
+
+void UploadFence::wait() const {
+    if (!submitted) {
+        throw std::logic_error("waiting for an upload that wasn't submitted");
+    }
+    _device.waitForFences(fence, VK_TRUE,
+                          std::numeric_limits<uint64_t>::max());
+}
+
 BufferManager::BufferManager(Context& context)
     : allocator(context.allocator), _context(context) {
+
+    _stagingRing
+        = createBuffer(stagingRingSize, vk::BufferUsageFlagBits::eTransferSrc,
+                       VMA_MEMORY_USAGE_CPU_ONLY);
+    void* mapped;
+    vmaMapMemory(allocator, _stagingRing.allocation, &mapped);
+    _stagingMapped = static_cast<char*>(mapped);
+
+    _chooseGeometryMemory();
+
+    // bound by every frame, even without instances
+    _instances = createBuffer(instanceBufferSize, instanceUsage,
+                              VMA_MEMORY_USAGE_GPU_ONLY);
+}
+
+BufferManager::~BufferManager() {
+    for (auto& block : _geometryBlocks) {
+        if (block.mapped) {
+            vmaUnmapMemory(allocator, block.buffer.allocation);
+        }
+        block.buffer.destroy(allocator);
+    }
+
+    // the batches wait for their copies, the slices are done
+    _stagingRegions.clear();
+    for (auto& dedicated : _dedicatedStaging) {
+        vmaUnmapMemory(allocator, dedicated.buffer.allocation);
+        dedicated.buffer.destroy(allocator);
+    }
+    vmaUnmapMemory(allocator, _stagingRing.allocation);
+    _stagingRing.destroy(allocator);
+    _instances.destroy(allocator);
 }
 
 Buffer BufferManager::createBuffer(vk::DeviceSize size,
@@ -76,48 +150,324 @@ Image BufferManager::createImage(uint32_t width, uint32_t height,
     return Image{image, allocation};
 }
 
-void BufferManager::copyBuffer(vk::Buffer srcBuffer, vk::Buffer dstBuffer,
-                               vk::DeviceSize size) {
-    auto commandBuffer = _context.beginSingleTimeCommands();
+StagingSlice BufferManager::stage(const void* data, vk::DeviceSize size,
+                                 const std::shared_ptr<UploadFence>& fence) {
+    if (size > stagingRingSize / 4) {
+        return _stageDedicated(data, size, fence);
+    }
+
+    StagingSlice slice;
+    {
+        std::unique_lock<std::mutex> lock(_stagingMutex);
+        _reclaimStaging();
+        auto offset = _allocateStaging(size);
+        while (!offset) {
+            // the fence can't be waited for before its batch is submitted,
+            // whether it's this batch or one of another thread
+            auto oldest = _stagingRegions.front().fence;
+            if (!oldest->submitted) {
+                break;
+            }
+            lock.unlock();
+            oldest->wait();
+            lock.lock();
+            _reclaimStaging();
+            offset = _allocateStaging(size);
+        }
+        if (offset) {
+            _stagingRegions.push_back({*offset, *offset + size, fence});
+            _stagingHead = *offset + size;
+            slice = StagingSlice{_stagingRing.buffer, *offset};
+        }
+    }
+    if (slice.buffer) {
+        std::memcpy(_stagingMapped + slice.offset, data,
+                    static_cast<std::size_t>(size));
+        return slice;
+    }
+    // a batch bigger than the ring
+    return _stageDedicated(data, size, fence);
+}
 
-    vk::BufferCopy copyRegion = {};
-    copyRegion.srcOffset = 0;
-    copyRegion.dstOffset = 0;
-    copyRegion.size = size;
-    commandBuffer.copyBuffer(srcBuffer, dstBuffer, copyRegion);
+Buffer BufferManager::_createTwoLevelBuffer(UploadBatch* batch,
+                                           const void* data,
+                                           vk::DeviceSize size,
+                                           vk::BufferUsageFlags addUsage) {
+    if (auto buffer = _createDirectBuffer(size, addUsage)) {
+        void* mapped;
+        vmaMapMemory(allocator, buffer->allocation, &mapped);
+        std::memcpy(mapped, data, static_cast<std::size_t>(size));
+        vmaUnmapMemory(allocator, buffer->allocation);
+        if (batch) {
+            batch->addDirectWrite(size);
+        }
+        return *buffer;
+    }
 
-    _context.endSingleTimeCommands(commandBuffer);
+    auto buffer
+        = createBuffer(size, vk::BufferUsageFlagBits::eTransferDst | addUsage,
+                       VMA_MEMORY_USAGE_GPU_ONLY);
+    if (batch) {
+        batch->copyBuffer(data, size, buffer.buffer);
+    } else {
+        UploadBatch ownBatch(*this);
+        ownBatch.copyBuffer(data, size, buffer.buffer);
+        ownBatch.wait();
+    }
+    return buffer;
 }
 
-void BufferManager::copyBufferToImage(vk::Buffer buffer, vk::Image image,
-                                      uint32_t width, uint32_t height) {
-    auto commandBuffer = _context.beginSingleTimeCommands();
+void BufferManager::destroyBuffer(Buffer buffer) {
+    buffer.destroy(allocator);
+}
 
-    vk::BufferImageCopy region = {};
-    region.bufferOffset = 0;
-    region.bufferRowLength = 0;
-    region.bufferImageHeight = 0;
+void BufferManager::destroyImage(Image image) {
+    image.destroy(allocator);
+}
 
-    region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-    region.imageSubresource.mipLevel = 0;
-    region.imageSubresource.baseArrayLayer = 0;
-    region.imageSubresource.layerCount = 1;
+void BufferManager::freeGeometry(const GeometryRange& range) {
+    std::lock_guard<std::mutex> lock(_geometryMutex);
+    _geometryBlocks[range.block].ranges.free(range.offset, range.size);
+}
 
-    region.imageOffset = vk::Offset3D{0, 0, 0};
-    region.imageExtent = vk::Extent3D{width, height, 1};
+GeometryRange BufferManager::_allocateGeometry(vk::DeviceSize size,
+                                               vk::DeviceSize alignment) {
+    std::lock_guard<std::mutex> lock(_geometryMutex);
+    for (std::size_t i = 0; i < _geometryBlocks.size(); ++i) {
+        auto& block = _geometryBlocks[i];
+        if (auto offset = block.ranges.allocate(size, alignment)) {
+            return GeometryRange{i, block.buffer.buffer, *offset, size};
+        }
+    }
 
-    commandBuffer.copyBufferToImage(
-        buffer, image, vk::ImageLayout::eTransferDstOptimal, region);
+    auto blockSize = std::max(size, geometryBlockSize);
+    vk::BufferUsageFlags usage = vk::BufferUsageFlagBits::eVertexBuffer
+                                 | vk::BufferUsageFlagBits::eIndexBuffer
+                                 | vk::BufferUsageFlagBits::eTransferDst;
+    GeometryBlock block{Buffer{}, RangeAllocator(blockSize)};
+    if (auto direct = _createDirectBuffer(blockSize, usage)) {
+        void* mapped;
+        vmaMapMemory(allocator, direct->allocation, &mapped);
+        block.buffer = *direct;
+        block.mapped = static_cast<char*>(mapped);
+    } else {
+        block.buffer
+            = createBuffer(blockSize, usage, VMA_MEMORY_USAGE_GPU_ONLY);
+    }
+    auto buffer = block.buffer.buffer;
+    _geometryBlocks.push_back(std::move(block));
 
-    _context.endSingleTimeCommands(commandBuffer);
+    auto offset = _geometryBlocks.back().ranges.allocate(size, alignment);
+    return GeometryRange{_geometryBlocks.size() - 1, buffer, *offset, size};
 }
 
-void BufferManager::destroyBuffer(Buffer buffer) {
-    buffer.destroy(allocator);
+void BufferManager::_uploadGeometry(UploadBatch* batch,
+                                    const GeometryRange& range,
+                                    const void* data) {
+    if (range.size == 0) {
+        return;
+    }
+
+    char* mapped;
+    {
+        std::lock_guard<std::mutex> lock(_geometryMutex);
+        mapped = _geometryBlocks[range.block].mapped;
+    }
+    // host writes are visible to the submits that follow them
+    if (mapped) {
+        std::memcpy(mapped + range.offset, data,
+                    static_cast<std::size_t>(range.size));
+        // still counted, so the callers flushing on size publish meshes
+        if (batch) {
+            batch->addDirectWrite(range.size);
+        }
+    } else if (batch) {
+        batch->copyBuffer(data, range.size, range.buffer, range.offset);
+    } else {
+        UploadBatch ownBatch(*this);
+        ownBatch.copyBuffer(data, range.size, range.buffer, range.offset);
+        ownBatch.wait();
+    }
 }
 
-void BufferManager::destroyImage(Image image) {
-    image.destroy(allocator);
+GeometryRange BufferManager::allocateInstances(const void* data,
+                                               vk::DeviceSize size,
+                                               vk::DeviceSize alignment) {
+    auto offset = _instanceRanges.allocate(size, alignment);
+    if (!offset) {
+        _growInstances(size + alignment);
+        offset = _instanceRanges.allocate(size, alignment);
+    }
+
+    UploadBatch batch(*this);
+    batch.copyBuffer(data, size, _instances.buffer, *offset);
+    batch.wait();
+    return GeometryRange{0, _instances.buffer, *offset, size};
+}
+
+void BufferManager::freeInstances(const GeometryRange& range) {
+    _instanceRanges.free(range.offset, range.size);
+}
+
+void BufferManager::_growInstances(vk::DeviceSize size) {
+    auto capacity = _instanceRanges.capacity();
+    auto newCapacity = capacity * 2;
+    while (newCapacity < capacity + size) {
+        newCapacity *= 2;
+    }
+    auto instances
+        = createBuffer(newCapacity, instanceUsage, VMA_MEMORY_USAGE_GPU_ONLY);
+
+    auto cmd = _context.beginSingleTimeCommands();
+    cmd.copyBuffer(_instances.buffer, instances.buffer,
+                   vk::BufferCopy{0, 0, capacity});
+    vk::MemoryBarrier barrier;
+    barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+    barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead
+                            | vk::AccessFlagBits::eTransferWrite;
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                        vk::PipelineStageFlagBits::eVertexShader
+                            | vk::PipelineStageFlagBits::eTransfer,
+                        {}, barrier, nullptr, nullptr);
+    _context.endSingleTimeCommands(cmd);
+
+    // frames in flight may still read the old buffer
+    _context.deviceWaitIdle();
+    _instances.destroy(allocator);
+    _instances = instances;
+    _instanceRanges.grow(newCapacity);
+    ++_instanceVersion;
+}
+
+std::optional<vk::DeviceSize>
+BufferManager::_allocateStaging(vk::DeviceSize size) {
+    if (_stagingRegions.empty()) {
+        return 0;
+    }
+
+    // the free space is past the head up to the oldest region, wrapping
+    // around the end of the ring
+    auto tail = _stagingRegions.front().begin;
+    auto head = alignStaging(_stagingHead);
+    if (_stagingHead > tail) {
+        if (head + size <= stagingRingSize) {
+            return head;
+        }
+        if (size <= tail) {
+            return 0;
+        }
+    } else if (head + size <= tail) {
+        return head;
+    }
+    return std::nullopt;
+}
+
+void BufferManager::_reclaimStaging() {
+    // in order, a slice done before an older one waits for it
+    while (!_stagingRegions.empty() && _stagingRegions.front().fence->done()) {
+        _stagingRegions.pop_front();
+    }
+    if (_stagingRegions.empty()) {
+        _stagingHead = 0;
+    }
+
+    auto done = std::remove_if(
+        _dedicatedStaging.begin(), _dedicatedStaging.end(),
+        [&](DedicatedStaging& dedicated) {
+            if (!dedicated.fence->done()) {
+                return false;
+            }
+            vmaUnmapMemory(allocator, dedicated.buffer.allocation);
+            dedicated.buffer.destroy(allocator);
+            return true;
+        });
+    _dedicatedStaging.erase(done, _dedicatedStaging.end());
+}
+
+void BufferManager::_chooseGeometryMemory() {
+    auto properties = _context.physicalDevice.getMemoryProperties();
+    vk::DeviceSize deviceMemory = 0;
+    for (uint32_t i = 0; i < properties.memoryHeapCount; ++i) {
+        const auto& heap = properties.memoryHeaps[i];
+        if (heap.flags & vk::MemoryHeapFlagBits::eDeviceLocal) {
+            deviceMemory = std::max(deviceMemory, heap.size);
+        }
+    }
+
+    // a small BAR window is left to the allocator, writing all the geometry
+    // there would run out of it
+    auto direct = vk::MemoryPropertyFlagBits::eDeviceLocal
+                  | vk::MemoryPropertyFlagBits::eHostVisible
+                  | vk::MemoryPropertyFlagBits::eHostCoherent;
+    vk::DeviceSize windowSize = 0;
+    for (uint32_t i = 0; i < properties.memoryTypeCount; ++i) {
+        const auto& type = properties.memoryTypes[i];
+        if ((type.propertyFlags & direct) != direct) {
+            continue;
+        }
+        auto heapSize = properties.memoryHeaps[type.heapIndex].size;
+        windowSize = std::max(windowSize, heapSize);
+        if (heapSize >= deviceMemory / 2) {
+            _directMemoryType = i;
+            break;
+        }
+    }
+
+    constexpr vk::DeviceSize mib = 1024 * 1024;
+    if (_directMemoryType) {
+        const auto& type = properties.memoryTypes[*_directMemoryType];
+        std::cout << "memory: geometry written directly to device local "
+                     "memory type "
+                  << *_directMemoryType << " (heap " << type.heapIndex << ", "
+                  << properties.memoryHeaps[type.heapIndex].size / mib
+                  << " MiB)\n";
+    } else {
+        std::cout << "memory: geometry copied to device local memory ("
+                  << deviceMemory / mib << " MiB), host visible window "
+                  << windowSize / mib << " MiB\n";
+    }
+}
+
+std::optional<Buffer>
+BufferManager::_createDirectBuffer(vk::DeviceSize size,
+                                   vk::BufferUsageFlags usage) {
+    if (!_directMemoryType) {
+        return std::nullopt;
+    }
+
+    vk::BufferCreateInfo bufferInfo;
+    bufferInfo.size = size;
+    bufferInfo.usage = usage;
+    bufferInfo.sharingMode = vk::SharingMode::eExclusive;
+    auto bufferInfoC = static_cast<VkBufferCreateInfo>(bufferInfo);
+
+    VmaAllocationCreateInfo allocInfo = {};
+    allocInfo.memoryTypeBits = 1u << *_directMemoryType;
+
+    VkBuffer buffer;
+    VmaAllocation allocation;
+    if (vmaCreateBuffer(allocator, &bufferInfoC, &allocInfo, &buffer,
+                        &allocation, nullptr)
+        != VK_SUCCESS) {
+        return std::nullopt;
+    }
+    return Buffer{buffer, allocation};
+}
+
+StagingSlice
+BufferManager::_stageDedicated(const void* data, vk::DeviceSize size,
+                               const std::shared_ptr<UploadFence>& fence) {
+    auto buffer = createBuffer(size, vk::BufferUsageFlagBits::eTransferSrc,
+                               VMA_MEMORY_USAGE_CPU_ONLY);
+    void* mapped;
+    vmaMapMemory(allocator, buffer.allocation, &mapped);
+    std::memcpy(mapped, data, static_cast<std::size_t>(size));
+    {
+        std::lock_guard<std::mutex> lock(_stagingMutex);
+        _reclaimStaging();
+        _dedicatedStaging.push_back({buffer, fence});
+    }
+    return StagingSlice{buffer.buffer, 0};
 }
 
 } // namespace vulkan
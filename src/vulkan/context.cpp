@@ -1,13 +1,17 @@
 #include "vulkan/context.hpp"
 #include "vulkan/utils.hpp"
 
+#include <iostream>
+#include <limits>
 #include <map>
 #include <set>
+#include <string>
 #include <vector>
 
 namespace vulkan {
 
-Context::Context(GLFWwindow* window) {
+Context::Context(GLFWwindow* window)
+    : _mainThread(std::this_thread::get_id()) {
     instance = _createInstance();
     debugMessenger = _setupDebugMessenger();
 
@@ -15,10 +19,21 @@ Context::Context(GLFWwindow* window) {
     physicalDevice = _pickPhysicalDevice(instance);
     std::tie(device, graphicsQueue, presentQueue) = _createLogicalDevice();
     allocator = _createAllocator();
-    commandPool = _createCommandPool();
+    commandPool = _createCommandPool(graphicsFamily);
+
+    if (hasTransferQueue()) {
+        std::cout << "context: uploads on transfer queue family "
+                  << transferFamily << "\n";
+    } else {
+        std::cout << "context: no transfer only queue family, uploads on "
+                     "the graphics queue\n";
+    }
 }
 
 void Context::destroy() {
+    for (const auto& [key, pool] : _threadPools) {
+        vkDestroyCommandPool(device, pool, nullptr);
+    }
     vkDestroyCommandPool(device, commandPool, nullptr);
 
     vmaDestroyAllocator(allocator);
@@ -32,13 +47,15 @@ void Context::destroy() {
 }
 
 void Context::deviceWaitIdle() {
+    // waiting idle uses every queue
+    std::scoped_lock lock(queueMutex, _transferQueueMutex);
     vkDeviceWaitIdle(device);
 }
 
-vk::CommandBuffer Context::beginSingleTimeCommands() {
+vk::CommandBuffer Context::beginSingleTimeCommands(bool transfer) {
     vk::CommandBufferAllocateInfo allocInfo;
     allocInfo.level = vk::CommandBufferLevel::ePrimary;
-    allocInfo.commandPool = commandPool;
+    allocInfo.commandPool = _threadCommandPool(transfer);
     allocInfo.commandBufferCount = 1;
 
     vk::CommandBuffer commandBuffer;
@@ -53,16 +70,31 @@ vk::CommandBuffer Context::beginSingleTimeCommands() {
 }
 
 void Context::endSingleTimeCommands(vk::CommandBuffer commandBuffer) {
+    // wait on a fence rather than the queue, so that other threads can keep
+    // submitting while this upload is in flight
+    auto fence = device.createFence(vk::FenceCreateInfo());
+    submitSingleTimeCommands(commandBuffer, fence);
+    device.waitForFences(fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+    device.destroy(fence);
+
+    freeSingleTimeCommands(commandBuffer);
+}
+
+void Context::submitSingleTimeCommands(vk::CommandBuffer commandBuffer,
+                                       vk::Fence fence) {
     commandBuffer.end();
 
     vk::SubmitInfo submitInfo;
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = &commandBuffer;
 
-    graphicsQueue.submit(submitInfo, vk::Fence());
-    graphicsQueue.waitIdle();
+    std::lock_guard<std::mutex> lock(queueMutex);
+    graphicsQueue.submit(submitInfo, fence);
+}
 
-    device.freeCommandBuffers(commandPool, commandBuffer);
+void Context::freeSingleTimeCommands(vk::CommandBuffer commandBuffer,
+                                     bool transfer) {
+    device.freeCommandBuffers(_threadCommandPool(transfer), commandBuffer);
 }
 
 vk::Instance Context::_createInstance() {
@@ -134,10 +166,14 @@ std::tuple<vk::Device, vk::Queue, vk::Queue> Context::_createLogicalDevice() {
     utils::QueueFamilyIndices indices
         = utils::findQueueFamilies(physicalDevice, surface);
 
+    graphicsFamily = indices.graphicsFamily.value();
+    transferFamily = indices.transferFamily.value_or(graphicsFamily);
+
     std::vector<vk::DeviceQueueCreateInfo> queueCreateInfos;
     std::set<uint32_t> uniqueQueueFamilies = {
         indices.graphicsFamily.value(),
         indices.presentFamily.value(),
+        transferFamily,
     };
 
     float queuePriority = 1.0f;
@@ -149,17 +185,34 @@ std::tuple<vk::Device, vk::Queue, vk::Queue> Context::_createLogicalDevice() {
         queueCreateInfos.push_back(queueCreateInfo);
     }
 
+    // the indirect draws use them when the device has them
+    auto supported = physicalDevice.getFeatures();
     vk::PhysicalDeviceFeatures deviceFeatures = {};
     deviceFeatures.samplerAnisotropy = VK_TRUE;
+    deviceFeatures.multiDrawIndirect = supported.multiDrawIndirect;
+    deviceFeatures.drawIndirectFirstInstance
+        = supported.drawIndirectFirstInstance;
+    enabledFeatures = deviceFeatures;
     vk::DeviceCreateInfo createInfo = {};
     createInfo.queueCreateInfoCount
         = static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
     createInfo.pEnabledFeatures = &deviceFeatures;
 
+    // lets the occlusion culling skip the draws it dropped
+    auto extensions = utils::deviceExtensions;
+    bool drawIndirectCount = false;
+    for (const auto& extension :
+         physicalDevice.enumerateDeviceExtensionProperties()) {
+        if (std::string(extension.extensionName)
+            == VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) {
+            extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+            drawIndirectCount = true;
+        }
+    }
     createInfo.enabledExtensionCount
-        = static_cast<uint32_t>(utils::deviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = utils::deviceExtensions.data();
+        = static_cast<uint32_t>(extensions.size());
+    createInfo.ppEnabledExtensionNames = extensions.data();
 
     if (utils::enableValidationLayers) {
         createInfo.enabledLayerCount
@@ -170,8 +223,14 @@ std::tuple<vk::Device, vk::Queue, vk::Queue> Context::_createLogicalDevice() {
     }
 
     auto device = physicalDevice.createDevice(createInfo);
+    if (drawIndirectCount) {
+        cmdDrawIndexedIndirectCount
+            = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+                device.getProcAddr("vkCmdDrawIndexedIndirectCountKHR"));
+    }
     auto graphicsQueue = device.getQueue(*indices.graphicsFamily, 0);
     auto presentQueue = device.getQueue(*indices.presentFamily, 0);
+    transferQueue = device.getQueue(transferFamily, 0);
 
     return std::make_tuple(device, graphicsQueue, presentQueue);
 }
@@ -186,16 +245,31 @@ VmaAllocator Context::_createAllocator() {
     return allocator;
 }
 
-vk::CommandPool Context::_createCommandPool() {
-    auto queueFamilyIndices = utils::findQueueFamilies(physicalDevice, surface);
-
+vk::CommandPool Context::_createCommandPool(uint32_t queueFamily) {
     vk::CommandPoolCreateInfo poolInfo;
-    poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
-    poolInfo.flags = {};
+    poolInfo.queueFamilyIndex = queueFamily;
+    // swapchain command buffers are re-recorded every frame
+    poolInfo.flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
 
     return device.createCommandPool(poolInfo);
 }
 
+vk::CommandPool Context::_threadCommandPool(bool transfer) {
+    auto thread = std::this_thread::get_id();
+    if (thread == _mainThread && !transfer) {
+        return commandPool;
+    }
+
+    std::lock_guard<std::mutex> lock(_poolMutex);
+    auto key = std::make_pair(thread, transfer);
+    auto it = _threadPools.find(key);
+    if (it == _threadPools.end()) {
+        auto family = transfer ? transferFamily : graphicsFamily;
+        it = _threadPools.emplace(key, _createCommandPool(family)).first;
+    }
+    return it->second;
+}
+
 VkDebugUtilsMessengerEXT Context::_setupDebugMessenger() {
     if (utils::enableValidationLayers) {
         auto createInfo = utils::makeDebugMessengerCreateInfo();
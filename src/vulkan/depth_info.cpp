@@ -16,7 +16,9 @@ DepthResources::DepthResources(Context& context, BufferManager& bufferManager,
     depthImage = _bufferManager.createImage(
         scExtent.width, scExtent.height, mipLevels, depthFormat,
         vk::ImageTiling::eOptimal,
-        vk::ImageUsageFlagBits::eDepthStencilAttachment,
+        // sampled by the depth pyramid
+        vk::ImageUsageFlagBits::eDepthStencilAttachment
+            | vk::ImageUsageFlagBits::eSampled,
         VMA_MEMORY_USAGE_GPU_ONLY);
     depthImageView = utils::createImageView(depthImage.image, depthFormat,
                                             vk::ImageAspectFlagBits::eDepth,
@@ -36,7 +38,9 @@ vk::Format DepthResources::_findDepthFormat(vk::PhysicalDevice physicalDevice) {
         {vk::Format::eD32Sfloat, vk::Format::eD32SfloatS8Uint,
          vk::Format::eD24UnormS8Uint},
         vk::ImageTiling::eOptimal,
-        vk::FormatFeatureFlagBits::eDepthStencilAttachment, physicalDevice);
+        vk::FormatFeatureFlagBits::eDepthStencilAttachment
+            | vk::FormatFeatureFlagBits::eSampledImage,
+        physicalDevice);
 }
 
 vk::Format DepthResources::_findSupportedFormat(
@@ -0,0 +1,243 @@
+#include "vulkan/depth_pyramid.hpp"
+#include "vulkan/context.hpp"
+#include "vulkan/utils.hpp"
+
+#include <algorithm>
+#include <array>
+
+namespace vulkan {
+
+namespace {
+
+constexpr uint32_t workGroupSize = 8;
+constexpr auto pyramidFormat = vk::Format::eR32Sfloat;
+
+// same layout as the push constants of depth_reduce.comp
+struct ReduceLevel {
+    uint32_t width, height;
+    uint32_t copy;
+};
+
+} // namespace
+
+DepthPyramid::DepthPyramid(Context& context, BufferManager& bufferManager,
+                           const DepthResources& depthResources,
+                           vk::Extent2D extent)
+    : _context(context), _bufferManager(bufferManager),
+      _depthResources(depthResources), _extent(extent) {
+
+    _levelCount = 1;
+    while ((std::max(_extent.width, _extent.height) >> _levelCount) > 0) {
+        ++_levelCount;
+    }
+
+    _image = _bufferManager.createImage(
+        _extent.width, _extent.height, _levelCount, pyramidFormat,
+        vk::ImageTiling::eOptimal,
+        vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled,
+        VMA_MEMORY_USAGE_GPU_ONLY);
+    _view = utils::createImageView(_image.image, pyramidFormat,
+                                   vk::ImageAspectFlagBits::eColor,
+                                   _levelCount, _context.device);
+    for (uint32_t level = 0; level < _levelCount; ++level) {
+        _levelViews.push_back(utils::createImageView(
+            _image.image, pyramidFormat, vk::ImageAspectFlagBits::eColor, 1,
+            _context.device, level));
+    }
+    utils::transitionImageLayout(_image.image, pyramidFormat,
+                                 vk::ImageLayout::eUndefined,
+                                 vk::ImageLayout::eGeneral, _levelCount,
+                                 _context);
+
+    vk::SamplerCreateInfo samplerInfo;
+    samplerInfo.magFilter = vk::Filter::eNearest;
+    samplerInfo.minFilter = vk::Filter::eNearest;
+    samplerInfo.mipmapMode = vk::SamplerMipmapMode::eNearest;
+    samplerInfo.addressModeU = samplerInfo.addressModeV
+        = samplerInfo.addressModeW = vk::SamplerAddressMode::eClampToEdge;
+    samplerInfo.minLod = 0.0f;
+    samplerInfo.maxLod = static_cast<float>(_levelCount);
+    _sampler = _context.device.createSampler(samplerInfo);
+
+    _createDescriptorSets();
+    _createPipeline();
+}
+
+DepthPyramid::~DepthPyramid() {
+    _context.device.destroy(_pipeline);
+    _context.device.destroy(_layout);
+    _context.device.destroy(_descriptorPool);
+    _context.device.destroy(_descriptorSetLayout);
+    _context.device.destroy(_sampler);
+    for (auto view : _levelViews) {
+        _context.device.destroy(view);
+    }
+    _context.device.destroy(_view);
+    _bufferManager.destroyImage(_image);
+}
+
+void DepthPyramid::build(vk::CommandBuffer cmdBuffer) {
+    auto depthAspect = vk::ImageAspectFlags(vk::ImageAspectFlagBits::eDepth);
+    if (utils::hasStencilComponent(_depthResources.depthFormat)) {
+        depthAspect |= vk::ImageAspectFlagBits::eStencil;
+    }
+
+    vk::ImageMemoryBarrier depthBarrier;
+    depthBarrier.srcAccessMask
+        = vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+    depthBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+    depthBarrier.oldLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+    depthBarrier.newLayout = vk::ImageLayout::eDepthStencilReadOnlyOptimal;
+    depthBarrier.srcQueueFamilyIndex = depthBarrier.dstQueueFamilyIndex
+        = VK_QUEUE_FAMILY_IGNORED;
+    depthBarrier.image = _depthResources.depthImage.image;
+    depthBarrier.subresourceRange = {depthAspect, 0, 1, 0, 1};
+
+    // the previous frame may still read the pyramid
+    vk::MemoryBarrier pyramidBarrier;
+    pyramidBarrier.srcAccessMask = vk::AccessFlagBits::eShaderRead;
+    pyramidBarrier.dstAccessMask = vk::AccessFlagBits::eShaderWrite;
+
+    cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eLateFragmentTests
+                                  | vk::PipelineStageFlagBits::eComputeShader,
+                              vk::PipelineStageFlagBits::eComputeShader, {},
+                              pyramidBarrier, nullptr, depthBarrier);
+
+    cmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, _pipeline);
+    for (uint32_t level = 0; level < _levelCount; ++level) {
+        ReduceLevel reduce;
+        reduce.width = std::max(1u, _extent.width >> level);
+        reduce.height = std::max(1u, _extent.height >> level);
+        reduce.copy = level == 0;
+
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+                                     _layout, 0, _descriptorSets[level],
+                                     nullptr);
+        cmdBuffer.pushConstants(_layout, vk::ShaderStageFlagBits::eCompute, 0,
+                                sizeof(reduce), &reduce);
+        cmdBuffer.dispatch((reduce.width + workGroupSize - 1) / workGroupSize,
+                           (reduce.height + workGroupSize - 1) / workGroupSize,
+                           1);
+
+        vk::MemoryBarrier levelBarrier;
+        levelBarrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+        levelBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                                  vk::PipelineStageFlagBits::eComputeShader,
+                                  {}, levelBarrier, nullptr, nullptr);
+    }
+
+    std::swap(depthBarrier.oldLayout, depthBarrier.newLayout);
+    depthBarrier.srcAccessMask = vk::AccessFlagBits::eShaderRead;
+    depthBarrier.dstAccessMask
+        = vk::AccessFlagBits::eDepthStencilAttachmentRead
+          | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+    cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                              vk::PipelineStageFlagBits::eEarlyFragmentTests,
+                              {}, nullptr, nullptr, depthBarrier);
+}
+
+void DepthPyramid::_createDescriptorSets() {
+    std::array<vk::DescriptorSetLayoutBinding, 2> bindings;
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = vk::DescriptorType::eCombinedImageSampler;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = vk::ShaderStageFlagBits::eCompute;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = vk::DescriptorType::eStorageImage;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = vk::ShaderStageFlagBits::eCompute;
+
+    vk::DescriptorSetLayoutCreateInfo layoutInfo;
+    layoutInfo.bindingCount = bindings.size();
+    layoutInfo.pBindings = bindings.data();
+    _descriptorSetLayout
+        = _context.device.createDescriptorSetLayout(layoutInfo);
+
+    std::array<vk::DescriptorPoolSize, 2> poolSizes;
+    poolSizes[0].type = vk::DescriptorType::eCombinedImageSampler;
+    poolSizes[0].descriptorCount = _levelCount;
+    poolSizes[1].type = vk::DescriptorType::eStorageImage;
+    poolSizes[1].descriptorCount = _levelCount;
+
+    vk::DescriptorPoolCreateInfo poolInfo;
+    poolInfo.poolSizeCount = poolSizes.size();
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = _levelCount;
+    _descriptorPool = _context.device.createDescriptorPool(poolInfo);
+
+    std::vector<vk::DescriptorSetLayout> layouts(_levelCount,
+                                                 _descriptorSetLayout);
+    vk::DescriptorSetAllocateInfo allocInfo;
+    allocInfo.descriptorPool = _descriptorPool;
+    allocInfo.descriptorSetCount = _levelCount;
+    allocInfo.pSetLayouts = layouts.data();
+    _descriptorSets = _context.device.allocateDescriptorSets(allocInfo);
+
+    for (uint32_t level = 0; level < _levelCount; ++level) {
+        vk::DescriptorImageInfo sourceInfo;
+        sourceInfo.sampler = _sampler;
+        if (level == 0) {
+            sourceInfo.imageView = _depthResources.depthImageView;
+            sourceInfo.imageLayout
+                = vk::ImageLayout::eDepthStencilReadOnlyOptimal;
+        } else {
+            sourceInfo.imageView = _levelViews[level - 1];
+            sourceInfo.imageLayout = vk::ImageLayout::eGeneral;
+        }
+
+        vk::DescriptorImageInfo destinationInfo;
+        destinationInfo.imageView = _levelViews[level];
+        destinationInfo.imageLayout = vk::ImageLayout::eGeneral;
+
+        std::array<vk::WriteDescriptorSet, 2> writes;
+        writes[0].dstSet = _descriptorSets[level];
+        writes[0].dstBinding = 0;
+        writes[0].descriptorType = vk::DescriptorType::eCombinedImageSampler;
+        writes[0].descriptorCount = 1;
+        writes[0].pImageInfo = &sourceInfo;
+        writes[1].dstSet = _descriptorSets[level];
+        writes[1].dstBinding = 1;
+        writes[1].descriptorType = vk::DescriptorType::eStorageImage;
+        writes[1].descriptorCount = 1;
+        writes[1].pImageInfo = &destinationInfo;
+        _context.device.updateDescriptorSets(writes, nullptr);
+    }
+}
+
+void DepthPyramid::_createPipeline() {
+    vk::PushConstantRange pushConstantRange;
+    pushConstantRange.stageFlags = vk::ShaderStageFlagBits::eCompute;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(ReduceLevel);
+
+    vk::PipelineLayoutCreateInfo layoutInfo;
+    layoutInfo.setLayoutCount = 1;
+    layoutInfo.pSetLayouts = &_descriptorSetLayout;
+    layoutInfo.pushConstantRangeCount = 1;
+    layoutInfo.pPushConstantRanges = &pushConstantRange;
+    _layout = _context.device.createPipelineLayout(layoutInfo);
+
+    auto module = _createShaderModule("shaders/depth_reduce.comp.spv");
+
+    vk::ComputePipelineCreateInfo pipelineInfo;
+    pipelineInfo.stage.stage = vk::ShaderStageFlagBits::eCompute;
+    pipelineInfo.stage.module = module;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = _layout;
+    _pipeline = _context.device.createComputePipeline(nullptr, pipelineInfo);
+
+    _context.device.destroy(module);
+}
+
+vk::ShaderModule DepthPyramid::_createShaderModule(const std::string& path) {
+    auto code = utils::readFile(path);
+
+    vk::ShaderModuleCreateInfo createInfo = {};
+    createInfo.codeSize = code.size();
+    createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+    return _context.device.createShaderModule(createInfo);
+}
+
+} // namespace vulkan
@@ -0,0 +1,122 @@
+#include "vulkan/draw_list.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+
+namespace vulkan {
+
+namespace {
+
+constexpr std::size_t minCapacity = 256;
+
+} // namespace
+
+DrawList::DrawList(BufferManager& bufferManager, std::size_t imageCount)
+    : _bufferManager(bufferManager), _images(imageCount) {
+}
+
+DrawList::~DrawList() {
+    for (auto& draws : _images) {
+        _destroyCommands(draws);
+        _destroyObjects(draws);
+    }
+}
+
+void DrawList::reset(uint32_t image, std::size_t drawCount,
+                     uint32_t maxInstanceCount) {
+    auto& draws = _images[image];
+    draws.commandCount = 0;
+    draws.objectCount = 0;
+    draws.instanceShift = 0;
+    while ((uint64_t(1) << draws.instanceShift) < maxInstanceCount) {
+        ++draws.instanceShift;
+    }
+    if ((uint64_t(drawCount) << draws.instanceShift)
+        > std::numeric_limits<uint32_t>::max()) {
+        throw std::runtime_error("too many instances drawn in a frame");
+    }
+
+    if (drawCount > draws.capacity) {
+        _destroyCommands(draws);
+        draws.capacity = std::max(minCapacity, drawCount + drawCount / 2);
+        draws.commands = _bufferManager.createBuffer(
+            draws.capacity * sizeof(vk::DrawIndexedIndirectCommand),
+            vk::BufferUsageFlagBits::eIndirectBuffer
+                | vk::BufferUsageFlagBits::eStorageBuffer,
+            VMA_MEMORY_USAGE_CPU_TO_GPU);
+
+        void* data;
+        vmaMapMemory(_bufferManager.allocator, draws.commands.allocation,
+                     &data);
+        draws.mappedCommands
+            = static_cast<vk::DrawIndexedIndirectCommand*>(data);
+    }
+
+    if (drawCount > draws.objectCapacity) {
+        _destroyObjects(draws);
+        draws.objectCapacity = std::max(minCapacity, drawCount + drawCount / 2);
+        draws.objects = _bufferManager.createBuffer(
+            draws.objectCapacity * sizeof(ObjectData),
+            vk::BufferUsageFlagBits::eStorageBuffer,
+            VMA_MEMORY_USAGE_CPU_TO_GPU);
+
+        void* data;
+        vmaMapMemory(_bufferManager.allocator, draws.objects.allocation,
+                     &data);
+        draws.mappedObjects = static_cast<ObjectData*>(data);
+    }
+}
+
+uint32_t DrawList::addInstances(uint32_t image, const Mesh& mesh,
+                                const glm::mat4& model) {
+    auto& draws = _images[image];
+    auto draw = draws.objectCount++;
+
+    ObjectData object{};
+    object.model = model;
+    object.decode = mesh.vertexDecode();
+    object.material = mesh.material();
+    object.firstInstance = mesh.firstInstanceData();
+    draws.mappedObjects[draw] = object;
+    return static_cast<uint32_t>(draw << draws.instanceShift);
+}
+
+void DrawList::addCommand(uint32_t image,
+                          const vk::DrawIndexedIndirectCommand& command) {
+    auto& draws = _images[image];
+    draws.mappedCommands[draws.commandCount++] = command;
+}
+
+void DrawList::flush(uint32_t image) {
+    auto& draws = _images[image];
+    if (draws.capacity > 0) {
+        vmaFlushAllocation(_bufferManager.allocator, draws.commands.allocation,
+                           0, VK_WHOLE_SIZE);
+    }
+    if (draws.objectCapacity > 0) {
+        vmaFlushAllocation(_bufferManager.allocator, draws.objects.allocation,
+                           0, VK_WHOLE_SIZE);
+    }
+}
+
+void DrawList::_destroyCommands(ImageDraws& draws) {
+    if (draws.capacity == 0) {
+        return;
+    }
+    vmaUnmapMemory(_bufferManager.allocator, draws.commands.allocation);
+    _bufferManager.destroyBuffer(draws.commands);
+    draws.capacity = 0;
+}
+
+void DrawList::_destroyObjects(ImageDraws& draws) {
+    if (draws.objectCapacity == 0) {
+        return;
+    }
+    vmaUnmapMemory(_bufferManager.allocator, draws.objects.allocation);
+    _bufferManager.destroyBuffer(draws.objects);
+    draws.objectCapacity = 0;
+}
+
+} // namespace vulkan
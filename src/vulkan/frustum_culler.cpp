@@ -0,0 +1,155 @@
+#include "vulkan/frustum_culler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace vulkan {
+
+namespace {
+
+#if defined(__AVX__)
+constexpr std::size_t batchSize = 8;
+#elif defined(__SSE2__)
+constexpr std::size_t batchSize = 4;
+#else
+constexpr std::size_t batchSize = 1;
+
+// A mesh is outside when one plane has both volumes behind it. The box
+// reaches dot(|n|, extents) towards the plane, the sphere radius, so the
+// tighter of the two decides.
+bool outside(const glm::vec4& plane, float x, float y, float z, float radius,
+             float ex, float ey, float ez) {
+    float distance = plane.x * x + plane.y * y + plane.z * z + plane.w;
+    float boxRadius = std::abs(plane.x) * ex + std::abs(plane.y) * ey
+                      + std::abs(plane.z) * ez;
+    return distance + std::min(radius, boxRadius) < 0.0f;
+}
+#endif
+
+} // namespace
+
+void FrustumCuller::clear() {
+    for (auto* array : {&_centerX, &_centerY, &_centerZ, &_radius, &_extentX,
+                        &_extentY, &_extentZ}) {
+        array->clear();
+    }
+    _count = 0;
+}
+
+void FrustumCuller::add(const std::vector<MeshBounds>& bounds,
+                        std::size_t first, std::size_t count) {
+    auto padded = _count + count + batchSize - 1;
+    for (auto* array : {&_centerX, &_centerY, &_centerZ, &_radius, &_extentX,
+                        &_extentY, &_extentZ}) {
+        array->resize(padded, 0.0f);
+    }
+
+    for (auto i = first; i < first + count; ++i) {
+        const auto& mesh = bounds[i];
+        _centerX[_count] = mesh.center.x;
+        _centerY[_count] = mesh.center.y;
+        _centerZ[_count] = mesh.center.z;
+        _radius[_count] = mesh.radius;
+        _extentX[_count] = mesh.extents.x;
+        _extentY[_count] = mesh.extents.y;
+        _extentZ[_count] = mesh.extents.z;
+        ++_count;
+    }
+}
+
+void FrustumCuller::cull(const glm::vec4 (&planes)[6], std::size_t first,
+                         std::size_t count,
+                         std::vector<uint32_t>& visible) const {
+    auto end = first + count;
+    // the SIMD paths test the planes like outside() does, one mesh per lane
+#if defined(__AVX__)
+    for (auto i = first; i < end; i += batchSize) {
+        auto x = _mm256_loadu_ps(&_centerX[i]);
+        auto y = _mm256_loadu_ps(&_centerY[i]);
+        auto z = _mm256_loadu_ps(&_centerZ[i]);
+        auto radius = _mm256_loadu_ps(&_radius[i]);
+        auto ex = _mm256_loadu_ps(&_extentX[i]);
+        auto ey = _mm256_loadu_ps(&_extentY[i]);
+        auto ez = _mm256_loadu_ps(&_extentZ[i]);
+
+        auto inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (const auto& plane : planes) {
+            auto distance = _mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.x), x),
+                              _mm256_mul_ps(_mm256_set1_ps(plane.y), y)),
+                _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.z), z),
+                              _mm256_set1_ps(plane.w)));
+            auto boxRadius = _mm256_add_ps(
+                _mm256_add_ps(
+                    _mm256_mul_ps(_mm256_set1_ps(std::abs(plane.x)), ex),
+                    _mm256_mul_ps(_mm256_set1_ps(std::abs(plane.y)), ey)),
+                _mm256_mul_ps(_mm256_set1_ps(std::abs(plane.z)), ez));
+            auto reach = _mm256_add_ps(distance,
+                                       _mm256_min_ps(radius, boxRadius));
+            inside = _mm256_and_ps(
+                inside,
+                _mm256_cmp_ps(reach, _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+
+        auto mask = static_cast<unsigned>(_mm256_movemask_ps(inside));
+        for (std::size_t k = 0; k < batchSize && i + k < end; ++k) {
+            if (mask & (1u << k)) {
+                visible.push_back(static_cast<uint32_t>(i + k));
+            }
+        }
+    }
+#elif defined(__SSE2__)
+    for (auto i = first; i < end; i += batchSize) {
+        auto x = _mm_loadu_ps(&_centerX[i]);
+        auto y = _mm_loadu_ps(&_centerY[i]);
+        auto z = _mm_loadu_ps(&_centerZ[i]);
+        auto radius = _mm_loadu_ps(&_radius[i]);
+        auto ex = _mm_loadu_ps(&_extentX[i]);
+        auto ey = _mm_loadu_ps(&_extentY[i]);
+        auto ez = _mm_loadu_ps(&_extentZ[i]);
+
+        auto inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (const auto& plane : planes) {
+            auto distance = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), x),
+                           _mm_mul_ps(_mm_set1_ps(plane.y), y)),
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), z),
+                           _mm_set1_ps(plane.w)));
+            auto boxRadius = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(std::abs(plane.x)), ex),
+                           _mm_mul_ps(_mm_set1_ps(std::abs(plane.y)), ey)),
+                _mm_mul_ps(_mm_set1_ps(std::abs(plane.z)), ez));
+            auto reach = _mm_add_ps(distance, _mm_min_ps(radius, boxRadius));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(reach, _mm_setzero_ps()));
+        }
+
+        auto mask = static_cast<unsigned>(_mm_movemask_ps(inside));
+        for (std::size_t k = 0; k < batchSize && i + k < end; ++k) {
+            if (mask & (1u << k)) {
+                visible.push_back(static_cast<uint32_t>(i + k));
+            }
+        }
+    }
+#else
+    for (auto i = first; i < end; ++i) {
+        bool inside = true;
+        for (const auto& plane : planes) {
+            if (outside(plane, _centerX[i], _centerY[i], _centerZ[i],
+                        _radius[i], _extentX[i], _extentY[i], _extentZ[i])) {
+                inside = false;
+                break;
+            }
+        }
+        if (inside) {
+            visible.push_back(static_cast<uint32_t>(i));
+        }
+    }
+#endif
+}
+
+} // namespace vulkan
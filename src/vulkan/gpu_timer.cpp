@@ -0,0 +1,70 @@
+#include "vulkan/gpu_timer.hpp"
+#include "vulkan/context.hpp"
+#include "vulkan/utils.hpp"
+
+namespace vulkan {
+
+GpuTimer::GpuTimer(Context& context, std::size_t imageCount)
+    : _context(context), _submitted(imageCount, false) {
+    auto indices
+        = utils::findQueueFamilies(_context.physicalDevice, _context.surface);
+    auto families = _context.physicalDevice.getQueueFamilyProperties();
+    if (families[indices.graphicsFamily.value()].timestampValidBits == 0) {
+        return;
+    }
+
+    _timestampPeriod
+        = _context.physicalDevice.getProperties().limits.timestampPeriod;
+
+    vk::QueryPoolCreateInfo createInfo;
+    createInfo.queryType = vk::QueryType::eTimestamp;
+    createInfo.queryCount = static_cast<uint32_t>(2 * imageCount);
+    _queryPool = _context.device.createQueryPool(createInfo);
+}
+
+GpuTimer::~GpuTimer() {
+    if (_queryPool) {
+        _context.device.destroy(_queryPool);
+    }
+}
+
+void GpuTimer::writeBegin(vk::CommandBuffer cmdBuffer, std::size_t image) {
+    if (!_queryPool) {
+        return;
+    }
+    auto first = static_cast<uint32_t>(2 * image);
+    cmdBuffer.resetQueryPool(_queryPool, first, 2);
+    cmdBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe,
+                             _queryPool, first);
+}
+
+void GpuTimer::writeEnd(vk::CommandBuffer cmdBuffer, std::size_t image) {
+    if (!_queryPool) {
+        return;
+    }
+    cmdBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe,
+                             _queryPool, static_cast<uint32_t>(2 * image + 1));
+}
+
+void GpuTimer::markSubmitted(std::size_t image) {
+    _submitted[image] = true;
+}
+
+std::optional<double> GpuTimer::read(std::size_t image) {
+    if (!_queryPool || !_submitted[image]) {
+        return {};
+    }
+
+    uint64_t timestamps[2];
+    auto result = vkGetQueryPoolResults(
+        _context.device, _queryPool, static_cast<uint32_t>(2 * image), 2,
+        sizeof(timestamps), timestamps, sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS) {
+        return {};
+    }
+    return static_cast<double>(timestamps[1] - timestamps[0])
+           * _timestampPeriod / 1e6;
+}
+
+} // namespace vulkan
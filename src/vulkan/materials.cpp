@@ -0,0 +1,157 @@
+#include "vulkan/materials.hpp"
+
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <map>
+
+#include "vulkan/context.hpp"
+#include "vulkan/upload_batch.hpp"
+
+namespace vulkan {
+
+Materials::Materials(Context& context, BufferManager& bufferManager)
+    : _context(context), _bufferManager(bufferManager) {
+    _descriptorSetLayout = _createDescriptorSetLayout();
+    set({scene::MaterialData{}});
+}
+
+Materials::~Materials() {
+    _destroy();
+    _context.device.destroy(_descriptorSetLayout);
+}
+
+void Materials::set(const std::vector<scene::MaterialData>& materials) {
+    if (materials.empty()) {
+        set({scene::MaterialData{}});
+        return;
+    }
+    _destroy();
+
+    // every texture and the constants in a single submit
+    UploadBatch batch(_bufferManager);
+    const stbi_uc white[4] = {255, 255, 255, 255};
+    _textures.push_back(std::make_unique<Texture>(white, 1, 1, _bufferManager,
+                                                  _context, &batch));
+
+    // texture of each material, shared by the materials with the same path
+    std::map<std::string, std::size_t> texturePaths;
+    std::vector<std::size_t> textures;
+    std::vector<MaterialConstants> constants;
+    for (const auto& material : materials) {
+        constants.push_back({glm::vec4(material.diffuse, 1.0f)});
+        if (material.diffuseTexture.empty()) {
+            textures.push_back(0);
+            continue;
+        }
+
+        auto found = texturePaths.find(material.diffuseTexture);
+        if (found == texturePaths.end()) {
+            std::size_t index = 0;
+            try {
+                _textures.push_back(std::make_unique<Texture>(
+                    material.diffuseTexture, _bufferManager, _context,
+                    &batch));
+                index = _textures.size() - 1;
+            } catch (std::exception& e) {
+                std::cerr << "materials: " << e.what() << std::endl;
+            }
+            found = texturePaths.emplace(material.diffuseTexture, index).first;
+        }
+        textures.push_back(found->second);
+    }
+
+    uint32_t mipLevels = 1;
+    for (const auto& texture : _textures) {
+        mipLevels = std::max(mipLevels, texture->mipLevels);
+    }
+    _sampler = std::make_unique<Sampler>(_context, mipLevels);
+    _constants = _bufferManager.createTwoLevelBuffer(
+        batch, constants, vk::BufferUsageFlagBits::eStorageBuffer);
+    batch.wait();
+
+    auto count = static_cast<uint32_t>(materials.size());
+    std::array<vk::DescriptorPoolSize, 2> poolSizes;
+    poolSizes[0].type = vk::DescriptorType::eCombinedImageSampler;
+    poolSizes[0].descriptorCount = count;
+    poolSizes[1].type = vk::DescriptorType::eStorageBuffer;
+    poolSizes[1].descriptorCount = count;
+
+    vk::DescriptorPoolCreateInfo poolInfo;
+    poolInfo.poolSizeCount = poolSizes.size();
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = count;
+    _descriptorPool = _context.device.createDescriptorPool(poolInfo);
+
+    std::vector<vk::DescriptorSetLayout> layouts(count, _descriptorSetLayout);
+    vk::DescriptorSetAllocateInfo allocInfo;
+    allocInfo.descriptorPool = _descriptorPool;
+    allocInfo.descriptorSetCount = count;
+    allocInfo.pSetLayouts = layouts.data();
+    _descriptorSets = _context.device.allocateDescriptorSets(allocInfo);
+
+    vk::DescriptorBufferInfo bufferInfo;
+    bufferInfo.buffer = _constants.buffer;
+    bufferInfo.offset = 0;
+    bufferInfo.range = VK_WHOLE_SIZE;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        vk::DescriptorImageInfo imageInfo;
+        imageInfo.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+        imageInfo.imageView = _textures[textures[i]]->textureImageView;
+        imageInfo.sampler = _sampler->sampler;
+
+        std::array<vk::WriteDescriptorSet, 2> writes;
+        writes[0].dstSet = _descriptorSets[i];
+        writes[0].dstBinding = 0;
+        writes[0].descriptorType = vk::DescriptorType::eCombinedImageSampler;
+        writes[0].descriptorCount = 1;
+        writes[0].pImageInfo = &imageInfo;
+        writes[1].dstSet = _descriptorSets[i];
+        writes[1].dstBinding = 1;
+        writes[1].descriptorType = vk::DescriptorType::eStorageBuffer;
+        writes[1].descriptorCount = 1;
+        writes[1].pBufferInfo = &bufferInfo;
+        _context.device.updateDescriptorSets(writes, nullptr);
+    }
+
+    std::cout << "materials: " << count << " materials, " << _textures.size()
+              << " textures\n";
+}
+
+void Materials::_destroy() {
+    if (!_descriptorSets.empty()) {
+        _context.device.destroy(_descriptorPool);
+        _descriptorSets.clear();
+        _bufferManager.destroyBuffer(_constants);
+    }
+    _textures.clear();
+    _sampler.reset();
+}
+
+vk::DescriptorSetLayout Materials::_createDescriptorSetLayout() {
+    vk::DescriptorSetLayoutBinding textureBinding;
+    textureBinding.binding = 0;
+    textureBinding.descriptorCount = 1;
+    textureBinding.descriptorType = vk::DescriptorType::eCombinedImageSampler;
+    textureBinding.pImmutableSamplers = nullptr;
+    textureBinding.stageFlags = vk::ShaderStageFlagBits::eFragment;
+
+    vk::DescriptorSetLayoutBinding constantsBinding;
+    constantsBinding.binding = 1;
+    constantsBinding.descriptorCount = 1;
+    constantsBinding.descriptorType = vk::DescriptorType::eStorageBuffer;
+    constantsBinding.pImmutableSamplers = nullptr;
+    constantsBinding.stageFlags = vk::ShaderStageFlagBits::eVertex;
+
+    std::array<vk::DescriptorSetLayoutBinding, 2> bindings
+        = {textureBinding, constantsBinding};
+
+    vk::DescriptorSetLayoutCreateInfo layoutInfo;
+    layoutInfo.bindingCount = bindings.size();
+    layoutInfo.pBindings = bindings.data();
+
+    return _context.device.createDescriptorSetLayout(layoutInfo);
+}
+
+} // namespace vulkan
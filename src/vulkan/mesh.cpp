@@ -1,7 +1,99 @@
 #include "vulkan/mesh.hpp"
+#include "vulkan/upload_batch.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <optional>
 
 namespace vulkan {
 
+namespace {
+
+int16_t quantizeSnorm(float value) {
+    return static_cast<int16_t>(
+        std::round(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+uint16_t quantizeUnorm(float value) {
+    return static_cast<uint16_t>(
+        std::round(std::clamp(value, 0.0f, 1.0f) * 65535.0f));
+}
+
+bool hasSingleColor(const MeshView& view) {
+    for (std::size_t i = 1; i < view.vertexCount; ++i) {
+        if (view.vertices[i].color != view.vertices[0].color) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<PackedVertex> packVertices(const MeshView& view,
+                                       VertexDecode& decode) {
+    const auto* vertices = view.vertices;
+    glm::vec3 minPos{0.0f}, maxPos{0.0f};
+    glm::vec2 minTexCoord{0.0f}, maxTexCoord{0.0f};
+    for (std::size_t i = 0; i < view.vertexCount; ++i) {
+        const auto& v = vertices[i];
+        minPos = i == 0 ? v.pos : glm::min(minPos, v.pos);
+        maxPos = i == 0 ? v.pos : glm::max(maxPos, v.pos);
+        minTexCoord = i == 0 ? v.texCoord : glm::min(minTexCoord, v.texCoord);
+        maxTexCoord = i == 0 ? v.texCoord : glm::max(maxTexCoord, v.texCoord);
+    }
+
+    auto center = (minPos + maxPos) * 0.5f;
+    auto halfExtent = (maxPos - minPos) * 0.5f;
+    auto texCoordExtent = maxTexCoord - minTexCoord;
+    decode.posOffset = glm::vec4(center, 0.0f);
+    decode.posScale = glm::vec4(halfExtent, 0.0f);
+    decode.texCoordOffset = minTexCoord;
+    decode.texCoordScale = texCoordExtent;
+    decode.color = view.vertexCount > 0 ? glm::vec4(vertices[0].color, 1.0f)
+                                        : glm::vec4(1.0f);
+
+    // flat axes keep a zero scale and quantize to 0
+    std::vector<PackedVertex> packed(view.vertexCount);
+    for (std::size_t i = 0; i < view.vertexCount; ++i) {
+        const auto& v = vertices[i];
+        for (int k = 0; k < 3; ++k) {
+            packed[i].pos[k] = halfExtent[k] > 0.0f
+                                   ? quantizeSnorm((v.pos[k] - center[k])
+                                                   / halfExtent[k])
+                                   : 0;
+        }
+        packed[i].pos[3] = 0;
+        for (int k = 0; k < 2; ++k) {
+            packed[i].texCoord[k]
+                = texCoordExtent[k] > 0.0f
+                      ? quantizeUnorm((v.texCoord[k] - minTexCoord[k])
+                                      / texCoordExtent[k])
+                      : 0;
+        }
+    }
+    return packed;
+}
+
+} // namespace
+
+float maxScale(const glm::mat4& model) {
+    glm::mat3 linear{model};
+    return std::max({glm::length(linear[0]), glm::length(linear[1]),
+                     glm::length(linear[2])});
+}
+
+MeshBounds transformBounds(const MeshBounds& bounds, const glm::mat4& model) {
+    MeshBounds result;
+    result.center = model * glm::vec4(bounds.center, 1.0f);
+    result.radius = bounds.radius * maxScale(model);
+    glm::mat3 linear{model};
+    result.extents = glm::vec3(0.0f);
+    for (int axis = 0; axis < 3; ++axis) {
+        result.extents += glm::abs(linear[axis]) * bounds.extents[axis];
+    }
+    return result;
+}
+
 vk::VertexInputBindingDescription Vertex::getBindingDescription() {
     vk::VertexInputBindingDescription bindingDescription = {};
 
@@ -19,12 +111,12 @@ Vertex::getAttributeDescriptions() {
 
     attributeDescriptions[0].binding = 0;
     attributeDescriptions[0].location = 0;
-    attributeDescriptions[0].format = vk::Format::eR32G32B32A32Sfloat;
+    attributeDescriptions[0].format = vk::Format::eR32G32B32Sfloat;
     attributeDescriptions[0].offset = offsetof(Vertex, pos);
 
     attributeDescriptions[1].binding = 0;
     attributeDescriptions[1].location = 1;
-    attributeDescriptions[1].format = vk::Format::eR32G32B32A32Sfloat;
+    attributeDescriptions[1].format = vk::Format::eR32G32B32Sfloat;
     attributeDescriptions[1].offset = offsetof(Vertex, color);
 
     attributeDescriptions[2].binding = 0;
@@ -39,33 +131,249 @@ bool operator==(const Vertex& a, const Vertex& b) {
     return a.pos == b.pos && a.color == b.color && a.texCoord == b.texCoord;
 }
 
+bool operator==(const GeometryBinding& a, const GeometryBinding& b) {
+    return a.vertexBuffer == b.vertexBuffer && a.indexBuffer == b.indexBuffer
+           && a.indexType == b.indexType;
+}
+
+bool operator!=(const GeometryBinding& a, const GeometryBinding& b) {
+    return !(a == b);
+}
+
+vk::VertexInputBindingDescription PackedVertex::getBindingDescription() {
+    vk::VertexInputBindingDescription bindingDescription = {};
+
+    bindingDescription.binding = 0;
+    bindingDescription.stride = sizeof(PackedVertex);
+    bindingDescription.inputRate = vk::VertexInputRate::eVertex;
+
+    return bindingDescription;
+}
+
+std::array<vk::VertexInputAttributeDescription, 2>
+PackedVertex::getAttributeDescriptions() {
+    std::array<vk::VertexInputAttributeDescription, 2> attributeDescriptions
+        = {};
+
+    attributeDescriptions[0].binding = 0;
+    attributeDescriptions[0].location = 0;
+    attributeDescriptions[0].format = vk::Format::eR16G16B16A16Snorm;
+    attributeDescriptions[0].offset = offsetof(PackedVertex, pos);
+
+    attributeDescriptions[1].binding = 0;
+    attributeDescriptions[1].location = 2;
+    attributeDescriptions[1].format = vk::Format::eR16G16Unorm;
+    attributeDescriptions[1].offset = offsetof(PackedVertex, texCoord);
+
+    return attributeDescriptions;
+}
+
 Mesh::Mesh(BufferManager& bufferManager, std::vector<Vertex> vertices,
            std::vector<uint32_t> indices)
-    : _bufferManager(bufferManager) {
+    : Mesh(bufferManager,
+           MeshView{vertices.data(), vertices.size(), indices.data(),
+                    indices.size(), nullptr, 0, nullptr, 0, nullptr, 0,
+                    nullptr, 0}) {
+}
+
+Mesh::Mesh(BufferManager& bufferManager, const MeshView& view,
+           VertexFormat format, UploadBatch* batch)
+    : _bufferManager(bufferManager), _vertexFormat(format), _decode() {
+
+    // waited for when it goes out of scope
+    std::optional<UploadBatch> ownBatch;
+    if (!batch) {
+        batch = &ownBatch.emplace(_bufferManager);
+    }
+
+    if (_vertexFormat == VertexFormat::Packed && !hasSingleColor(view)) {
+        _vertexFormat = VertexFormat::Full;
+    }
+    if (_vertexFormat == VertexFormat::Packed) {
+        _vertexRange = _bufferManager.uploadGeometry(
+            *batch, packVertices(view, _decode));
+        _vertexOffset
+            = static_cast<int32_t>(_vertexRange.offset / sizeof(PackedVertex));
+    } else {
+        _vertexRange = _bufferManager.uploadGeometry(*batch, view.vertices,
+                                                     view.vertexCount);
+        _vertexOffset
+            = static_cast<int32_t>(_vertexRange.offset / sizeof(Vertex));
+    }
 
-    vertexBuffer = _bufferManager.createTwoLevelBuffer(
-        vertices, vk::BufferUsageFlagBits::eVertexBuffer);
+    if (view.vertexCount <= maxShortIndexVertices) {
+        std::vector<uint16_t> shortIndices(view.indices,
+                                           view.indices + view.indexCount);
+        _indexRange = _bufferManager.uploadGeometry(*batch, shortIndices);
+        _firstIndex
+            = static_cast<uint32_t>(_indexRange.offset / sizeof(uint16_t));
+        _indexType = vk::IndexType::eUint16;
+    } else {
+        _indexRange = _bufferManager.uploadGeometry(*batch, view.indices,
+                                                    view.indexCount);
+        _firstIndex
+            = static_cast<uint32_t>(_indexRange.offset / sizeof(uint32_t));
+        _indexType = vk::IndexType::eUint32;
+    }
 
-    indexBuffer = _bufferManager.createTwoLevelBuffer(
-        indices, vk::BufferUsageFlagBits::eIndexBuffer);
+    if (view.lodCount > 0) {
+        _lods.assign(view.lods, view.lods + view.lodCount);
+    } else {
+        _lods.push_back({0, static_cast<uint32_t>(view.indexCount), 0.0f});
+    }
 
-    indexCount = static_cast<uint32_t>(indices.size());
+    if (view.meshletCount > 0) {
+        _meshlets.meshlets = _bufferManager.createTwoLevelBuffer(
+            *batch, view.meshlets, view.meshletCount,
+            vk::BufferUsageFlagBits::eStorageBuffer);
+        _meshlets.vertices = _bufferManager.createTwoLevelBuffer(
+            *batch, view.meshletVertices, view.meshletVertexCount,
+            vk::BufferUsageFlagBits::eStorageBuffer);
+        _meshlets.triangles = _bufferManager.createTwoLevelBuffer(
+            *batch, view.meshletTriangles, view.meshletTriangleCount,
+            vk::BufferUsageFlagBits::eStorageBuffer);
+        _meshlets.meshletCount = static_cast<uint32_t>(view.meshletCount);
+    }
+
+    const auto* vertices = view.vertices;
+    glm::vec3 minPos{0.0f}, maxPos{0.0f};
+    for (std::size_t i = 0; i < view.vertexCount; ++i) {
+        minPos = i == 0 ? vertices[i].pos : glm::min(minPos, vertices[i].pos);
+        maxPos = i == 0 ? vertices[i].pos : glm::max(maxPos, vertices[i].pos);
+    }
+    _bounds.center = (minPos + maxPos) * 0.5f;
+    _bounds.extents = (maxPos - minPos) * 0.5f;
+    _bounds.radius = 0.0f;
+    for (std::size_t i = 0; i < view.vertexCount; ++i) {
+        _bounds.radius = std::max(
+            _bounds.radius, glm::distance(_bounds.center, vertices[i].pos));
+    }
 }
 
 Mesh::~Mesh() {
-    _bufferManager.destroyBuffer(vertexBuffer);
-    _bufferManager.destroyBuffer(indexBuffer);
+    _bufferManager.freeGeometry(_vertexRange);
+    _bufferManager.freeGeometry(_indexRange);
+    if (_meshlets.meshletCount > 0) {
+        _bufferManager.destroyBuffer(_meshlets.meshlets);
+        _bufferManager.destroyBuffer(_meshlets.vertices);
+        _bufferManager.destroyBuffer(_meshlets.triangles);
+    }
+    if (_instanceCount > 0) {
+        _bufferManager.freeInstances(_instances);
+    }
+}
+
+void Mesh::setInstances(const std::vector<InstanceData>& instances) {
+    if (_instanceCount > 0) {
+        _bufferManager.freeInstances(_instances);
+        _instanceCount = 0;
+    }
+    if (instances.empty()) {
+        return;
+    }
+    // read by the vertex shaders from there, see DrawList
+    _instances = _bufferManager.allocateInstances(
+        instances.data(), instances.size() * sizeof(InstanceData),
+        sizeof(InstanceData));
+    _instanceCount = static_cast<uint32_t>(instances.size());
+
+    // box around the transformed box of every instance, and a sphere around
+    // their transformed spheres
+    std::vector<MeshBounds> placed;
+    placed.reserve(instances.size());
+    glm::vec3 minPos{std::numeric_limits<float>::max()};
+    glm::vec3 maxPos{std::numeric_limits<float>::lowest()};
+    for (const auto& instance : instances) {
+        placed.push_back(transformBounds(_bounds, instance.model));
+        minPos = glm::min(minPos, placed.back().center - placed.back().extents);
+        maxPos = glm::max(maxPos, placed.back().center + placed.back().extents);
+    }
+    _instanceBounds.center = (minPos + maxPos) * 0.5f;
+    _instanceBounds.extents = (maxPos - minPos) * 0.5f;
+    _instanceBounds.radius = 0.0f;
+    for (const auto& bounds : placed) {
+        _instanceBounds.radius = std::max(
+            _instanceBounds.radius,
+            glm::distance(_instanceBounds.center, bounds.center)
+                + bounds.radius);
+    }
+}
+
+uint32_t Mesh::firstInstanceData() const {
+    if (_instanceCount == 0) {
+        return noInstances;
+    }
+    return static_cast<uint32_t>(_instances.offset / sizeof(InstanceData));
+}
+
+std::size_t Mesh::selectLod(const LodView& view,
+                            const glm::mat4& model) const {
+    // with instances, at least as fine as the closest copy needs. The
+    // errors are in mesh space, scaled like the mesh.
+    auto bounds = transformBounds(this->bounds(), model);
+    auto scale = maxScale(model);
+    auto distance = glm::distance(view.cameraPosition, bounds.center)
+                    - bounds.radius;
+    if (distance <= 0.0f) {
+        return 0;
+    }
+
+    for (auto level = _lods.size() - 1; level > 0; --level) {
+        auto pixels
+            = _lods[level].error * scale * view.projectionScale / distance;
+        if (pixels <= view.maxPixelError) {
+            return level;
+        }
+    }
+    return 0;
+}
+
+GeometryBinding Mesh::geometryBinding() const {
+    return GeometryBinding{_vertexRange.buffer, _indexRange.buffer,
+                           _indexType};
 }
 
-void Mesh::writeCmdBuffer(vk::CommandBuffer cmdBuffer,
-                          vk::DescriptorSet descriptorSet,
-                          vk::PipelineLayout pipelineLayout) const {
-    cmdBuffer.bindVertexBuffers(0, vertexBuffer.buffer, {0});
-    cmdBuffer.bindIndexBuffer(indexBuffer.buffer, 0, vk::IndexType::eUint32);
-    cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
-                                 pipelineLayout, 0, descriptorSet, nullptr);
+uint32_t Mesh::geometryId() const {
+    // the buffers are the blocks of the geometry arena
+    auto is32 = _indexType == vk::IndexType::eUint32 ? 1u : 0u;
+    return static_cast<uint32_t>(_vertexRange.block << 7
+                                 | _indexRange.block << 1)
+           | is32;
+}
+
+void Mesh::bindGeometry(vk::CommandBuffer cmdBuffer) const {
+    // bound at offset 0, the draws add the offsets of the mesh
+    cmdBuffer.bindVertexBuffers(0, _vertexRange.buffer, {0});
+    cmdBuffer.bindIndexBuffer(_indexRange.buffer, 0, _indexType);
+}
+
+vk::DrawIndexedIndirectCommand Mesh::drawCommand(std::size_t lod,
+                                                uint32_t firstInstance) const {
+    vk::DrawIndexedIndirectCommand command;
+    command.indexCount = _lods[lod].indexCount;
+    command.instanceCount = instanceCount();
+    command.firstIndex = _firstIndex + _lods[lod].firstIndex;
+    command.vertexOffset = _vertexOffset;
+    command.firstInstance = firstInstance;
+    return command;
+}
+
+void Mesh::writeCmdBuffer(vk::CommandBuffer cmdBuffer, std::size_t lod,
+                          uint32_t firstInstance) const {
+    auto command = drawCommand(lod, firstInstance);
+    vkCmdDrawIndexed(cmdBuffer, command.indexCount, command.instanceCount,
+                     command.firstIndex, command.vertexOffset,
+                     command.firstInstance);
+}
 
-    vkCmdDrawIndexed(cmdBuffer, indexCount, 1, 0, 0, 0);
+void Mesh::writeCulledCmdBuffer(vk::CommandBuffer cmdBuffer,
+                                vk::Buffer indexBuffer,
+                                vk::Buffer indirectBuffer,
+                                vk::DeviceSize commandOffset) const {
+    cmdBuffer.bindIndexBuffer(indexBuffer, 0, _indexType);
+    // the culling writes the first index, vertex offset and first instance
+    // of the draw
+    cmdBuffer.drawIndexedIndirect(indirectBuffer, commandOffset, 1, 0);
 }
 
 } // namespace vulkan
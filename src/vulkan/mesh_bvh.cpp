@@ -0,0 +1,367 @@
+#include "vulkan/mesh_bvh.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace vulkan {
+
+namespace {
+
+constexpr std::size_t binCount = 16;
+// one AVX batch of the FrustumCuller
+constexpr uint32_t maxLeafMeshes = 8;
+// smaller subtrees are built by the task of their parent
+constexpr uint32_t minTaskMeshes = 256;
+
+struct Box {
+    glm::vec3 min{std::numeric_limits<float>::max()};
+    glm::vec3 max{std::numeric_limits<float>::lowest()};
+
+    void grow(const glm::vec3& point) {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+    void grow(const Box& box) {
+        min = glm::min(min, box.min);
+        max = glm::max(max, box.max);
+    }
+    float area() const {
+        auto size = max - min;
+        if (size.x < 0.0f || size.y < 0.0f || size.z < 0.0f) {
+            return 0.0f;
+        }
+        return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+};
+
+Box meshBox(const MeshBounds& bounds) {
+    return {bounds.center - bounds.extents, bounds.center + bounds.extents};
+}
+
+// distance along the ray to where it enters the box, none if it misses it
+// or the box is behind the origin
+std::optional<float> enterBox(const Ray& ray, const glm::vec3& inverseDir,
+                              const glm::vec3& min, const glm::vec3& max) {
+    auto t1 = (min - ray.origin) * inverseDir;
+    auto t2 = (max - ray.origin) * inverseDir;
+    auto near = glm::min(t1, t2);
+    auto far = glm::max(t1, t2);
+    auto entry = std::max({near.x, near.y, near.z, 0.0f});
+    auto exit = std::min({far.x, far.y, far.z});
+    if (entry > exit) {
+        return {};
+    }
+    return entry;
+}
+
+} // namespace
+
+void MeshBvh::build(const std::vector<MeshBounds>& bounds,
+                    scene::ThreadPool& pool) {
+    _nodes.clear();
+    _order.resize(bounds.size());
+    std::iota(_order.begin(), _order.end(), 0);
+    _leafCuller.clear();
+    _leafBounds.clear();
+    if (bounds.empty()) {
+        return;
+    }
+
+    Box root;
+    for (const auto& mesh : bounds) {
+        root.grow(meshBox(mesh));
+    }
+    _nodes.push_back(
+        {root.min, 0, root.max, static_cast<uint32_t>(bounds.size()), 0});
+
+    // the first levels are split here until there are enough subtrees to
+    // keep the pool busy, subtrees work on disjoint ranges of _order
+    std::vector<std::size_t> frontier{0};
+    while (frontier.size() < 2 * pool.size()) {
+        std::vector<std::size_t> next;
+        bool split = false;
+        for (auto node : frontier) {
+            if (_nodes[node].count < minTaskMeshes) {
+                next.push_back(node);
+                continue;
+            }
+            _split(_nodes, node, bounds);
+            if (_nodes[node].left != 0) {
+                next.push_back(_nodes[node].left);
+                next.push_back(_nodes[node].left + 1);
+                split = true;
+            }
+        }
+        frontier = std::move(next);
+        if (!split) {
+            break;
+        }
+    }
+
+    std::vector<std::vector<Node>> subtrees(frontier.size());
+    pool.parallelFor(frontier.size(), [&](std::size_t i) {
+        subtrees[i].push_back(_nodes[frontier[i]]);
+        _buildSubtree(subtrees[i], bounds);
+    });
+
+    // node 0 of a subtree is its frontier node, the others go at the end
+    for (std::size_t i = 0; i < frontier.size(); ++i) {
+        auto base = static_cast<uint32_t>(_nodes.size());
+        auto relocate = [base](Node node) {
+            if (node.left != 0) {
+                node.left = base + node.left - 1;
+            }
+            return node;
+        };
+        _nodes[frontier[i]] = relocate(subtrees[i][0]);
+        for (std::size_t j = 1; j < subtrees[i].size(); ++j) {
+            _nodes.push_back(relocate(subtrees[i][j]));
+        }
+    }
+
+    _leafBounds.reserve(bounds.size());
+    for (auto index : _order) {
+        _leafBounds.push_back(bounds[index]);
+    }
+    _leafCuller.add(_leafBounds, 0, _leafBounds.size());
+}
+
+void MeshBvh::refit(const std::vector<MeshBounds>& bounds) {
+    for (std::size_t i = 0; i < _order.size(); ++i) {
+        _leafBounds[i] = bounds[_order[i]];
+    }
+    _leafCuller.clear();
+    _leafCuller.add(_leafBounds, 0, _leafBounds.size());
+
+    // children always come after their parent
+    for (auto node = _nodes.rbegin(); node != _nodes.rend(); ++node) {
+        Box box;
+        if (node->left == 0) {
+            for (auto i = node->first; i < node->first + node->count; ++i) {
+                box.grow(meshBox(_leafBounds[i]));
+            }
+        } else {
+            box.grow(Box{_nodes[node->left].min, _nodes[node->left].max});
+            box.grow(
+                Box{_nodes[node->left + 1].min, _nodes[node->left + 1].max});
+        }
+        node->min = box.min;
+        node->max = box.max;
+    }
+}
+
+void MeshBvh::_buildSubtree(std::vector<Node>& nodes,
+                            const std::vector<MeshBounds>& bounds) {
+    std::vector<std::size_t> stack{0};
+    while (!stack.empty()) {
+        auto node = stack.back();
+        stack.pop_back();
+        _split(nodes, node, bounds);
+        if (nodes[node].left != 0) {
+            stack.push_back(nodes[node].left);
+            stack.push_back(nodes[node].left + 1);
+        }
+    }
+}
+
+void MeshBvh::_split(std::vector<Node>& nodes, std::size_t node,
+                     const std::vector<MeshBounds>& bounds) {
+    auto first = nodes[node].first;
+    auto count = nodes[node].count;
+    if (count <= 2) {
+        return;
+    }
+    auto begin = _order.begin() + first;
+    auto end = begin + count;
+
+    Box centroids;
+    for (auto it = begin; it != end; ++it) {
+        centroids.grow(bounds[*it].center);
+    }
+    auto extent = centroids.max - centroids.min;
+    auto binOf = [&](uint32_t mesh, int axis) {
+        auto bin = static_cast<std::size_t>(
+            (bounds[mesh].center[axis] - centroids.min[axis]) * binCount
+            / extent[axis]);
+        return std::min(bin, binCount - 1);
+    };
+
+    // cost of a leaf is one test per mesh, of a split one test for the node
+    // plus the meshes of each child weighted by the chance of reaching it
+    Box nodeBox{nodes[node].min, nodes[node].max};
+    auto bestCost = static_cast<float>(count);
+    int bestAxis = -1;
+    std::size_t bestBin = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+        if (extent[axis] <= 0.0f) {
+            continue;
+        }
+        std::array<Box, binCount> boxes;
+        std::array<uint32_t, binCount> counts{};
+        for (auto it = begin; it != end; ++it) {
+            auto bin = binOf(*it, axis);
+            boxes[bin].grow(meshBox(bounds[*it]));
+            ++counts[bin];
+        }
+
+        std::array<float, binCount> rightCost{};
+        Box right;
+        uint32_t rightCount = 0;
+        for (auto bin = binCount - 1; bin > 0; --bin) {
+            right.grow(boxes[bin]);
+            rightCount += counts[bin];
+            rightCost[bin] = right.area() * rightCount;
+        }
+        Box left;
+        uint32_t leftCount = 0;
+        for (std::size_t bin = 1; bin < binCount; ++bin) {
+            left.grow(boxes[bin - 1]);
+            leftCount += counts[bin - 1];
+            if (leftCount == 0 || leftCount == count) {
+                continue;
+            }
+            auto cost = 1.0f
+                        + (left.area() * leftCount + rightCost[bin])
+                              / std::max(nodeBox.area(), 1e-12f);
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = bin;
+            }
+        }
+    }
+
+    decltype(begin) middle;
+    if (bestAxis >= 0) {
+        middle = std::partition(begin, end, [&](uint32_t mesh) {
+            return binOf(mesh, bestAxis) < bestBin;
+        });
+    } else if (count > maxLeafMeshes) {
+        // too many meshes for a leaf but no split pays off, e.g. they all
+        // share a centroid: halve along the longest axis
+        auto axis = extent.x >= extent.y && extent.x >= extent.z ? 0
+                    : extent.y >= extent.z                      ? 1
+                                                                : 2;
+        middle = begin + count / 2;
+        std::nth_element(begin, middle, end, [&](uint32_t a, uint32_t b) {
+            return bounds[a].center[axis] < bounds[b].center[axis];
+        });
+    } else {
+        return;
+    }
+
+    auto leftCount = static_cast<uint32_t>(middle - begin);
+    Box leftBox, rightBox;
+    for (auto it = begin; it != middle; ++it) {
+        leftBox.grow(meshBox(bounds[*it]));
+    }
+    for (auto it = middle; it != end; ++it) {
+        rightBox.grow(meshBox(bounds[*it]));
+    }
+    nodes[node].left = static_cast<uint32_t>(nodes.size());
+    nodes.push_back({leftBox.min, first, leftBox.max, leftCount, 0});
+    nodes.push_back({rightBox.min, first + leftCount, rightBox.max,
+                     count - leftCount, 0});
+}
+
+void MeshBvh::cull(const glm::vec4 (&planes)[6],
+                   std::vector<uint32_t>& visible) const {
+    if (!_nodes.empty()) {
+        _cullNode(0, planes, (1u << 6) - 1, visible);
+    }
+}
+
+void MeshBvh::_cullNode(uint32_t index, const glm::vec4 (&planes)[6],
+                        uint32_t planeMask,
+                        std::vector<uint32_t>& visible) const {
+    const auto& node = _nodes[index];
+    auto center = (node.min + node.max) * 0.5f;
+    auto extents = (node.max - node.min) * 0.5f;
+    for (uint32_t p = 0; p < 6; ++p) {
+        if (!(planeMask & (1u << p))) {
+            continue;
+        }
+        auto normal = glm::vec3(planes[p]);
+        auto distance = glm::dot(normal, center) + planes[p].w;
+        auto radius = glm::dot(glm::abs(normal), extents);
+        if (distance + radius < 0.0f) {
+            return;
+        }
+        // the children are inside this plane too
+        if (distance - radius >= 0.0f) {
+            planeMask &= ~(1u << p);
+        }
+    }
+
+    if (planeMask == 0) {
+        visible.insert(visible.end(), _order.begin() + node.first,
+                       _order.begin() + node.first + node.count);
+    } else if (node.left == 0) {
+        auto start = visible.size();
+        _leafCuller.cull(planes, node.first, node.count, visible);
+        for (auto i = start; i < visible.size(); ++i) {
+            visible[i] = _order[visible[i]];
+        }
+    } else {
+        _cullNode(node.left, planes, planeMask, visible);
+        _cullNode(node.left + 1, planes, planeMask, visible);
+    }
+}
+
+std::optional<RayHit> MeshBvh::raycast(const Ray& ray) const {
+    if (_nodes.empty()) {
+        return {};
+    }
+
+    // divisions by zero give infinities, which the slab test handles
+    auto inverseDir = 1.0f / ray.direction;
+    std::optional<RayHit> hit;
+    auto closest = std::numeric_limits<float>::max();
+
+    std::vector<uint32_t> stack{0};
+    while (!stack.empty()) {
+        const auto& node = _nodes[stack.back()];
+        stack.pop_back();
+        auto entry = enterBox(ray, inverseDir, node.min, node.max);
+        if (!entry || *entry >= closest) {
+            continue;
+        }
+
+        if (node.left == 0) {
+            for (auto i = node.first; i < node.first + node.count; ++i) {
+                const auto& bounds = _leafBounds[i];
+                auto meshEntry
+                    = enterBox(ray, inverseDir, bounds.center - bounds.extents,
+                               bounds.center + bounds.extents);
+                if (meshEntry && *meshEntry < closest) {
+                    closest = *meshEntry;
+                    hit = RayHit{_order[i], closest};
+                }
+            }
+            continue;
+        }
+
+        // the nearest child is popped first, which prunes more of the other
+        const auto& left = _nodes[node.left];
+        const auto& right = _nodes[node.left + 1];
+        auto leftEntry = enterBox(ray, inverseDir, left.min, left.max);
+        auto rightEntry = enterBox(ray, inverseDir, right.min, right.max);
+        if (leftEntry && rightEntry && *leftEntry < *rightEntry) {
+            stack.push_back(node.left + 1);
+            stack.push_back(node.left);
+        } else {
+            if (leftEntry) {
+                stack.push_back(node.left);
+            }
+            if (rightEntry) {
+                stack.push_back(node.left + 1);
+            }
+        }
+    }
+    return hit;
+}
+
+} // namespace vulkan
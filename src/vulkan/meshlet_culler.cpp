@@ -0,0 +1,326 @@
+#include "vulkan/meshlet_culler.hpp"
+#include "vulkan/context.hpp"
+#include "vulkan/utils.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace vulkan {
+
+namespace {
+
+constexpr uint32_t workGroupSize = 64;
+constexpr uint32_t descriptorSetsPerPool = 64;
+// meshlets, meshlet vertices and meshlet triangles
+constexpr uint32_t meshBindingCount = 3;
+// index list and draw commands
+constexpr uint32_t imageBindingCount = 2;
+
+// view with the planes and the camera in the space of a mesh placed by model
+CullView meshSpaceView(const CullView& view, const glm::mat4& model) {
+    CullView result = view;
+    // a point p of the mesh is at model * p in the world
+    auto transposed = glm::transpose(model);
+    for (auto& plane : result.planes) {
+        plane = transposed * plane;
+        plane /= glm::length(glm::vec3(plane));
+    }
+    result.cameraPosition
+        = glm::inverse(model) * glm::vec4(view.cameraPosition, 1.0f);
+    return result;
+}
+
+} // namespace
+
+bool MeshletCuller::canCull(const glm::mat4& model) {
+    glm::mat3 linear{model};
+    auto x = glm::dot(linear[0], linear[0]);
+    auto y = glm::dot(linear[1], linear[1]);
+    auto z = glm::dot(linear[2], linear[2]);
+    auto tolerance = 1e-4f * x;
+    return std::abs(x - y) <= tolerance && std::abs(x - z) <= tolerance
+           && std::abs(glm::dot(linear[0], linear[1])) <= tolerance
+           && std::abs(glm::dot(linear[0], linear[2])) <= tolerance
+           && std::abs(glm::dot(linear[1], linear[2])) <= tolerance;
+}
+
+MeshletCuller::MeshletCuller(Context& context, BufferManager& bufferManager)
+    : _context(context), _bufferManager(bufferManager) {
+    _meshSetLayout = _createDescriptorSetLayout(meshBindingCount);
+    _imageSetLayout = _createDescriptorSetLayout(imageBindingCount);
+
+    vk::PushConstantRange pushConstantRange;
+    pushConstantRange.stageFlags = vk::ShaderStageFlagBits::eCompute;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(CullView);
+
+    std::array<vk::DescriptorSetLayout, 2> setLayouts
+        = {_meshSetLayout, _imageSetLayout};
+    vk::PipelineLayoutCreateInfo layoutInfo;
+    layoutInfo.setLayoutCount = setLayouts.size();
+    layoutInfo.pSetLayouts = setLayouts.data();
+    layoutInfo.pushConstantRangeCount = 1;
+    layoutInfo.pPushConstantRanges = &pushConstantRange;
+    _layout = _context.device.createPipelineLayout(layoutInfo);
+
+    auto module = _createShaderModule("shaders/meshlet_cull.comp.spv");
+
+    vk::ComputePipelineCreateInfo pipelineInfo;
+    pipelineInfo.stage.stage = vk::ShaderStageFlagBits::eCompute;
+    pipelineInfo.stage.module = module;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = _layout;
+    _pipeline = _context.device.createComputePipeline(nullptr, pipelineInfo);
+
+    _context.device.destroy(module);
+}
+
+MeshletCuller::~MeshletCuller() {
+    clear();
+    _context.device.destroy(_pipeline);
+    _context.device.destroy(_layout);
+    _context.device.destroy(_meshSetLayout);
+    _context.device.destroy(_imageSetLayout);
+}
+
+void MeshletCuller::cull(vk::CommandBuffer cmdBuffer, uint32_t image,
+                         const std::vector<CulledDraw>& draws,
+                         const CullView& view) {
+    if (draws.empty()) {
+        return;
+    }
+
+    // room for every meshlet being visible: the meshlets cover the full
+    // resolution level, 16 bit lists also get a degenerate triangle per
+    // meshlet so that each one starts on a word
+    std::vector<CullView> views;
+    views.reserve(draws.size());
+    vk::DeviceSize indexSize = 0;
+    for (std::size_t i = 0; i < draws.size(); ++i) {
+        const auto& mesh = *draws[i].mesh;
+        views.push_back(meshSpaceView(view, draws[i].model));
+        auto meshletCount = mesh.meshlets().meshletCount;
+        bool index16 = mesh.geometryBinding().indexType
+                       == vk::IndexType::eUint16;
+        vk::DeviceSize size = index16 ? sizeof(uint16_t) : sizeof(uint32_t);
+        vk::DeviceSize count = mesh.lod(0).indexCount;
+        if (index16) {
+            count += meshletCount * 3;
+        }
+
+        indexSize = (indexSize + 3) / 4 * 4;
+        views[i].meshletCount = meshletCount;
+        views[i].firstIndex = static_cast<uint32_t>(indexSize / size);
+        views[i].command = static_cast<uint32_t>(i);
+        views[i].index16 = index16 ? 1 : 0;
+        indexSize += count * size;
+    }
+    auto& target = _reserve(image, indexSize, draws.size());
+
+    // every draw command starts with no index and one instance, the culled
+    // indices are relative to the first vertex of the mesh
+    for (std::size_t i = 0; i < draws.size(); ++i) {
+        vk::DrawIndexedIndirectCommand reset;
+        reset.indexCount = 0;
+        reset.instanceCount = 1;
+        reset.firstIndex = views[i].firstIndex;
+        reset.vertexOffset = draws[i].mesh->vertexOffset();
+        reset.firstInstance = draws[i].firstInstance;
+        cmdBuffer.updateBuffer(target.commands.buffer, i * sizeof(reset),
+                               sizeof(reset), &reset);
+    }
+
+    vk::MemoryBarrier resetBarrier;
+    resetBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+    resetBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead
+                                 | vk::AccessFlagBits::eShaderWrite;
+    cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                              vk::PipelineStageFlagBits::eComputeShader, {},
+                              resetBarrier, nullptr, nullptr);
+
+    cmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, _pipeline);
+    cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, _layout, 1,
+                                 target.descriptorSet, nullptr);
+    for (std::size_t i = 0; i < draws.size(); ++i) {
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+                                     _layout, 0,
+                                     _meshDescriptorSet(*draws[i].mesh),
+                                     nullptr);
+        cmdBuffer.pushConstants(_layout, vk::ShaderStageFlagBits::eCompute, 0,
+                                sizeof(views[i]), &views[i]);
+        cmdBuffer.dispatch(
+            (views[i].meshletCount + workGroupSize - 1) / workGroupSize, 1,
+            1);
+    }
+
+    vk::MemoryBarrier drawBarrier;
+    drawBarrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+    drawBarrier.dstAccessMask = vk::AccessFlagBits::eIndirectCommandRead
+                                | vk::AccessFlagBits::eIndexRead;
+    cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                              vk::PipelineStageFlagBits::eDrawIndirect
+                                  | vk::PipelineStageFlagBits::eVertexInput,
+                              {}, drawBarrier, nullptr, nullptr);
+}
+
+void MeshletCuller::draw(vk::CommandBuffer cmdBuffer, uint32_t image,
+                         uint32_t draw, const Mesh& mesh) {
+    const auto& target = _images[image];
+    mesh.writeCulledCmdBuffer(cmdBuffer, target.indices.buffer,
+                              target.commands.buffer,
+                              draw * sizeof(vk::DrawIndexedIndirectCommand));
+}
+
+void MeshletCuller::clear() {
+    for (auto& target : _images) {
+        if (target.indexCapacity > 0) {
+            _bufferManager.destroyBuffer(target.indices);
+            _bufferManager.destroyBuffer(target.commands);
+        }
+    }
+    _images.clear();
+    _meshSets.clear();
+
+    for (auto pool : _descriptorPools) {
+        _context.device.destroy(pool);
+    }
+    _descriptorPools.clear();
+    _freeDescriptorSets = 0;
+}
+
+MeshletCuller::ImageTarget& MeshletCuller::_reserve(uint32_t image,
+                                                    vk::DeviceSize indexSize,
+                                                    std::size_t commandCount) {
+    if (image >= _images.size()) {
+        _images.resize(image + 1);
+    }
+    auto& target = _images[image];
+    if (indexSize <= target.indexCapacity
+        && commandCount <= target.commandCapacity) {
+        return target;
+    }
+
+    // the previous frame of image is done, nothing uses the buffers
+    if (target.indexCapacity > 0) {
+        _bufferManager.destroyBuffer(target.indices);
+        _bufferManager.destroyBuffer(target.commands);
+    } else {
+        target.descriptorSet = _allocateDescriptorSet(_imageSetLayout);
+    }
+    target.indexCapacity
+        = std::max(target.indexCapacity, indexSize + indexSize / 2);
+    target.commandCapacity
+        = std::max(target.commandCapacity, commandCount + commandCount / 2);
+    target.indices = _bufferManager.createBuffer(
+        target.indexCapacity,
+        vk::BufferUsageFlagBits::eStorageBuffer
+            | vk::BufferUsageFlagBits::eIndexBuffer,
+        VMA_MEMORY_USAGE_GPU_ONLY);
+    target.commands = _bufferManager.createBuffer(
+        target.commandCapacity * sizeof(vk::DrawIndexedIndirectCommand),
+        vk::BufferUsageFlagBits::eStorageBuffer
+            | vk::BufferUsageFlagBits::eIndirectBuffer
+            | vk::BufferUsageFlagBits::eTransferDst,
+        VMA_MEMORY_USAGE_GPU_ONLY);
+
+    std::array<vk::DescriptorBufferInfo, imageBindingCount> bufferInfos;
+    bufferInfos[0] = {target.indices.buffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[1] = {target.commands.buffer, 0, VK_WHOLE_SIZE};
+
+    std::array<vk::WriteDescriptorSet, imageBindingCount> writes;
+    for (uint32_t i = 0; i < imageBindingCount; ++i) {
+        writes[i].dstSet = target.descriptorSet;
+        writes[i].dstBinding = i;
+        writes[i].dstArrayElement = 0;
+        writes[i].descriptorType = vk::DescriptorType::eStorageBuffer;
+        writes[i].descriptorCount = 1;
+        writes[i].pBufferInfo = &bufferInfos[i];
+    }
+    _context.device.updateDescriptorSets(writes, nullptr);
+
+    return target;
+}
+
+vk::DescriptorSet MeshletCuller::_meshDescriptorSet(const Mesh& mesh) {
+    auto [it, inserted] = _meshSets.try_emplace(&mesh);
+    if (!inserted) {
+        return it->second;
+    }
+    it->second = _allocateDescriptorSet(_meshSetLayout);
+
+    const auto& meshlets = mesh.meshlets();
+    std::array<vk::DescriptorBufferInfo, meshBindingCount> bufferInfos;
+    bufferInfos[0] = {meshlets.meshlets.buffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[1] = {meshlets.vertices.buffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[2] = {meshlets.triangles.buffer, 0, VK_WHOLE_SIZE};
+
+    std::array<vk::WriteDescriptorSet, meshBindingCount> writes;
+    for (uint32_t i = 0; i < meshBindingCount; ++i) {
+        writes[i].dstSet = it->second;
+        writes[i].dstBinding = i;
+        writes[i].dstArrayElement = 0;
+        writes[i].descriptorType = vk::DescriptorType::eStorageBuffer;
+        writes[i].descriptorCount = 1;
+        writes[i].pBufferInfo = &bufferInfos[i];
+    }
+    _context.device.updateDescriptorSets(writes, nullptr);
+
+    return it->second;
+}
+
+vk::DescriptorSet
+MeshletCuller::_allocateDescriptorSet(vk::DescriptorSetLayout layout) {
+    if (_freeDescriptorSets == 0) {
+        vk::DescriptorPoolSize poolSize;
+        poolSize.type = vk::DescriptorType::eStorageBuffer;
+        poolSize.descriptorCount = meshBindingCount * descriptorSetsPerPool;
+
+        vk::DescriptorPoolCreateInfo poolInfo;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        poolInfo.maxSets = descriptorSetsPerPool;
+
+        _descriptorPools.push_back(
+            _context.device.createDescriptorPool(poolInfo));
+        _freeDescriptorSets = descriptorSetsPerPool;
+    }
+
+    vk::DescriptorSetAllocateInfo allocInfo;
+    allocInfo.descriptorPool = _descriptorPools.back();
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &layout;
+
+    --_freeDescriptorSets;
+    return _context.device.allocateDescriptorSets(allocInfo).front();
+}
+
+vk::DescriptorSetLayout
+MeshletCuller::_createDescriptorSetLayout(uint32_t bindingCount) {
+    std::vector<vk::DescriptorSetLayoutBinding> bindings(bindingCount);
+    for (uint32_t i = 0; i < bindingCount; ++i) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = vk::DescriptorType::eStorageBuffer;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = vk::ShaderStageFlagBits::eCompute;
+        bindings[i].pImmutableSamplers = nullptr;
+    }
+
+    vk::DescriptorSetLayoutCreateInfo layoutInfo;
+    layoutInfo.bindingCount = bindingCount;
+    layoutInfo.pBindings = bindings.data();
+
+    return _context.device.createDescriptorSetLayout(layoutInfo);
+}
+
+vk::ShaderModule MeshletCuller::_createShaderModule(const std::string& path) {
+    auto code = utils::readFile(path);
+
+    vk::ShaderModuleCreateInfo createInfo = {};
+    createInfo.codeSize = code.size();
+    createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+    return _context.device.createShaderModule(createInfo);
+}
+
+} // namespace vulkan
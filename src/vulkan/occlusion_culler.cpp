@@ -0,0 +1,340 @@
+#include "vulkan/occlusion_culler.hpp"
+#include "vulkan/context.hpp"
+#include "vulkan/utils.hpp"
+
+#include <algorithm>
+#include <array>
+
+namespace vulkan {
+
+namespace {
+
+constexpr uint32_t workGroupSize = 64;
+constexpr std::size_t minCapacity = 256;
+constexpr uint32_t bufferBindingCount = 5;
+constexpr uint32_t pyramidBinding = 5;
+constexpr vk::DeviceSize commandSize = sizeof(vk::DrawIndexedIndirectCommand);
+
+} // namespace
+
+OcclusionCuller::OcclusionCuller(Context& context,
+                                 BufferManager& bufferManager,
+                                 std::size_t imageCount)
+    : _context(context), _bufferManager(bufferManager), _images(imageCount) {
+    _descriptorSetLayout = _createDescriptorSetLayout();
+
+    std::array<vk::DescriptorPoolSize, 2> poolSizes;
+    poolSizes[0].type = vk::DescriptorType::eStorageBuffer;
+    poolSizes[0].descriptorCount = bufferBindingCount * imageCount;
+    poolSizes[1].type = vk::DescriptorType::eCombinedImageSampler;
+    poolSizes[1].descriptorCount = imageCount;
+
+    vk::DescriptorPoolCreateInfo poolInfo;
+    poolInfo.poolSizeCount = poolSizes.size();
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = imageCount;
+    _descriptorPool = _context.device.createDescriptorPool(poolInfo);
+
+    std::vector<vk::DescriptorSetLayout> layouts(imageCount,
+                                                 _descriptorSetLayout);
+    vk::DescriptorSetAllocateInfo allocInfo;
+    allocInfo.descriptorPool = _descriptorPool;
+    allocInfo.descriptorSetCount = imageCount;
+    allocInfo.pSetLayouts = layouts.data();
+    auto descriptorSets = _context.device.allocateDescriptorSets(allocInfo);
+    for (std::size_t i = 0; i < imageCount; ++i) {
+        _images[i].descriptorSet = descriptorSets[i];
+    }
+
+    vk::PushConstantRange pushConstantRange;
+    pushConstantRange.stageFlags = vk::ShaderStageFlagBits::eCompute;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(OcclusionView);
+
+    vk::PipelineLayoutCreateInfo layoutInfo;
+    layoutInfo.setLayoutCount = 1;
+    layoutInfo.pSetLayouts = &_descriptorSetLayout;
+    layoutInfo.pushConstantRangeCount = 1;
+    layoutInfo.pPushConstantRanges = &pushConstantRange;
+    _layout = _context.device.createPipelineLayout(layoutInfo);
+
+    auto module = _createShaderModule("shaders/occlusion_cull.comp.spv");
+
+    vk::ComputePipelineCreateInfo pipelineInfo;
+    pipelineInfo.stage.stage = vk::ShaderStageFlagBits::eCompute;
+    pipelineInfo.stage.module = module;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = _layout;
+    _pipeline = _context.device.createComputePipeline(nullptr, pipelineInfo);
+
+    _context.device.destroy(module);
+}
+
+OcclusionCuller::~OcclusionCuller() {
+    for (auto& objects : _images) {
+        _destroyObjects(objects);
+        _destroyBatches(objects);
+    }
+    if (_historyCapacity > 0) {
+        _bufferManager.destroyBuffer(_history);
+    }
+    _context.device.destroy(_pipeline);
+    _context.device.destroy(_layout);
+    _context.device.destroy(_descriptorPool);
+    _context.device.destroy(_descriptorSetLayout);
+}
+
+void OcclusionCuller::reset(uint32_t image, std::size_t objectCount,
+                            std::size_t batchCount, std::size_t meshCount) {
+    auto& objects = _images[image];
+    objects.objectCount = 0;
+    objects.batchCount = 0;
+
+    if (objectCount > objects.objectCapacity) {
+        _destroyObjects(objects);
+        objects.objectCapacity
+            = std::max(minCapacity, objectCount + objectCount / 2);
+        objects.objects = _bufferManager.createBuffer(
+            objects.objectCapacity * sizeof(Object),
+            vk::BufferUsageFlagBits::eStorageBuffer,
+            VMA_MEMORY_USAGE_CPU_TO_GPU);
+        // the early then the late commands
+        objects.culled = _bufferManager.createBuffer(
+            2 * objects.objectCapacity * commandSize,
+            vk::BufferUsageFlagBits::eStorageBuffer
+                | vk::BufferUsageFlagBits::eIndirectBuffer
+                | vk::BufferUsageFlagBits::eTransferDst,
+            VMA_MEMORY_USAGE_GPU_ONLY);
+
+        void* data;
+        vmaMapMemory(_bufferManager.allocator, objects.objects.allocation,
+                     &data);
+        objects.mappedObjects = static_cast<Object*>(data);
+    }
+
+    if (batchCount > objects.batchCapacity) {
+        _destroyBatches(objects);
+        objects.batchCapacity
+            = std::max(minCapacity, batchCount + batchCount / 2);
+        objects.batches = _bufferManager.createBuffer(
+            objects.batchCapacity * sizeof(Batch),
+            vk::BufferUsageFlagBits::eStorageBuffer
+                | vk::BufferUsageFlagBits::eIndirectBuffer,
+            VMA_MEMORY_USAGE_CPU_TO_GPU);
+
+        void* data;
+        vmaMapMemory(_bufferManager.allocator, objects.batches.allocation,
+                     &data);
+        objects.mappedBatches = static_cast<Batch*>(data);
+    }
+
+    if (meshCount > _historyCapacity) {
+        // shared with the frames of the other images still in flight
+        _context.deviceWaitIdle();
+        if (_historyCapacity > 0) {
+            _bufferManager.destroyBuffer(_history);
+        }
+        _historyCapacity = std::max(minCapacity, meshCount + meshCount / 2);
+        _history = _bufferManager.createBuffer(
+            _historyCapacity * sizeof(uint32_t),
+            vk::BufferUsageFlagBits::eStorageBuffer
+                | vk::BufferUsageFlagBits::eTransferDst,
+            VMA_MEMORY_USAGE_GPU_ONLY);
+        _clearHistory = true;
+    }
+}
+
+void OcclusionCuller::addBatch(uint32_t image, uint32_t firstCommand) {
+    auto& objects = _images[image];
+    auto& batch = objects.mappedBatches[objects.batchCount++];
+    batch.first = firstCommand;
+    batch.earlyCount = 0;
+    batch.lateCount = 0;
+    batch.padding = 0;
+}
+
+void OcclusionCuller::addObject(uint32_t image, const MeshBounds& bounds,
+                                uint32_t meshId, uint32_t batch) {
+    auto& objects = _images[image];
+    auto& object = objects.mappedObjects[objects.objectCount++];
+    object.center = bounds.center;
+    object.meshId = meshId;
+    object.extents = bounds.extents;
+    object.batch = batch;
+}
+
+void OcclusionCuller::flush(uint32_t image) {
+    auto& objects = _images[image];
+    if (objects.objectCapacity > 0) {
+        vmaFlushAllocation(_bufferManager.allocator,
+                           objects.objects.allocation, 0, VK_WHOLE_SIZE);
+    }
+    if (objects.batchCapacity > 0) {
+        vmaFlushAllocation(_bufferManager.allocator,
+                           objects.batches.allocation, 0, VK_WHOLE_SIZE);
+    }
+}
+
+void OcclusionCuller::cull(vk::CommandBuffer cmdBuffer, uint32_t image,
+                           OcclusionPhase phase, vk::Buffer commands,
+                           const DepthPyramid& pyramid,
+                           const glm::mat4& viewProjection) {
+    auto& objects = _images[image];
+    if (objects.objectCount == 0) {
+        return;
+    }
+
+    if (phase == OcclusionPhase::Early) {
+        _writeDescriptorSet(objects, commands, pyramid);
+
+        // the commands no object is compacted to stay empty draws
+        auto usedSize = objects.objectCount * commandSize;
+        cmdBuffer.fillBuffer(objects.culled.buffer, 0, usedSize, 0);
+        cmdBuffer.fillBuffer(objects.culled.buffer,
+                             objects.objectCapacity * commandSize, usedSize, 0);
+        if (_clearHistory) {
+            cmdBuffer.fillBuffer(_history.buffer, 0, VK_WHOLE_SIZE, 0);
+            _clearHistory = false;
+        }
+
+        // also orders the history after the late phase of the last frame
+        vk::MemoryBarrier fillBarrier;
+        fillBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite
+                                    | vk::AccessFlagBits::eShaderWrite;
+        fillBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead
+                                    | vk::AccessFlagBits::eShaderWrite;
+        auto srcStages = vk::PipelineStageFlagBits::eTransfer
+                         | vk::PipelineStageFlagBits::eComputeShader;
+        cmdBuffer.pipelineBarrier(srcStages,
+                                  vk::PipelineStageFlagBits::eComputeShader,
+                                  {}, fillBarrier, nullptr, nullptr);
+    }
+
+    OcclusionView view;
+    view.viewProjection = viewProjection;
+    view.pyramidSize = glm::vec2(pyramid.extent().width,
+                                 pyramid.extent().height);
+    view.objectCount = static_cast<uint32_t>(objects.objectCount);
+    view.phase = static_cast<uint32_t>(phase);
+    view.lateOffset = static_cast<uint32_t>(objects.objectCapacity);
+
+    cmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, _pipeline);
+    cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, _layout, 0,
+                                 objects.descriptorSet, nullptr);
+    cmdBuffer.pushConstants(_layout, vk::ShaderStageFlagBits::eCompute, 0,
+                            sizeof(view), &view);
+    cmdBuffer.dispatch(
+        (view.objectCount + workGroupSize - 1) / workGroupSize, 1, 1);
+
+    vk::MemoryBarrier drawBarrier;
+    drawBarrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+    drawBarrier.dstAccessMask = vk::AccessFlagBits::eIndirectCommandRead;
+    cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                              vk::PipelineStageFlagBits::eDrawIndirect, {},
+                              drawBarrier, nullptr, nullptr);
+}
+
+std::size_t OcclusionCuller::culledFirst(uint32_t image, OcclusionPhase phase,
+                                         std::size_t firstCommand) const {
+    if (phase == OcclusionPhase::Late) {
+        return _images[image].objectCapacity + firstCommand;
+    }
+    return firstCommand;
+}
+
+vk::DeviceSize OcclusionCuller::countOffset(uint32_t batch,
+                                            OcclusionPhase phase) const {
+    auto offset = batch * sizeof(Batch);
+    if (phase == OcclusionPhase::Late) {
+        return offset + offsetof(Batch, lateCount);
+    }
+    return offset + offsetof(Batch, earlyCount);
+}
+
+void OcclusionCuller::_destroyObjects(ImageObjects& objects) {
+    if (objects.objectCapacity == 0) {
+        return;
+    }
+    vmaUnmapMemory(_bufferManager.allocator, objects.objects.allocation);
+    _bufferManager.destroyBuffer(objects.objects);
+    _bufferManager.destroyBuffer(objects.culled);
+    objects.objectCapacity = 0;
+}
+
+void OcclusionCuller::_destroyBatches(ImageObjects& objects) {
+    if (objects.batchCapacity == 0) {
+        return;
+    }
+    vmaUnmapMemory(_bufferManager.allocator, objects.batches.allocation);
+    _bufferManager.destroyBuffer(objects.batches);
+    objects.batchCapacity = 0;
+}
+
+void OcclusionCuller::_writeDescriptorSet(ImageObjects& objects,
+                                          vk::Buffer commands,
+                                          const DepthPyramid& pyramid) {
+    std::array<vk::DescriptorBufferInfo, bufferBindingCount> bufferInfos;
+    bufferInfos[0] = {objects.objects.buffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[1] = {commands, 0, VK_WHOLE_SIZE};
+    bufferInfos[2] = {objects.culled.buffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[3] = {objects.batches.buffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[4] = {_history.buffer, 0, VK_WHOLE_SIZE};
+
+    vk::DescriptorImageInfo pyramidInfo;
+    pyramidInfo.sampler = pyramid.sampler();
+    pyramidInfo.imageView = pyramid.view();
+    pyramidInfo.imageLayout = vk::ImageLayout::eGeneral;
+
+    std::array<vk::WriteDescriptorSet, bufferBindingCount + 1> writes;
+    for (uint32_t i = 0; i < bufferBindingCount; ++i) {
+        writes[i].dstSet = objects.descriptorSet;
+        writes[i].dstBinding = i;
+        writes[i].dstArrayElement = 0;
+        writes[i].descriptorType = vk::DescriptorType::eStorageBuffer;
+        writes[i].descriptorCount = 1;
+        writes[i].pBufferInfo = &bufferInfos[i];
+    }
+    writes[pyramidBinding].dstSet = objects.descriptorSet;
+    writes[pyramidBinding].dstBinding = pyramidBinding;
+    writes[pyramidBinding].dstArrayElement = 0;
+    writes[pyramidBinding].descriptorType
+        = vk::DescriptorType::eCombinedImageSampler;
+    writes[pyramidBinding].descriptorCount = 1;
+    writes[pyramidBinding].pImageInfo = &pyramidInfo;
+    _context.device.updateDescriptorSets(writes, nullptr);
+}
+
+vk::DescriptorSetLayout OcclusionCuller::_createDescriptorSetLayout() {
+    std::array<vk::DescriptorSetLayoutBinding, bufferBindingCount + 1>
+        bindings;
+    for (uint32_t i = 0; i < bindings.size(); ++i) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = vk::DescriptorType::eStorageBuffer;
+        if (i == pyramidBinding) {
+            bindings[i].descriptorType
+                = vk::DescriptorType::eCombinedImageSampler;
+        }
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = vk::ShaderStageFlagBits::eCompute;
+        bindings[i].pImmutableSamplers = nullptr;
+    }
+
+    vk::DescriptorSetLayoutCreateInfo layoutInfo;
+    layoutInfo.bindingCount = bindings.size();
+    layoutInfo.pBindings = bindings.data();
+
+    return _context.device.createDescriptorSetLayout(layoutInfo);
+}
+
+vk::ShaderModule
+OcclusionCuller::_createShaderModule(const std::string& path) {
+    auto code = utils::readFile(path);
+
+    vk::ShaderModuleCreateInfo createInfo = {};
+    createInfo.codeSize = code.size();
+    createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+    return _context.device.createShaderModule(createInfo);
+}
+
+} // namespace vulkan
@@ -1,14 +1,19 @@
 #include "vulkan/pipeline.hpp"
 
-#include "scene.hpp"
 #include "vulkan/utils.hpp"
 
+#include <vector>
+
 namespace vulkan {
 
-Pipeline::Pipeline(vk::Device device, vk::DescriptorSetLayout dsl,
-                   vk::Extent2D extent, vk::RenderPass renderPass)
+Pipeline::Pipeline(vk::Device device,
+                   const std::vector<vk::DescriptorSetLayout>& setLayouts,
+                   vk::Extent2D extent, vk::RenderPass renderPass,
+                   VertexFormat vertexFormat)
     : device(device) {
-    auto vertModule = _createShaderModule("shaders/shader.vert.spv");
+    bool packed = vertexFormat == VertexFormat::Packed;
+    auto vertModule = _createShaderModule(
+        packed ? "shaders/shader_packed.vert.spv" : "shaders/shader.vert.spv");
     auto fragModule = _createShaderModule("shaders/shader.frag.spv");
 
     vk::PipelineShaderStageCreateInfo vertShaderStageInfo;
@@ -30,13 +35,24 @@ Pipeline::Pipeline(vk::Device device, vk::DescriptorSetLayout dsl,
     vertexInputInfo.vertexAttributeDescriptionCount = 0;
     vertexInputInfo.pVertexAttributeDescriptions = nullptr;
 
-    auto bindingDescription = scene::Vertex::getBindingDescription();
-    auto attributeDescriptions = scene::Vertex::getAttributeDescriptions();
-    vertexInputInfo.vertexBindingDescriptionCount = 1;
+    // the per instance data comes from the storage buffer of the objects
+    std::vector<vk::VertexInputBindingDescription> bindings;
+    std::vector<vk::VertexInputAttributeDescription> attributes;
+    if (packed) {
+        auto packedAttributes = PackedVertex::getAttributeDescriptions();
+        bindings = {PackedVertex::getBindingDescription()};
+        attributes.assign(packedAttributes.begin(), packedAttributes.end());
+    } else {
+        auto fullAttributes = Vertex::getAttributeDescriptions();
+        bindings = {Vertex::getBindingDescription()};
+        attributes.assign(fullAttributes.begin(), fullAttributes.end());
+    }
+    vertexInputInfo.vertexBindingDescriptionCount
+        = static_cast<uint32_t>(bindings.size());
     vertexInputInfo.vertexAttributeDescriptionCount
-        = static_cast<uint32_t>(attributeDescriptions.size());
-    vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-    vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+        = static_cast<uint32_t>(attributes.size());
+    vertexInputInfo.pVertexBindingDescriptions = bindings.data();
+    vertexInputInfo.pVertexAttributeDescriptions = attributes.data();
 
     vk::PipelineInputAssemblyStateCreateInfo inputAssembly;
     inputAssembly.topology = vk::PrimitiveTopology::eTriangleList;
@@ -125,10 +141,16 @@ Pipeline::Pipeline(vk::Device device, vk::DescriptorSetLayout dsl,
     depthStencil.stencilTestEnable = VK_FALSE;
 
     vk::PipelineLayoutCreateInfo pipelineLayoutInfo;
-    pipelineLayoutInfo.setLayoutCount = 1;
-    pipelineLayoutInfo.pSetLayouts = &dsl;
-    pipelineLayoutInfo.pushConstantRangeCount = 0;
-    pipelineLayoutInfo.pPushConstantRanges = nullptr;
+    pipelineLayoutInfo.setLayoutCount
+        = static_cast<uint32_t>(setLayouts.size());
+    pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+    // DrawList::instanceShift()
+    vk::PushConstantRange pushConstantRange;
+    pushConstantRange.stageFlags = vk::ShaderStageFlagBits::eVertex;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(uint32_t);
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
 
     layout = device.createPipelineLayout(pipelineLayoutInfo);
 
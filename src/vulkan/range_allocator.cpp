@@ -0,0 +1,79 @@
+#include "vulkan/range_allocator.hpp"
+
+#include <iterator>
+#include <stdexcept>
+
+namespace vulkan {
+
+RangeAllocator::RangeAllocator(uint64_t capacity)
+    : _capacity(capacity), _freeSize(capacity) {
+    if (capacity > 0) {
+        _free.emplace(0, capacity);
+    }
+}
+
+std::optional<uint64_t> RangeAllocator::allocate(uint64_t size,
+                                                 uint64_t alignment) {
+    if (alignment == 0) {
+        alignment = 1;
+    }
+
+    for (auto it = _free.begin(); it != _free.end(); ++it) {
+        auto [freeOffset, freeSize] = *it;
+        auto offset = (freeOffset + alignment - 1) / alignment * alignment;
+        auto padding = offset - freeOffset;
+        if (padding + size > freeSize) {
+            continue;
+        }
+
+        // the padding and the tail stay free
+        _free.erase(it);
+        if (padding > 0) {
+            _free.emplace(freeOffset, padding);
+        }
+        auto end = offset + size;
+        auto freeEnd = freeOffset + freeSize;
+        if (freeEnd > end) {
+            _free.emplace(end, freeEnd - end);
+        }
+        _freeSize -= size;
+        return offset;
+    }
+    return {};
+}
+
+void RangeAllocator::free(uint64_t offset, uint64_t size) {
+    if (size == 0) {
+        return;
+    }
+    if (offset + size > _capacity) {
+        throw std::out_of_range("freed range is outside of the allocator");
+    }
+    _freeSize += size;
+
+    auto next = _free.lower_bound(offset);
+    if (next != _free.begin()) {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == offset) {
+            offset = previous->first;
+            size += previous->second;
+            _free.erase(previous);
+        }
+    }
+    if (next != _free.end() && offset + size == next->first) {
+        size += next->second;
+        _free.erase(next);
+    }
+    _free.emplace(offset, size);
+}
+
+void RangeAllocator::grow(uint64_t capacity) {
+    if (capacity <= _capacity) {
+        return;
+    }
+    auto end = _capacity;
+    _capacity = capacity;
+    free(end, capacity - end);
+}
+
+} // namespace vulkan
@@ -0,0 +1,96 @@
+#include "vulkan/render_queue.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace vulkan {
+
+namespace {
+
+constexpr unsigned digitBits = 8;
+constexpr std::size_t radix = std::size_t(1) << digitBits;
+// packets sorted by a task in each pass
+constexpr std::size_t minBlockPackets = 4096;
+
+uint64_t field(uint32_t value, unsigned bits) {
+    return value & ((uint64_t(1) << bits) - 1);
+}
+
+} // namespace
+
+uint64_t makeSortKey(DrawPass pass, uint32_t pipeline, uint32_t material,
+                     uint32_t geometry, float depth) {
+    // the bits of a positive float sort like the float
+    uint32_t depthBits = 0;
+    if (depth > 0.0f) {
+        std::memcpy(&depthBits, &depth, sizeof(depthBits));
+    }
+
+    uint64_t state = field(pipeline, 2) << 28 | field(material, 14) << 14
+                     | field(geometry, 14);
+    uint64_t key = field(static_cast<uint32_t>(pass), 2) << 62;
+    if (pass == DrawPass::Transparent) {
+        return key | uint64_t(~depthBits) << 30 | state;
+    }
+    return key | state << 32 | depthBits;
+}
+
+void RenderQueue::sort(scene::ThreadPool& pool) {
+    auto count = _packets.size();
+    if (count < 2) {
+        return;
+    }
+    _scratch.resize(count);
+
+    uint64_t differing = 0;
+    for (const auto& packet : _packets) {
+        differing |= packet.key ^ _packets[0].key;
+    }
+
+    auto blockCount = std::max<std::size_t>(
+        1, std::min(pool.size(), count / minBlockPackets));
+    auto blockSize = (count + blockCount - 1) / blockCount;
+    std::vector<std::array<std::size_t, radix>> offsets(blockCount);
+
+    for (unsigned shift = 0; shift < 64; shift += digitBits) {
+        if (((differing >> shift) & (radix - 1)) == 0) {
+            continue;
+        }
+        auto digit = [shift](const DrawPacket& packet) {
+            return static_cast<std::size_t>(packet.key >> shift)
+                   & (radix - 1);
+        };
+
+        pool.parallelFor(blockCount, [&](std::size_t block) {
+            auto& histogram = offsets[block];
+            histogram.fill(0);
+            auto end = std::min(count, (block + 1) * blockSize);
+            for (auto i = block * blockSize; i < end; ++i) {
+                ++histogram[digit(_packets[i])];
+            }
+        });
+
+        // digit major, block minor: each block scatters after the blocks
+        // before it, which keeps the sort stable
+        std::size_t offset = 0;
+        for (std::size_t d = 0; d < radix; ++d) {
+            for (auto& histogram : offsets) {
+                auto digitCount = histogram[d];
+                histogram[d] = offset;
+                offset += digitCount;
+            }
+        }
+
+        pool.parallelFor(blockCount, [&](std::size_t block) {
+            auto& next = offsets[block];
+            auto end = std::min(count, (block + 1) * blockSize);
+            for (auto i = block * blockSize; i < end; ++i) {
+                _scratch[next[digit(_packets[i])]++] = _packets[i];
+            }
+        });
+        _packets.swap(_scratch);
+    }
+}
+
+} // namespace vulkan
@@ -2,9 +2,12 @@
 
 #include <algorithm>
 #include <chrono>
+#include <cmath>
 // #include <cstring>
 #include <iostream>
+#include <limits>
 #include <map>
+#include <mutex>
 #include <set>
 #include <stdexcept>
 
@@ -14,6 +17,12 @@
 
 namespace vulkan {
 
+namespace {
+
+const float fieldOfView = glm::radians(45.0f);
+
+} // namespace
+
 Renderer::Renderer(const app::Window& appWindow, Context& context,
                    BufferManager& bufferManager)
     : bufferManager(bufferManager), context(context), _appWindow(appWindow) {
@@ -23,6 +32,7 @@ Renderer::Renderer(const app::Window& appWindow, Context& context,
         = std::make_unique<Swapchain>(context, bufferManager, width, height);
 
     _syncObjects = _createSyncObjects();
+    _imagesInFlight.assign(_swapchain->imageBuffers.size(), vk::Fence());
 }
 
 Renderer::~Renderer() {
@@ -36,6 +46,8 @@ Renderer::~Renderer() {
 }
 
 void Renderer::drawFrame() {
+    _pollAsyncScene();
+
     auto currentSync = _syncObjects[currentFrame];
 
     context.device.waitForFences(currentSync.inFlight, VK_TRUE,
@@ -54,8 +66,50 @@ void Renderer::drawFrame() {
     }
 
     auto imageIndex = acqRes.value;
+    // the command buffer and uniform buffer of the image are reused below
+    if (_imagesInFlight[imageIndex]) {
+        context.device.waitForFences(_imagesInFlight[imageIndex], VK_TRUE,
+                                     std::numeric_limits<uint64_t>::max());
+    }
+    _imagesInFlight[imageIndex] = currentSync.inFlight;
+
+    _reportFrameStats(imageIndex);
     updateUniformBuffer(imageIndex);
 
+    LodView lodView;
+    lodView.cameraPosition = glm::vec3(glm::inverse(_viewMatrix)[3]);
+    lodView.projectionScale = _swapchain->extent.height
+                              / (2.0f * std::tan(fieldOfView / 2.0f));
+    auto cullView = _cullView();
+    auto cullStart = std::chrono::high_resolution_clock::now();
+    _updateTransforms();
+    _visibleIndices.clear();
+    _bvh.cull(cullView.planes, _visibleIndices);
+    if (_pendingMeshes.size() > 0) {
+        auto first = _visibleIndices.size();
+        _pendingMeshes.cull(cullView.planes, 0, _pendingMeshes.size(),
+                            _visibleIndices);
+        for (auto i = first; i < _visibleIndices.size(); ++i) {
+            _visibleIndices[i] += static_cast<uint32_t>(_bvhMeshCount);
+        }
+    }
+    auto recordStart = std::chrono::high_resolution_clock::now();
+    _lastFrameTimes.cullMs
+        = std::chrono::duration<double, std::milli>(recordStart - cullStart)
+              .count();
+    _cullTime += _lastFrameTimes.cullMs;
+    _culledMeshes += _meshes.size() - _visibleIndices.size();
+
+    _fillRenderQueue();
+    _triangles += _swapchain->recordCommandBuffer(
+        imageIndex, _renderQueue, _worldMatrices, _worldBounds, lodView,
+        cullView, _projectionMatrix() * _viewMatrix);
+    _lastFrameTimes.recordMs
+        = std::chrono::duration<double, std::milli>(
+              std::chrono::high_resolution_clock::now() - recordStart)
+              .count();
+    _recordTime += _lastFrameTimes.recordMs;
+
     vk::SubmitInfo submitInfo;
 
     vk::Semaphore waitSemaphores[] = {currentSync.imageAvailable};
@@ -74,7 +128,9 @@ void Renderer::drawFrame() {
     submitInfo.pSignalSemaphores = signalSemaphores;
 
     context.device.resetFences(currentSync.inFlight);
+    std::unique_lock<std::mutex> queueLock(context.queueMutex);
     context.graphicsQueue.submit(submitInfo, currentSync.inFlight);
+    _swapchain->gpuTimer->markSubmitted(imageIndex);
 
     vk::PresentInfoKHR presentInfo;
     presentInfo.waitSemaphoreCount = 1;
@@ -88,6 +144,7 @@ void Renderer::drawFrame() {
     presentInfo.pResults = nullptr;
 
     auto presRes = context.presentQueue.presentKHR(presentInfo);
+    queueLock.unlock();
     if (presRes == vk::Result::eErrorOutOfDateKHR || _mustRecreateSwapchain) {
         _mustRecreateSwapchain = false;
         recreateSwapchain();
@@ -106,6 +163,7 @@ void Renderer::recreateSwapchain() {
 
     auto [width, height] = _appWindow.getFrameBufferSize();
     _swapchain->recreate(width, height);
+    _imagesInFlight.assign(_swapchain->imageBuffers.size(), vk::Fence());
 }
 
 void Renderer::updateUniformBuffer(uint32_t currentImage) {
@@ -120,28 +178,226 @@ void Renderer::updateUniformBuffer(uint32_t currentImage) {
     ubo.model = glm::mat4(1.0f);
     ubo.view = _viewMatrix;
 
-    ubo.proj = glm::perspective(glm::radians(45.0f),
-                                _swapchain->extent.width
-                                    / (float)_swapchain->extent.height,
-                                0.1f, 1000.0f);
-    ubo.proj[1][1] *= -1; // openGL -> Vulkan conversion
+    ubo.proj = _projectionMatrix();
 
     _swapchain->updateUniformBuffer(currentImage, ubo);
 }
 
 void Renderer::setScene(const scene::Scene& scene) {
+    // the culled index lists belong to the meshes of the previous scene
     context.deviceWaitIdle();
-    _swapchain->beginMeshUpdates();
+    _swapchain->meshletCuller->clear();
+
+    _asyncScene = nullptr;
+    _loading = false;
+    _swapchain->materials->set(scene.materials);
+    _resetTransforms();
+    std::vector<const Mesh*> meshes;
     for (const auto& mesh : scene.meshes) {
-        _swapchain->addMesh(&mesh);
+        meshes.push_back(&mesh);
+    }
+    _addMeshes(meshes);
+    _updateTransforms();
+}
+
+void Renderer::setScene(scene::AsyncScene& scene) {
+    context.deviceWaitIdle();
+    _swapchain->meshletCuller->clear();
+
+    _asyncScene = &scene;
+    _loading = true;
+    if (auto materials = scene.takeMaterials()) {
+        _swapchain->materials->set(*materials);
     }
-    _swapchain->endMeshUpdates();
+    _resetTransforms();
+    _addMeshes(scene.takeResidentMeshes());
+    _updateTransforms();
+}
+
+void Renderer::setMeshes(std::vector<const Mesh*> meshes) {
+    context.deviceWaitIdle();
+    _swapchain->meshletCuller->clear();
+
+    _asyncScene = nullptr;
+    _loading = false;
+    _swapchain->materials->set({});
+    _resetTransforms();
+    _addMeshes(meshes);
+    _updateTransforms();
+}
+
+void Renderer::setDrawMode(DrawMode drawMode) {
+    _swapchain->drawMode = drawMode;
+}
+
+void Renderer::setOcclusionCulling(bool enabled) {
+    _swapchain->occlusionCulling = enabled;
 }
 
 void Renderer::setViewMatrix(glm::mat4 viewMatrix) {
     _viewMatrix = viewMatrix;
 }
 
+void Renderer::_pollAsyncScene() {
+    if (!_asyncScene) {
+        return;
+    }
+
+    // the materials come before the first mesh, the frames in flight still
+    // use the previous ones
+    if (auto materials = _asyncScene->takeMaterials()) {
+        context.deviceWaitIdle();
+        _swapchain->materials->set(*materials);
+    }
+
+    // command buffers are recorded every frame, new meshes are simply drawn
+    // from the next one. The bvh is built once, after the last mesh, until
+    // then the new ones are culled without it, see _updateTransforms().
+    bool loaded = _asyncScene->isLoaded();
+    _addMeshes(_asyncScene->takeResidentMeshes());
+    _loading = !loaded;
+}
+
+void Renderer::_resetTransforms() {
+    _transforms = scene::TransformHierarchy();
+    _sceneRoot = _transforms.add({});
+    _meshes.clear();
+    _meshNodes.clear();
+    _worldMatrices.clear();
+    _worldBounds.clear();
+    _placedMeshCount = 0;
+    _bvh.build(_worldBounds, _pool);
+    _bvhMeshCount = 0;
+    _pendingMeshes.clear();
+}
+
+void Renderer::_addMeshes(const std::vector<const Mesh*>& meshes) {
+    for (auto mesh : meshes) {
+        _meshes.push_back(mesh);
+        _meshNodes.push_back(_transforms.add({}, _sceneRoot));
+    }
+}
+
+void Renderer::_updateTransforms() {
+    auto updated = _transforms.update(_pool);
+    if (updated > 0) {
+        // new meshes only update their own new node, anything more means
+        // some node moved, and maybe every mesh with it
+        auto added = _meshes.size() - _placedMeshCount;
+        auto first = updated > added ? 0 : _placedMeshCount;
+        _worldMatrices.resize(_meshes.size());
+        _worldBounds.resize(_meshes.size());
+        _pool.parallelFor(_meshes.size() - first, [&](std::size_t i) {
+            auto mesh = first + i;
+            _worldMatrices[mesh] = _transforms.worldMatrix(_meshNodes[mesh]);
+            _worldBounds[mesh] = transformBounds(_meshes[mesh]->bounds(),
+                                                 _worldMatrices[mesh]);
+        });
+
+        auto firstPending = _placedMeshCount;
+        if (first == 0) {
+            _bvh.refit(_worldBounds);
+            _pendingMeshes.clear();
+            firstPending = _bvhMeshCount;
+        }
+        _pendingMeshes.add(_worldBounds, firstPending,
+                           _meshes.size() - firstPending);
+        _placedMeshCount = _meshes.size();
+    }
+
+    if (!_loading && _pendingMeshes.size() > 0) {
+        _buildBvh();
+    }
+}
+
+void Renderer::_buildBvh() {
+    _bvh.build(_worldBounds, _pool);
+    _bvhMeshCount = _meshes.size();
+    _pendingMeshes.clear();
+}
+
+void Renderer::_fillRenderQueue() {
+    // view space depth of a point is -dot(row, (point, 1))
+    glm::vec4 row(_viewMatrix[0][2], _viewMatrix[1][2], _viewMatrix[2][2],
+                  _viewMatrix[3][2]);
+    _renderQueue.clear();
+    _renderQueue.reserve(_visibleIndices.size());
+    for (auto i : _visibleIndices) {
+        auto mesh = _meshes[i];
+        const auto& bounds = _worldBounds[i];
+        // nearest point of the bounding sphere, the key clamps negative ones
+        float depth = -glm::dot(row, glm::vec4(bounds.center, 1.0f))
+                      - bounds.radius;
+        auto key = makeSortKey(
+            DrawPass::Opaque, static_cast<uint32_t>(mesh->vertexFormat()),
+            mesh->material(), mesh->geometryId(), depth);
+        _renderQueue.push({key, mesh, i});
+    }
+    _renderQueue.sort(_pool);
+}
+
+std::optional<RayHit> Renderer::pick(const Ray& ray) const {
+    return _bvh.raycast(ray);
+}
+
+void Renderer::_reportFrameStats(uint32_t imageIndex) {
+    // the previous frame of this image is done, its timestamps are written
+    _lastFrameTimes.gpuMs = _swapchain->gpuTimer->read(imageIndex);
+    if (_lastFrameTimes.gpuMs) {
+        _gpuTime += *_lastFrameTimes.gpuMs;
+        ++_gpuFrames;
+    }
+
+    auto now = std::chrono::high_resolution_clock::now();
+    ++_frames;
+    if (now - _lastGpuReport > std::chrono::seconds(1) && _gpuFrames > 0) {
+        std::cout << "GPU: " << _gpuTime / _gpuFrames << " ms/frame, CPU "
+                  << _recordTime / _frames << " ms/frame recording, "
+                  << _cullTime / _frames << " ms/frame culling "
+                  << _culledMeshes / _frames << "/" << _meshes.size()
+                  << " meshes, " << _triangles / _frames
+                  << " triangles/frame\n";
+        _gpuTime = 0.0;
+        _cullTime = 0.0;
+        _culledMeshes = 0;
+        _recordTime = 0.0;
+        _gpuFrames = 0;
+        _triangles = 0;
+        _frames = 0;
+        _lastGpuReport = now;
+    }
+}
+
+glm::mat4 Renderer::_projectionMatrix() const {
+    auto proj = glm::perspective(fieldOfView,
+                                 _swapchain->extent.width
+                                     / (float)_swapchain->extent.height,
+                                 0.1f, 1000.0f);
+    proj[1][1] *= -1; // openGL -> Vulkan conversion
+    return proj;
+}
+
+CullView Renderer::_cullView() const {
+    // frustum planes from the rows of the clip matrix (Gribb and Hartmann),
+    // the model matrix of the uniforms is the identity so they are in world
+    // space
+    auto clip = glm::transpose(_projectionMatrix() * _viewMatrix);
+
+    CullView view;
+    view.planes[0] = clip[3] + clip[0];
+    view.planes[1] = clip[3] - clip[0];
+    view.planes[2] = clip[3] + clip[1];
+    view.planes[3] = clip[3] - clip[1];
+    view.planes[4] = clip[2]; // depth is in [0, 1]
+    view.planes[5] = clip[3] - clip[2];
+    for (auto& plane : view.planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    view.cameraPosition = glm::vec3(glm::inverse(_viewMatrix)[3]);
+    view.meshletCount = 0;
+    return view;
+}
+
 std::vector<Renderer::SyncObject> Renderer::_createSyncObjects() {
     std::vector<SyncObject> objects;
     objects.reserve(MAX_FRAMES_IN_FLIGHT);
@@ -4,7 +4,10 @@
 #include "vulkan/utils.hpp"
 #include "window.hpp"
 
+#include <algorithm>
 #include <iostream>
+#include <optional>
+#include <tuple>
 
 namespace vulkan {
 
@@ -13,11 +16,8 @@ Swapchain::Swapchain(Context& context, BufferManager& bufferManager, int width,
     : _context(context), _bufferManager(bufferManager) {
 
     descriptorSetLayout = _createDescriptorSetLayout();
-    // texture = std::make_unique<Texture>("../obj/cathedral/base_diff.jpg",
-    //                                     _bufferManager, _context);
-    texture = std::make_unique<Texture>("../obj/chalet/chalet.jpg",
-                                        _bufferManager, _context);
-    sampler = std::make_unique<Sampler>(_context, texture->mipLevels);
+    materials = std::make_unique<Materials>(_context, _bufferManager);
+    meshletCuller = std::make_unique<MeshletCuller>(_context, _bufferManager);
 
     _innerInit(width, height);
 }
@@ -25,7 +25,8 @@ Swapchain::Swapchain(Context& context, BufferManager& bufferManager, int width,
 Swapchain::~Swapchain() {
     _cleanup();
 
-    texture.reset();
+    materials.reset();
+    meshletCuller.reset();
 
     _context.device.destroy(descriptorSetLayout);
     for (auto& uniformBuffer : uniformBuffers) {
@@ -52,18 +53,225 @@ void Swapchain::updateUniformBuffer(uint32_t currentImage,
                    uniformBuffers[currentImage].allocation);
 }
 
-void Swapchain::beginMeshUpdates() {
-    _context.device.freeCommandBuffers(_context.commandPool, commandBuffers);
-    _meshes.clear();
-    commandBuffers = _createCommandBuffers();
-}
+std::size_t
+Swapchain::recordCommandBuffer(uint32_t image, const RenderQueue& queue,
+                               const std::vector<glm::mat4>& models,
+                               const std::vector<MeshBounds>& bounds,
+                               const LodView& lodView,
+                               const CullView& cullView,
+                               const glm::mat4& viewProjection) {
+    auto& cmdBuffer = commandBuffers[image];
+    cmdBuffer.reset({});
+
+    vk::CommandBufferBeginInfo beginInfo;
+    beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+    beginInfo.pInheritanceInfo = nullptr;
+
+    cmdBuffer.begin(beginInfo);
+    gpuTimer->writeBegin(cmdBuffer, image);
+
+    const auto& packets = queue.packets();
+
+    // the instances of draw i start at firstInstances[i], culled draws need
+    // it as the firstInstance of their indirect command
+    bool firstInstance = _context.enabledFeatures.drawIndirectFirstInstance;
+    uint32_t maxInstanceCount = 1;
+    for (const auto& packet : packets) {
+        maxInstanceCount
+            = std::max(maxInstanceCount, packet.mesh->instanceCount());
+    }
+    drawList->reset(image, packets.size(), maxInstanceCount);
+    std::vector<std::size_t> lods(packets.size());
+    std::vector<uint32_t> firstInstances(packets.size());
+    // index of the draw in culledDraws
+    std::vector<std::optional<uint32_t>> culled(packets.size());
+    std::vector<CulledDraw> culledDraws;
+    std::size_t triangles = 0;
+    uint32_t meshIdCount = 0;
+    for (std::size_t i = 0; i < packets.size(); ++i) {
+        auto mesh = packets[i].mesh;
+        const auto& model = models[packets[i].meshId];
+        lods[i] = mesh->selectLod(lodView, model);
+        firstInstances[i] = drawList->addInstances(image, *mesh, model);
+        // the meshlets are culled in mesh space, where the view is moved
+        // with the model but not with the instances: even a single one may
+        // move the mesh
+        if (lods[i] == 0 && mesh->meshlets().meshletCount > 0
+            && !mesh->hasInstances() && firstInstance
+            && MeshletCuller::canCull(model)) {
+            culled[i] = static_cast<uint32_t>(culledDraws.size());
+            culledDraws.push_back({mesh, firstInstances[i], model});
+        }
+        triangles += mesh->lod(lods[i]).indexCount / 3 * mesh->instanceCount();
+        meshIdCount = std::max(meshIdCount, packets[i].meshId + 1);
+    }
+    // compute passes can't run inside the render pass
+    meshletCuller->cull(cmdBuffer, image, culledDraws, cullView);
+
+    // the sort keys put the draws sharing a pipeline, material and geometry
+    // next to each other; the id of the geometry in a key may collide, so a
+    // batch still compares the actual state
+    bool indirect = drawMode == DrawMode::Indirect && firstInstance;
+    bool occlusion = indirect && occlusionCulling;
+    auto drawKey = [&](std::size_t i) {
+        auto mesh = packets[i].mesh;
+        auto binding = mesh->geometryBinding();
+        return std::make_tuple(mesh->vertexFormat(), mesh->material(),
+                               binding.vertexBuffer, binding.indexBuffer,
+                               binding.indexType);
+    };
+    if (occlusion) {
+        occlusionCuller->reset(image, packets.size(), packets.size(),
+                               meshIdCount);
+    }
 
-void Swapchain::addMesh(const Mesh* mesh) {
-    _meshes.push_back(mesh);
-}
+    // a single mesh, or a batch of commands drawn by one indirect call
+    struct DrawItem {
+        uint32_t packet;
+        std::size_t firstCommand;
+        std::size_t commandCount;
+        uint32_t batch;
+    };
+    std::vector<DrawItem> items;
+    uint32_t batchCount = 0;
+    for (std::size_t i = 0; i < packets.size(); ++i) {
+        auto packet = static_cast<uint32_t>(i);
+        if (culled[i] || !indirect) {
+            items.push_back({packet, 0, 0, 0});
+            continue;
+        }
+
+        auto end = i + 1;
+        while (end < packets.size() && !culled[end]
+               && drawKey(end) == drawKey(i)) {
+            ++end;
+        }
+        auto firstCommand = drawList->commandCount(image);
+        items.push_back({packet, firstCommand, end - i, batchCount});
+        if (occlusion) {
+            occlusionCuller->addBatch(image,
+                                      static_cast<uint32_t>(firstCommand));
+        }
+        for (auto j = i; j < end; ++j) {
+            auto mesh = packets[j].mesh;
+            drawList->addCommand(image,
+                                 mesh->drawCommand(lods[j], firstInstances[j]));
+            if (occlusion) {
+                occlusionCuller->addObject(image, bounds[packets[j].meshId],
+                                           packets[j].meshId, batchCount);
+            }
+        }
+        ++batchCount;
+        i = end - 1;
+    }
+    drawList->flush(image);
+    _bindObjects(image);
+    if (occlusion) {
+        occlusionCuller->flush(image);
+    }
+
+    std::array<vk::ClearValue, 2> clearColors;
+    clearColors[0].color = vk::ClearColorValue{
+        std::array<float, 4>{0.7f, 0.7f, 1.0f, 1.0f}}; // yes 3 braces
+    clearColors[1].depthStencil = vk::ClearDepthStencilValue{1.0f, 0};
 
-void Swapchain::endMeshUpdates() {
-    _updateCommandBuffers();
+    // without a phase every item is drawn, the early phase also draws the
+    // single meshes and the late one only the batches
+    auto drawPhase = [&](vk::RenderPass pass,
+                         std::optional<OcclusionPhase> phase) {
+        vk::RenderPassBeginInfo renderPassInfo;
+        renderPassInfo.renderPass = pass;
+        renderPassInfo.framebuffer = swapchainFramebuffers[image];
+        renderPassInfo.renderArea.offset = vk::Offset2D{0, 0};
+        renderPassInfo.renderArea.extent = extent;
+        renderPassInfo.clearValueCount = clearColors.size();
+        renderPassInfo.pClearValues = clearColors.data();
+
+        cmdBuffer.beginRenderPass(renderPassInfo,
+                                  vk::SubpassContents::eInline);
+
+        // both pipelines have the same layout, bound sets and push
+        // constants stay valid
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
+                                     pipeline->layout, 0,
+                                     descriptorSets[image], nullptr);
+        auto instanceShift = drawList->instanceShift(image);
+        cmdBuffer.pushConstants(pipeline->layout,
+                                vk::ShaderStageFlagBits::eVertex, 0,
+                                sizeof(instanceShift), &instanceShift);
+
+        // meshes share the buffers of the geometry arena, which usually
+        // makes for a single bind per pass
+        std::optional<VertexFormat> boundFormat;
+        std::optional<uint32_t> boundMaterial;
+        std::optional<GeometryBinding> boundGeometry;
+        for (const auto& item : items) {
+            if (phase == OcclusionPhase::Late && item.commandCount == 0) {
+                continue;
+            }
+
+            auto mesh = packets[item.packet].mesh;
+            if (boundFormat != mesh->vertexFormat()) {
+                boundFormat = mesh->vertexFormat();
+                auto& meshPipeline = *boundFormat == VertexFormat::Packed
+                                         ? packedPipeline
+                                         : pipeline;
+                cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics,
+                                       meshPipeline->pipeline);
+            }
+            if (boundMaterial != mesh->material()) {
+                boundMaterial = mesh->material();
+                cmdBuffer.bindDescriptorSets(
+                    vk::PipelineBindPoint::eGraphics, pipeline->layout, 1,
+                    materials->descriptorSet(*boundMaterial), nullptr);
+            }
+            if (boundGeometry != mesh->geometryBinding()) {
+                boundGeometry = mesh->geometryBinding();
+                mesh->bindGeometry(cmdBuffer);
+            }
+
+            if (culled[item.packet]) {
+                meshletCuller->draw(cmdBuffer, image, *culled[item.packet],
+                                    *mesh);
+                boundGeometry.reset();
+            } else if (item.commandCount == 0) {
+                mesh->writeCmdBuffer(cmdBuffer, lods[item.packet],
+                                     firstInstances[item.packet]);
+            } else if (!phase) {
+                _drawIndirect(cmdBuffer, drawList->commandBuffer(image),
+                              item.firstCommand, item.commandCount);
+            } else {
+                _drawIndirect(
+                    cmdBuffer, occlusionCuller->culledCommands(image),
+                    occlusionCuller->culledFirst(image, *phase,
+                                                 item.firstCommand),
+                    item.commandCount, occlusionCuller->countBuffer(image),
+                    occlusionCuller->countOffset(item.batch, *phase));
+            }
+        }
+
+        cmdBuffer.endRenderPass();
+    };
+
+    if (occlusion) {
+        // the early draws fill the depth the late phase tests against
+        occlusionCuller->cull(cmdBuffer, image, OcclusionPhase::Early,
+                              drawList->commandBuffer(image), *depthPyramid,
+                              viewProjection);
+        drawPhase(earlyRenderPass, OcclusionPhase::Early);
+        depthPyramid->build(cmdBuffer);
+        occlusionCuller->cull(cmdBuffer, image, OcclusionPhase::Late,
+                              drawList->commandBuffer(image), *depthPyramid,
+                              viewProjection);
+        drawPhase(lateRenderPass, OcclusionPhase::Late);
+    } else {
+        drawPhase(renderPass, std::nullopt);
+    }
+
+    gpuTimer->writeEnd(cmdBuffer, image);
+    cmdBuffer.end();
+
+    return triangles;
 }
 
 void Swapchain::_innerInit(int width, int height) {
@@ -71,17 +279,32 @@ void Swapchain::_innerInit(int width, int height) {
         = _createSwapChain(width, height);
     depthResources
         = std::make_unique<DepthResources>(_context, _bufferManager, extent);
-    renderPass = _createRenderPass();
+    renderPass = _createRenderPass(true, true);
+    earlyRenderPass = _createRenderPass(true, false);
+    lateRenderPass = _createRenderPass(false, true);
     // depthResources = std::make_unique<DepthResources>();
-    pipeline = std::make_unique<Pipeline>(_context.device, descriptorSetLayout,
-                                          extent, renderPass);
+    std::vector<vk::DescriptorSetLayout> setLayouts{
+        descriptorSetLayout, materials->descriptorSetLayout()};
+    pipeline = std::make_unique<Pipeline>(_context.device, setLayouts, extent,
+                                          renderPass);
+    packedPipeline = std::make_unique<Pipeline>(
+        _context.device, setLayouts, extent, renderPass, VertexFormat::Packed);
     swapchainFramebuffers = _createFramebuffers();
     descriptorPool = _createDescriptorPool();
 
     uniformBuffers = _createUniformBuffers(imageBuffers.size());
 
     descriptorSets = _createDescriptorSets();
+    _updateDescriptorSets();
+    _boundObjectCapacities.assign(imageBuffers.size(), 0);
+    _boundInstanceVersions.assign(imageBuffers.size(), 0);
     commandBuffers = _createCommandBuffers();
+    gpuTimer = std::make_unique<GpuTimer>(_context, imageBuffers.size());
+    drawList = std::make_unique<DrawList>(_bufferManager, imageBuffers.size());
+    depthPyramid = std::make_unique<DepthPyramid>(_context, _bufferManager,
+                                                  *depthResources, extent);
+    occlusionCuller = std::make_unique<OcclusionCuller>(
+        _context, _bufferManager, imageBuffers.size());
 }
 
 void Swapchain::_cleanup() {
@@ -98,8 +321,15 @@ void Swapchain::_cleanup() {
 
     _context.device.destroy(swapchain);
     pipeline.reset();
+    packedPipeline.reset();
     _context.device.destroy(renderPass);
+    _context.device.destroy(earlyRenderPass);
+    _context.device.destroy(lateRenderPass);
+    occlusionCuller.reset();
+    depthPyramid.reset();
     depthResources.reset();
+    gpuTimer.reset();
+    drawList.reset();
 }
 
 std::tuple<vk::SwapchainKHR, vk::Format, vk::Extent2D,
@@ -181,16 +411,24 @@ Swapchain::_createImageViews(std::vector<vk::Image> images, vk::Format format) {
     return buffers;
 }
 
-vk::RenderPass Swapchain::_createRenderPass() {
+vk::RenderPass Swapchain::_createRenderPass(bool clear, bool present) {
+    // a pass that doesn't clear continues the one that doesn't present
+    auto loadOp = clear ? vk::AttachmentLoadOp::eClear
+                        : vk::AttachmentLoadOp::eLoad;
+
     vk::AttachmentDescription colorAttachment;
     colorAttachment.format = format;
     colorAttachment.samples = vk::SampleCountFlagBits::e1;
-    colorAttachment.loadOp = vk::AttachmentLoadOp::eClear;
+    colorAttachment.loadOp = loadOp;
     colorAttachment.storeOp = vk::AttachmentStoreOp::eStore;
     colorAttachment.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
     colorAttachment.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
-    colorAttachment.initialLayout = vk::ImageLayout::eUndefined;
-    colorAttachment.finalLayout = vk::ImageLayout::ePresentSrcKHR;
+    colorAttachment.initialLayout
+        = clear ? vk::ImageLayout::eUndefined
+                : vk::ImageLayout::eColorAttachmentOptimal;
+    colorAttachment.finalLayout
+        = present ? vk::ImageLayout::ePresentSrcKHR
+                  : vk::ImageLayout::eColorAttachmentOptimal;
 
     vk::AttachmentReference colorAttachmentRef;
     colorAttachmentRef.attachment = 0;
@@ -199,11 +437,15 @@ vk::RenderPass Swapchain::_createRenderPass() {
     vk::AttachmentDescription depthAttachment;
     depthAttachment.format = depthResources->depthFormat;
     depthAttachment.samples = vk::SampleCountFlagBits::e1;
-    depthAttachment.loadOp = vk::AttachmentLoadOp::eClear;
-    depthAttachment.storeOp = vk::AttachmentStoreOp::eDontCare;
+    depthAttachment.loadOp = loadOp;
+    // the depth pyramid is built from the depth of the early pass
+    depthAttachment.storeOp = present ? vk::AttachmentStoreOp::eDontCare
+                                      : vk::AttachmentStoreOp::eStore;
     depthAttachment.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
     depthAttachment.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
-    depthAttachment.initialLayout = vk::ImageLayout::eUndefined;
+    depthAttachment.initialLayout
+        = clear ? vk::ImageLayout::eUndefined
+                : vk::ImageLayout::eDepthStencilAttachmentOptimal;
     depthAttachment.finalLayout
         = vk::ImageLayout::eDepthStencilAttachmentOptimal;
 
@@ -233,6 +475,21 @@ vk::RenderPass Swapchain::_createRenderPass() {
     dependency.dstStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
     dependency.dstAccessMask = vk::AccessFlagBits::eColorAttachmentRead
                                | vk::AccessFlagBits::eColorAttachmentWrite;
+    if (!clear || !present) {
+        // the early pass writes the depth the last pyramid build may still
+        // read, the late one draws over the early one
+        dependency.srcStageMask
+            |= vk::PipelineStageFlagBits::eComputeShader
+               | vk::PipelineStageFlagBits::eLateFragmentTests;
+        dependency.srcAccessMask
+            = vk::AccessFlagBits::eColorAttachmentWrite
+              | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+        dependency.dstStageMask
+            |= vk::PipelineStageFlagBits::eEarlyFragmentTests;
+        dependency.dstAccessMask
+            |= vk::AccessFlagBits::eDepthStencilAttachmentRead
+               | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+    }
 
     renderPassInfo.dependencyCount = 1;
     renderPassInfo.pDependencies = &dependency;
@@ -269,12 +526,13 @@ vk::DescriptorPool Swapchain::_createDescriptorPool() {
     uniformPoolSize.type = vk::DescriptorType::eUniformBuffer;
     uniformPoolSize.descriptorCount = size;
 
-    vk::DescriptorPoolSize samplerPoolSize;
-    samplerPoolSize.type = vk::DescriptorType::eCombinedImageSampler;
-    samplerPoolSize.descriptorCount = size;
+    // the objects and the instances
+    vk::DescriptorPoolSize objectPoolSize;
+    objectPoolSize.type = vk::DescriptorType::eStorageBuffer;
+    objectPoolSize.descriptorCount = size * 2;
 
     std::array<vk::DescriptorPoolSize, 2> poolSizes
-        = {uniformPoolSize, samplerPoolSize};
+        = {uniformPoolSize, objectPoolSize};
 
     vk::DescriptorPoolCreateInfo poolInfo;
     poolInfo.poolSizeCount = poolSizes.size();
@@ -292,15 +550,18 @@ vk::DescriptorSetLayout Swapchain::_createDescriptorSetLayout() {
     uboLayoutBinding.stageFlags = vk::ShaderStageFlagBits::eVertex;
     uboLayoutBinding.pImmutableSamplers = nullptr;
 
-    vk::DescriptorSetLayoutBinding samplerBinding;
-    samplerBinding.binding = 1;
-    samplerBinding.descriptorCount = 1;
-    samplerBinding.descriptorType = vk::DescriptorType::eCombinedImageSampler;
-    samplerBinding.pImmutableSamplers = nullptr;
-    samplerBinding.stageFlags = vk::ShaderStageFlagBits::eFragment;
+    vk::DescriptorSetLayoutBinding objectBinding;
+    objectBinding.binding = 1;
+    objectBinding.descriptorCount = 1;
+    objectBinding.descriptorType = vk::DescriptorType::eStorageBuffer;
+    objectBinding.pImmutableSamplers = nullptr;
+    objectBinding.stageFlags = vk::ShaderStageFlagBits::eVertex;
+
+    vk::DescriptorSetLayoutBinding instanceBinding = objectBinding;
+    instanceBinding.binding = 2;
 
-    std::array<vk::DescriptorSetLayoutBinding, 2> bindings
-        = {uboLayoutBinding, samplerBinding};
+    std::array<vk::DescriptorSetLayoutBinding, 3> bindings
+        = {uboLayoutBinding, objectBinding, instanceBinding};
 
     vk::DescriptorSetLayoutCreateInfo layoutInfo;
     layoutInfo.bindingCount = bindings.size();
@@ -329,11 +590,6 @@ void Swapchain::_updateDescriptorSets() {
         bufferInfo.offset = 0;
         bufferInfo.range = sizeof(scene::UniformBufferObject);
 
-        vk::DescriptorImageInfo imageInfo;
-        imageInfo.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-        imageInfo.imageView = texture->textureImageView;
-        imageInfo.sampler = sampler->sampler;
-
         vk::WriteDescriptorSet descriptorWriteUniform;
         descriptorWriteUniform.dstSet = descriptorSets[i];
         descriptorWriteUniform.dstBinding = 0;
@@ -345,20 +601,55 @@ void Swapchain::_updateDescriptorSets() {
         descriptorWriteUniform.pImageInfo = nullptr;
         descriptorWriteUniform.pTexelBufferView = nullptr;
 
-        vk::WriteDescriptorSet descriptorWriteSampler;
-        descriptorWriteSampler.dstSet = descriptorSets[i];
-        descriptorWriteSampler.dstBinding = 1;
-        descriptorWriteSampler.dstArrayElement = 0;
-        descriptorWriteSampler.descriptorType
-            = vk::DescriptorType::eCombinedImageSampler;
-        descriptorWriteSampler.descriptorCount = 1;
-        descriptorWriteSampler.pImageInfo = &imageInfo;
-
-        _context.device.updateDescriptorSets(
-            {descriptorWriteUniform, descriptorWriteSampler}, nullptr);
+        _context.device.updateDescriptorSets(descriptorWriteUniform, nullptr);
     }
 }
 
+void Swapchain::_bindObjects(uint32_t image) {
+    // the set is only written when the draw list grew or the instance buffer
+    // was replaced, the previous frame of image no longer uses it
+    auto version = _bufferManager.instanceBufferVersion();
+    if (version != _boundInstanceVersions[image]) {
+        _boundInstanceVersions[image] = version;
+
+        vk::DescriptorBufferInfo bufferInfo;
+        bufferInfo.buffer = _bufferManager.instanceBuffer();
+        bufferInfo.offset = 0;
+        bufferInfo.range = VK_WHOLE_SIZE;
+
+        vk::WriteDescriptorSet descriptorWrite;
+        descriptorWrite.dstSet = descriptorSets[image];
+        descriptorWrite.dstBinding = 2;
+        descriptorWrite.dstArrayElement = 0;
+        descriptorWrite.descriptorType = vk::DescriptorType::eStorageBuffer;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.pBufferInfo = &bufferInfo;
+
+        _context.device.updateDescriptorSets(descriptorWrite, nullptr);
+    }
+
+    auto capacity = drawList->objectCapacity(image);
+    if (capacity == _boundObjectCapacities[image]) {
+        return;
+    }
+    _boundObjectCapacities[image] = capacity;
+
+    vk::DescriptorBufferInfo bufferInfo;
+    bufferInfo.buffer = drawList->objectBuffer(image);
+    bufferInfo.offset = 0;
+    bufferInfo.range = VK_WHOLE_SIZE;
+
+    vk::WriteDescriptorSet descriptorWrite;
+    descriptorWrite.dstSet = descriptorSets[image];
+    descriptorWrite.dstBinding = 1;
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType = vk::DescriptorType::eStorageBuffer;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pBufferInfo = &bufferInfo;
+
+    _context.device.updateDescriptorSets(descriptorWrite, nullptr);
+}
+
 std::vector<vk::CommandBuffer> Swapchain::_createCommandBuffers() {
     vk::CommandBufferAllocateInfo allocInfo;
     allocInfo.commandPool = _context.commandPool;
@@ -369,43 +660,33 @@ std::vector<vk::CommandBuffer> Swapchain::_createCommandBuffers() {
     return _context.device.allocateCommandBuffers(allocInfo);
 }
 
-void Swapchain::_updateCommandBuffers() {
-    _updateDescriptorSets();
-
-    for (std::size_t i = 0; i < commandBuffers.size(); ++i) {
-        auto& cmdBuffer = commandBuffers[i];
-
-        vk::CommandBufferBeginInfo beginInfo;
-        beginInfo.flags = vk::CommandBufferUsageFlagBits::eSimultaneousUse;
-        beginInfo.pInheritanceInfo = nullptr;
-
-        cmdBuffer.begin(beginInfo);
-
-        vk::RenderPassBeginInfo renderPassInfo;
-        renderPassInfo.renderPass = renderPass;
-        renderPassInfo.framebuffer = swapchainFramebuffers[i];
-        renderPassInfo.renderArea.offset = vk::Offset2D{0, 0};
-        renderPassInfo.renderArea.extent = extent;
-
-        std::array<vk::ClearValue, 2> clearColors;
-        clearColors[0].color = vk::ClearColorValue{
-            std::array<float, 4>{0.7f, 0.7f, 1.0f, 1.0f}}; // yes 3 braces
-        clearColors[1].depthStencil = vk::ClearDepthStencilValue{1.0f, 0};
-
-        renderPassInfo.clearValueCount = clearColors.size();
-        renderPassInfo.pClearValues = clearColors.data();
-
-        cmdBuffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eInline);
-        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics,
-                               pipeline->pipeline);
+void Swapchain::_drawIndirect(vk::CommandBuffer cmdBuffer, vk::Buffer buffer,
+                              std::size_t firstCommand,
+                              std::size_t commandCount, vk::Buffer countBuffer,
+                              vk::DeviceSize countOffset) {
+    constexpr auto stride = sizeof(vk::DrawIndexedIndirectCommand);
+    std::size_t maxDrawCount = 1;
+    if (_context.enabledFeatures.multiDrawIndirect) {
+        maxDrawCount = _context.physicalDevice.getProperties()
+                           .limits.maxDrawIndirectCount;
+    }
 
-        for (auto mesh : _meshes) {
-            mesh->writeCmdBuffer(cmdBuffer, descriptorSets[i],
-                                 pipeline->layout);
-        }
+    // otherwise the commands past the count are empty draws
+    if (countBuffer && _context.cmdDrawIndexedIndirectCount
+        && commandCount <= maxDrawCount && maxDrawCount > 1) {
+        _context.cmdDrawIndexedIndirectCount(
+            static_cast<VkCommandBuffer>(cmdBuffer),
+            static_cast<VkBuffer>(buffer), firstCommand * stride,
+            static_cast<VkBuffer>(countBuffer), countOffset,
+            static_cast<uint32_t>(commandCount), stride);
+        return;
+    }
 
-        cmdBuffer.endRenderPass();
-        cmdBuffer.end();
+    auto end = firstCommand + commandCount;
+    for (auto first = firstCommand; first < end; first += maxDrawCount) {
+        auto count = std::min(maxDrawCount, end - first);
+        cmdBuffer.drawIndexedIndirect(buffer, first * stride,
+                                      static_cast<uint32_t>(count), stride);
     }
 }
 
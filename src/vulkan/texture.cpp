@@ -1,19 +1,42 @@
 #include "vulkan/texture.hpp"
 
+#include <algorithm>
 #include <cmath>
-#include <cstring>
+#include <optional>
 #include <stdexcept>
 
 #include "vk_mem_alloc.h"
+#include "vulkan/upload_batch.hpp"
 #include "vulkan/utils.hpp"
 
 namespace vulkan {
 
 Texture::Texture(const std::string& path, BufferManager& bufferManager,
-                 Context& context)
+                 Context& context, UploadBatch* batch)
     : _bufferManager(bufferManager), _context(context) {
 
-    std::tie(textureImage, mipLevels) = _createTextureImage(path);
+    // waited for when it goes out of scope
+    std::optional<UploadBatch> ownBatch;
+    if (!batch) {
+        batch = &ownBatch.emplace(_bufferManager);
+    }
+    std::tie(textureImage, mipLevels) = _createTextureImage(path, *batch);
+    textureImageView = utils::createImageView(
+        textureImage.image, vk::Format::eR8G8B8A8Unorm,
+        vk::ImageAspectFlagBits::eColor, mipLevels, _context.device);
+}
+
+Texture::Texture(const stbi_uc* pixels, uint32_t width, uint32_t height,
+                 BufferManager& bufferManager, Context& context,
+                 UploadBatch* batch)
+    : _bufferManager(bufferManager), _context(context) {
+
+    std::optional<UploadBatch> ownBatch;
+    if (!batch) {
+        batch = &ownBatch.emplace(_bufferManager);
+    }
+    std::tie(textureImage, mipLevels)
+        = _createTextureImage(pixels, width, height, *batch);
     textureImageView = utils::createImageView(
         textureImage.image, vk::Format::eR8G8B8A8Unorm,
         vk::ImageAspectFlagBits::eColor, mipLevels, _context.device);
@@ -25,30 +48,29 @@ Texture::~Texture() {
 }
 
 std::pair<Image, uint32_t>
-Texture::_createTextureImage(const std::string& path) {
+Texture::_createTextureImage(const std::string& path, UploadBatch& batch) {
     int width, height, channels;
     stbi_uc* pixels
         = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+    if (!pixels) {
+        throw std::runtime_error("failed to load texture image " + path);
+    }
 
+    // the batch keeps a copy of the pixels
+    auto result = _createTextureImage(pixels, width, height, batch);
+    stbi_image_free(pixels);
+    return result;
+}
+
+std::pair<Image, uint32_t>
+Texture::_createTextureImage(const stbi_uc* pixels, uint32_t width,
+                             uint32_t height, UploadBatch& batch) {
     uint32_t mipLevels
         = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height))))
           + 1;
 
     vk::DeviceSize size = width * height * 4; // 4 because RGBA
 
-    if (!pixels) {
-        throw std::runtime_error("failed to load texture image");
-    }
-
-    auto stagingBuffer = _bufferManager.createBuffer(
-        size, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_ONLY);
-
-    void* data;
-    vmaMapMemory(_bufferManager.allocator, stagingBuffer.allocation, &data);
-    std::memcpy(data, pixels, static_cast<std::size_t>(size));
-    vmaUnmapMemory(_bufferManager.allocator, stagingBuffer.allocation);
-    stbi_image_free(pixels);
-
     auto format = vk::Format::eR8G8B8A8Unorm;
     auto image = _bufferManager.createImage(
         width, height, mipLevels, format, vk::ImageTiling::eOptimal,
@@ -57,27 +79,27 @@ Texture::_createTextureImage(const std::string& path) {
             | vk::ImageUsageFlagBits::eSampled,
         VMA_MEMORY_USAGE_GPU_ONLY);
 
-    utils::transitionImageLayout(
-        image.image, format, vk::ImageLayout::eUndefined,
-        vk::ImageLayout::eTransferDstOptimal, mipLevels, _context);
-
-    _bufferManager.copyBufferToImage(stagingBuffer.buffer, image.image, width,
-                                     height);
+    batch.transitionImageLayout(image.image, format,
+                                vk::ImageLayout::eUndefined,
+                                vk::ImageLayout::eTransferDstOptimal,
+                                mipLevels);
+    batch.copyBufferToImage(pixels, size, image.image, width, height,
+                            mipLevels);
 
     /*utils::transitionImageLayout(image.image, format,
                                  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
                                  VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
                                  mipLevels, _device, commandPool);*/
     // the transition ot VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL is done in the
-    // mipmap generation
-    _generateMipLevels(image.image, format, width, height, mipLevels);
-
-    _bufferManager.destroyBuffer(stagingBuffer);
+    // mipmap generation, the blits need the graphics queue
+    _generateMipLevels(batch.graphicsCommandBuffer(), image.image, format,
+                       width, height, mipLevels);
 
     return std::make_pair(image, mipLevels);
 }
 
-void Texture::_generateMipLevels(vk::Image image, vk::Format format,
+void Texture::_generateMipLevels(vk::CommandBuffer commandBuffer,
+                                 vk::Image image, vk::Format format,
                                  uint32_t width, uint32_t height,
                                  uint32_t mipLevels) {
 
@@ -88,8 +110,6 @@ void Texture::_generateMipLevels(vk::Image image, vk::Format format,
             "texture image format does not support linear blitting");
     }
 
-    auto commandBuffer = _context.beginSingleTimeCommands();
-
     vk::ImageMemoryBarrier barrier;
     barrier.image = image;
     barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
@@ -158,8 +178,6 @@ void Texture::_generateMipLevels(vk::Image image, vk::Format format,
     commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
                                   vk::PipelineStageFlagBits::eFragmentShader,
                                   {}, nullptr, nullptr, barrier);
-
-    _context.endSingleTimeCommands(commandBuffer);
 }
 
 } // namespace vulkan
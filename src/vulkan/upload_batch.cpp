@@ -0,0 +1,223 @@
+#include "vulkan/upload_batch.hpp"
+
+#include <exception>
+#include <iostream>
+#include <mutex>
+
+#include "vulkan/context.hpp"
+#include "vulkan/utils.hpp"
+
+namespace vulkan {
+
+namespace {
+
+// buffers are read as geometry, by shaders or by later copies
+const vk::PipelineStageFlags readStages
+    = vk::PipelineStageFlagBits::eVertexInput
+      | vk::PipelineStageFlagBits::eVertexShader
+      | vk::PipelineStageFlagBits::eFragmentShader
+      | vk::PipelineStageFlagBits::eComputeShader
+      | vk::PipelineStageFlagBits::eTransfer;
+const vk::AccessFlags readAccess = vk::AccessFlagBits::eVertexAttributeRead
+                                   | vk::AccessFlagBits::eIndexRead
+                                   | vk::AccessFlagBits::eShaderRead
+                                   | vk::AccessFlagBits::eTransferRead;
+
+} // namespace
+
+UploadBatch::UploadBatch(BufferManager& bufferManager)
+    : _bufferManager(bufferManager), _context(bufferManager.context()),
+      _transfer(_context.hasTransferQueue()) {
+
+    _copyCommands = _context.beginSingleTimeCommands(_transfer);
+    if (!_transfer) {
+        _graphicsCommands = _copyCommands;
+    }
+    _fence = std::make_shared<UploadFence>(_context.device);
+}
+
+UploadBatch::~UploadBatch() {
+    // the staging ring waits for the fence, it must be signalled some day;
+    // the destructor may run while an exception unwinds, so it only logs
+    try {
+        wait();
+    } catch (std::exception& e) {
+        std::cerr << "failed to wait for an upload batch: " << e.what()
+                  << std::endl;
+    }
+    _context.freeSingleTimeCommands(_copyCommands, _transfer);
+    if (_transfer) {
+        if (_acquireCommands) {
+            _context.freeSingleTimeCommands(_acquireCommands);
+        }
+        if (_graphicsCommands) {
+            _context.freeSingleTimeCommands(_graphicsCommands);
+        }
+        _context.device.destroy(_copiesDone);
+    }
+}
+
+void UploadBatch::copyBuffer(const void* data, vk::DeviceSize size,
+                             vk::Buffer dstBuffer, vk::DeviceSize dstOffset) {
+    auto slice = _bufferManager.stage(data, size, _fence);
+    _uploadedSize += size;
+
+    vk::BufferCopy copyRegion = {};
+    copyRegion.srcOffset = slice.offset;
+    copyRegion.dstOffset = dstOffset;
+    copyRegion.size = size;
+    _copyCommands.copyBuffer(slice.buffer, dstBuffer, copyRegion);
+
+    if (_transfer) {
+        vk::BufferMemoryBarrier release;
+        release.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+        release.srcQueueFamilyIndex = _context.transferFamily;
+        release.dstQueueFamilyIndex = _context.graphicsFamily;
+        release.buffer = dstBuffer;
+        release.offset = dstOffset;
+        release.size = size;
+        _bufferReleases.push_back(release);
+    }
+}
+
+void UploadBatch::copyBufferToImage(const void* data, vk::DeviceSize size,
+                                    vk::Image image, uint32_t width,
+                                    uint32_t height, uint32_t mipLevels) {
+    auto slice = _bufferManager.stage(data, size, _fence);
+    _uploadedSize += size;
+
+    vk::BufferImageCopy region = {};
+    region.bufferOffset = slice.offset;
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+
+    region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+
+    region.imageOffset = vk::Offset3D{0, 0, 0};
+    region.imageExtent = vk::Extent3D{width, height, 1};
+
+    _copyCommands.copyBufferToImage(
+        slice.buffer, image, vk::ImageLayout::eTransferDstOptimal, region);
+
+    if (_transfer) {
+        vk::ImageMemoryBarrier release;
+        release.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+        release.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+        release.newLayout = vk::ImageLayout::eTransferDstOptimal;
+        release.srcQueueFamilyIndex = _context.transferFamily;
+        release.dstQueueFamilyIndex = _context.graphicsFamily;
+        release.image = image;
+        release.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
+        release.subresourceRange.baseMipLevel = 0;
+        release.subresourceRange.levelCount = mipLevels;
+        release.subresourceRange.baseArrayLayer = 0;
+        release.subresourceRange.layerCount = 1;
+        _imageReleases.push_back(release);
+    }
+}
+
+void UploadBatch::transitionImageLayout(vk::Image image, vk::Format format,
+                                        vk::ImageLayout oldLayout,
+                                        vk::ImageLayout newLayout,
+                                        uint32_t mipLevels) {
+    utils::transitionImageLayout(_copyCommands, image, format, oldLayout,
+                                 newLayout, mipLevels);
+}
+
+vk::CommandBuffer UploadBatch::graphicsCommandBuffer() {
+    if (!_graphicsCommands) {
+        _graphicsCommands = _context.beginSingleTimeCommands();
+    }
+    return _graphicsCommands;
+}
+
+const std::shared_ptr<UploadFence>& UploadBatch::submit() {
+    if (_submitted) {
+        return _fence;
+    }
+    _submitted = true;
+
+    if (!_transfer) {
+        vk::MemoryBarrier barrier;
+        barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+        barrier.dstAccessMask = readAccess;
+        _copyCommands.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                      readStages, {}, barrier, nullptr,
+                                      nullptr);
+        _context.submitSingleTimeCommands(_copyCommands, _fence->fence);
+        _fence->submitted = true;
+        return _fence;
+    }
+
+    _submitTransfer();
+
+    // the same barriers, from the point of view of the graphics family
+    auto bufferAcquires = _bufferReleases;
+    for (auto& acquire : bufferAcquires) {
+        acquire.srcAccessMask = {};
+        acquire.dstAccessMask = readAccess;
+    }
+    auto imageAcquires = _imageReleases;
+    for (auto& acquire : imageAcquires) {
+        acquire.srcAccessMask = {};
+        acquire.dstAccessMask = vk::AccessFlagBits::eTransferRead
+                                | vk::AccessFlagBits::eTransferWrite
+                                | vk::AccessFlagBits::eShaderRead;
+    }
+    _acquireCommands = _context.beginSingleTimeCommands();
+    if (!bufferAcquires.empty() || !imageAcquires.empty()) {
+        _acquireCommands.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe,
+                                         readStages, {}, nullptr,
+                                         bufferAcquires, imageAcquires);
+    }
+    _acquireCommands.end();
+
+    std::vector<vk::CommandBuffer> commandBuffers{_acquireCommands};
+    if (_graphicsCommands) {
+        _graphicsCommands.end();
+        commandBuffers.push_back(_graphicsCommands);
+    }
+
+    vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eAllCommands;
+    vk::SubmitInfo submitInfo;
+    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.pWaitSemaphores = &_copiesDone;
+    submitInfo.pWaitDstStageMask = &waitStage;
+    submitInfo.commandBufferCount
+        = static_cast<uint32_t>(commandBuffers.size());
+    submitInfo.pCommandBuffers = commandBuffers.data();
+
+    std::lock_guard<std::mutex> lock(_context.queueMutex);
+    _context.graphicsQueue.submit(submitInfo, _fence->fence);
+    _fence->submitted = true;
+    return _fence;
+}
+
+void UploadBatch::wait() {
+    submit()->wait();
+}
+
+void UploadBatch::_submitTransfer() {
+    if (!_bufferReleases.empty() || !_imageReleases.empty()) {
+        _copyCommands.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                      vk::PipelineStageFlagBits::eBottomOfPipe,
+                                      {}, nullptr, _bufferReleases,
+                                      _imageReleases);
+    }
+    _copyCommands.end();
+
+    _copiesDone = _context.device.createSemaphore(vk::SemaphoreCreateInfo());
+    vk::SubmitInfo submitInfo;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &_copyCommands;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &_copiesDone;
+
+    std::lock_guard<std::mutex> lock(_context.transferQueueMutex());
+    _context.transferQueue.submit(submitInfo, nullptr);
+}
+
+} // namespace vulkan
@@ -181,6 +181,18 @@ QueueFamilyIndices findQueueFamilies(vk::PhysicalDevice device,
         i++;
     }
 
+    auto graphicsOrCompute
+        = vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute;
+    for (uint32_t family = 0; family < queueFamilies.size(); ++family) {
+        const auto& queueFamily = queueFamilies[family];
+        if (queueFamily.queueCount > 0
+            && queueFamily.queueFlags & vk::QueueFlagBits::eTransfer
+            && !(queueFamily.queueFlags & graphicsOrCompute)) {
+            indices.transferFamily = family;
+            break;
+        }
+    }
+
     return indices;
 }
 
@@ -251,7 +263,8 @@ uint32_t findMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags properties,
 
 vk::ImageView createImageView(vk::Image image, vk::Format format,
                               vk::ImageAspectFlags aspectFlags,
-                              uint32_t mipLevels, vk::Device device) {
+                              uint32_t mipLevels, vk::Device device,
+                              uint32_t baseMipLevel) {
     vk::ImageViewCreateInfo createInfo;
     createInfo.image = image;
     createInfo.viewType = vk::ImageViewType::e2D;
@@ -261,7 +274,7 @@ vk::ImageView createImageView(vk::Image image, vk::Format format,
         = createInfo.components.a = vk::ComponentSwizzle::eIdentity;
 
     createInfo.subresourceRange.aspectMask = aspectFlags;
-    createInfo.subresourceRange.baseMipLevel = 0;
+    createInfo.subresourceRange.baseMipLevel = baseMipLevel;
     createInfo.subresourceRange.levelCount = mipLevels;
     createInfo.subresourceRange.baseArrayLayer = 0;
     createInfo.subresourceRange.layerCount = 1;
@@ -273,7 +286,14 @@ void transitionImageLayout(vk::Image image, vk::Format format,
                            vk::ImageLayout oldLayout, vk::ImageLayout newLayout,
                            uint32_t mipLevels, Context& context) {
     auto commandBuffer = context.beginSingleTimeCommands();
+    transitionImageLayout(commandBuffer, image, format, oldLayout, newLayout,
+                          mipLevels);
+    context.endSingleTimeCommands(commandBuffer);
+}
 
+void transitionImageLayout(vk::CommandBuffer commandBuffer, vk::Image image,
+                           vk::Format format, vk::ImageLayout oldLayout,
+                           vk::ImageLayout newLayout, uint32_t mipLevels) {
     vk::ImageMemoryBarrier barrier = {};
     barrier.oldLayout = oldLayout;
     barrier.newLayout = newLayout;
@@ -322,14 +342,20 @@ void transitionImageLayout(vk::Image image, vk::Format format,
 
         sourceStage = vk::PipelineStageFlagBits::eTopOfPipe;
         destinationStage = vk::PipelineStageFlagBits::eEarlyFragmentTests;
+    } else if (oldLayout == vk::ImageLayout::eUndefined
+               && newLayout == vk::ImageLayout::eGeneral) {
+        barrier.srcAccessMask = {};
+        barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead
+                                | vk::AccessFlagBits::eShaderWrite;
+
+        sourceStage = vk::PipelineStageFlagBits::eTopOfPipe;
+        destinationStage = vk::PipelineStageFlagBits::eComputeShader;
     } else {
         throw std::runtime_error("unsupported layout transition");
     }
 
     commandBuffer.pipelineBarrier(sourceStage, destinationStage, {}, nullptr,
                                   nullptr, barrier);
-
-    context.endSingleTimeCommands(commandBuffer);
 }
 
 bool hasStencilComponent(vk::Format format) {
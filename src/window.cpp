@@ -105,6 +105,17 @@ void key_callback(GLFWwindow* window, int key, int /*scancode*/, int action,
         coupler->game.setInputState(InputState::Back, pressed);
     } else if (key == GLFW_KEY_D) {
         coupler->game.setInputState(InputState::Right, pressed);
+    } else if (key == GLFW_KEY_F && pressed) {
+        // what the camera looks at
+        const auto& camera = coupler->game.getCamera();
+        auto hit = coupler->renderer.pick(
+            vulkan::Ray{camera.cameraPos, camera.cameraFront});
+        if (hit) {
+            std::cout << "looking at mesh " << hit->mesh << ", "
+                      << hit->distance << " units away\n";
+        } else {
+            std::cout << "looking at nothing\n";
+        }
     } else if (key == GLFW_KEY_P && pressed) {
         if (coupler->paused) {
             glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);